@@ -0,0 +1,86 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "BoxBVH.hpp"
+
+using namespace admm;
+
+void BoxBVH::build( const std::vector<Eigen::Vector3d> &centers ){
+
+	const int n = centers.size();
+	nodes.clear();
+	indices.resize( n );
+	for( int i=0; i<n; ++i ){ indices[i] = i; }
+	if( n == 0 ){ return; }
+	nodes.reserve( 2*n/leaf_size + 1 );
+	build_node( centers, 0, n, 0 );
+}
+
+
+int BoxBVH::build_node( const std::vector<Eigen::Vector3d> &centers, int first, int count, int depth ){
+
+	const int idx = nodes.size();
+	nodes.push_back( Node() );
+	Node node = Node();
+	node.first = first;
+	node.count = count;
+	node.left = -1;
+	node.right = -1;
+
+	Eigen::Vector3d cmin = centers[ indices[first] ], cmax = cmin;
+	for( int i=first+1; i<first+count; ++i ){
+		cmin = cmin.cwiseMin( centers[ indices[i] ] );
+		cmax = cmax.cwiseMax( centers[ indices[i] ] );
+	}
+
+	// Median split along the longest axis of the centers.
+	// The tree is balanced, so max_depth (the query stack) is never reached.
+	int axis = 0;
+	( cmax - cmin ).maxCoeff( &axis );
+	if( count > leaf_size && depth < max_depth-2 && cmax[axis] > cmin[axis] ){
+		const int half = count/2;
+		std::nth_element( indices.begin()+first, indices.begin()+first+half, indices.begin()+first+count,
+			[&]( int a, int b ){ return centers[a][axis] < centers[b][axis]; } );
+		node.left = build_node( centers, first, half, depth+1 );
+		node.right = build_node( centers, first+half, count-half, depth+1 );
+	}
+
+	nodes[idx] = node;
+	return idx;
+}
+
+
+void BoxBVH::refit(){
+
+	// Children come after their parents
+	for( int i=nodes.size()-1; i>=0; --i ){
+		Node &node = nodes[i];
+		if( node.left < 0 ){
+			node.bmin = box_min[ indices[node.first] ];
+			node.bmax = box_max[ indices[node.first] ];
+			for( int j=1; j<node.count; ++j ){
+				node.bmin = node.bmin.cwiseMin( box_min[ indices[node.first+j] ] );
+				node.bmax = node.bmax.cwiseMax( box_max[ indices[node.first+j] ] );
+			}
+		} else {
+			node.bmin = nodes[node.left].bmin.cwiseMin( nodes[node.right].bmin );
+			node.bmax = nodes[node.left].bmax.cwiseMax( nodes[node.right].bmax );
+		}
+	}
+}
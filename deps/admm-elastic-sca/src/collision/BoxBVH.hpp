@@ -0,0 +1,124 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef BOX_BVH_HPP
+#define BOX_BVH_HPP
+
+#include <Eigen/Dense>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+namespace admm {
+
+//
+//	Bounding volume hierarchy over axis-aligned boxes, shared by TriangleBVH
+//	and ShapeBVH. The topology is built once from the box centers (median splits
+//	along the longest axis), and refit updates the node boxes from box_min/max.
+//	Nodes are stored parent before children, so refitting is a reverse pass.
+//
+class BoxBVH {
+public:
+	struct Node {
+		Eigen::Vector3d bmin, bmax;
+		int left, right; // children, or -1 for leaves
+		int first, count; // leaves: range in indices
+	};
+
+	std::vector<Node> nodes; // root is nodes[0]
+	std::vector<int> indices; // item indices ordered by leaf
+	std::vector<Eigen::Vector3d> box_min, box_max; // per item boxes
+	static const int leaf_size = 4;
+	static const int max_depth = 64;
+
+	// Builds the tree from the centers of the items' boxes. Node boxes
+	// are set by refit, once box_min and box_max are.
+	void build( const std::vector<Eigen::Vector3d> &centers );
+
+	// Updates the node boxes to contain the item boxes
+	void refit();
+
+	// Calls f(item_index) for each item whose box overlaps [bmin,bmax]
+	template<typename F> void query( const Eigen::Vector3d &bmin, const Eigen::Vector3d &bmax, F f ) const;
+
+	// Finds the closest item to p at any distance. Calls d2 = f(item_index), the
+	// squared distance of p to the item, nearer boxes first, skipping items whose
+	// box is farther than the smallest d2 so far. Boxes must contain the items.
+	template<typename F> void closest( const Eigen::Vector3d &p, F f ) const;
+
+protected:
+	int build_node( const std::vector<Eigen::Vector3d> &centers, int first, int count, int depth );
+
+	static inline bool overlaps( const Eigen::Vector3d &amin, const Eigen::Vector3d &amax,
+		const Eigen::Vector3d &bmin, const Eigen::Vector3d &bmax ){
+		return !( amax[0] < bmin[0] || amin[0] > bmax[0] || amax[1] < bmin[1] ||
+			amin[1] > bmax[1] || amax[2] < bmin[2] || amin[2] > bmax[2] );
+	}
+
+	static inline double box_dist2( const Eigen::Vector3d &bmin, const Eigen::Vector3d &bmax, const Eigen::Vector3d &p ){
+		return ( bmin-p ).cwiseMax( p-bmax ).cwiseMax( 0.0 ).squaredNorm();
+	}
+};
+
+template<typename F> void BoxBVH::query( const Eigen::Vector3d &bmin, const Eigen::Vector3d &bmax, F f ) const {
+	if( nodes.size() == 0 ){ return; }
+	int stack[max_depth];
+	int n_stack = 0;
+	stack[n_stack++] = 0;
+	while( n_stack > 0 ){
+		const Node &node = nodes[ stack[--n_stack] ];
+		if( !overlaps( node.bmin, node.bmax, bmin, bmax ) ){ continue; }
+		if( node.left < 0 ){
+			for( int i=0; i<node.count; ++i ){
+				const int t = indices[ node.first+i ];
+				if( overlaps( box_min[t], box_max[t], bmin, bmax ) ){ f( t ); }
+			}
+		} else {
+			stack[n_stack++] = node.right;
+			stack[n_stack++] = node.left;
+		}
+	}
+}
+
+template<typename F> void BoxBVH::closest( const Eigen::Vector3d &p, F f ) const {
+	if( nodes.size() == 0 ){ return; }
+	double best = std::numeric_limits<double>::max();
+	int stack[max_depth];
+	int n_stack = 0;
+	stack[n_stack++] = 0;
+	while( n_stack > 0 ){
+		const Node &node = nodes[ stack[--n_stack] ];
+		if( box_dist2( node.bmin, node.bmax, p ) >= best ){ continue; }
+		if( node.left < 0 ){
+			for( int i=0; i<node.count; ++i ){
+				const int t = indices[ node.first+i ];
+				if( box_dist2( box_min[t], box_max[t], p ) < best ){ best = std::min( best, double( f( t ) ) ); }
+			}
+		} else {
+			const double dl = box_dist2( nodes[node.left].bmin, nodes[node.left].bmax, p );
+			const double dr = box_dist2( nodes[node.right].bmin, nodes[node.right].bmax, p );
+			stack[n_stack++] = dl < dr ? node.right : node.left;
+			stack[n_stack++] = dl < dr ? node.left : node.right;
+		}
+	}
+}
+
+} // end of namespace admm
+
+#endif
@@ -0,0 +1,126 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef CLOSEST_POINT_HPP
+#define CLOSEST_POINT_HPP
+
+#include <Eigen/Dense>
+
+namespace admm {
+
+//
+//	Closest point queries for proximity/contact, from Ericson,
+//	Real-Time Collision Detection (sections 5.1.5 and 5.1.9).
+//
+namespace closest_point {
+
+	// Closest point on triangle abc to p.
+	// Sets the barycentric weights of the point.
+	static inline Eigen::Vector3d triangle( const Eigen::Vector3d &p, const Eigen::Vector3d &a,
+		const Eigen::Vector3d &b, const Eigen::Vector3d &c, Eigen::Vector3d &bary );
+
+	// Closest points between segments p0p1 and q0q1, at p0 + s*(p1-p0) and q0 + t*(q1-q0).
+	// Returns the squared distance between them.
+	static inline double segments( const Eigen::Vector3d &p0, const Eigen::Vector3d &p1,
+		const Eigen::Vector3d &q0, const Eigen::Vector3d &q1, double &s, double &t );
+
+} // end namespace closest_point
+
+//
+//	Implementation below
+//
+
+static inline Eigen::Vector3d closest_point::triangle( const Eigen::Vector3d &p, const Eigen::Vector3d &a,
+	const Eigen::Vector3d &b, const Eigen::Vector3d &c, Eigen::Vector3d &bary ){
+
+	const Eigen::Vector3d ab = b-a, ac = c-a, ap = p-a;
+	const double d1 = ab.dot(ap), d2 = ac.dot(ap);
+	if( d1 <= 0.0 && d2 <= 0.0 ){ bary = Eigen::Vector3d(1,0,0); return a; }
+
+	const Eigen::Vector3d bp = p-b;
+	const double d3 = ab.dot(bp), d4 = ac.dot(bp);
+	if( d3 >= 0.0 && d4 <= d3 ){ bary = Eigen::Vector3d(0,1,0); return b; }
+
+	const double vc = d1*d4 - d3*d2;
+	if( vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0 ){
+		const double v = d1 / ( d1-d3 );
+		bary = Eigen::Vector3d( 1.0-v, v, 0 );
+		return a + v*ab;
+	}
+
+	const Eigen::Vector3d cp = p-c;
+	const double d5 = ab.dot(cp), d6 = ac.dot(cp);
+	if( d6 >= 0.0 && d5 <= d6 ){ bary = Eigen::Vector3d(0,0,1); return c; }
+
+	const double vb = d5*d2 - d1*d6;
+	if( vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0 ){
+		const double w = d2 / ( d2-d6 );
+		bary = Eigen::Vector3d( 1.0-w, 0, w );
+		return a + w*ac;
+	}
+
+	const double va = d3*d6 - d5*d4;
+	if( va <= 0.0 && ( d4-d3 ) >= 0.0 && ( d5-d6 ) >= 0.0 ){
+		const double w = ( d4-d3 ) / ( ( d4-d3 ) + ( d5-d6 ) );
+		bary = Eigen::Vector3d( 0, 1.0-w, w );
+		return b + w*( c-b );
+	}
+
+	const double denom = 1.0 / ( va+vb+vc );
+	const double v = vb*denom, w = vc*denom;
+	bary = Eigen::Vector3d( 1.0-v-w, v, w );
+	return a + v*ab + w*ac;
+
+} // end closest point on triangle
+
+
+static inline double closest_point::segments( const Eigen::Vector3d &p0, const Eigen::Vector3d &p1,
+	const Eigen::Vector3d &q0, const Eigen::Vector3d &q1, double &s, double &t ){
+
+	const double eps = 1e-20;
+	const Eigen::Vector3d d1 = p1-p0, d2 = q1-q0, r = p0-q0;
+	const double a = d1.squaredNorm(), e = d2.squaredNorm(), f = d2.dot(r);
+
+	if( a <= eps && e <= eps ){ s = t = 0.0; return r.squaredNorm(); }
+	if( a <= eps ){
+		s = 0.0;
+		t = std::min( std::max( f/e, 0.0 ), 1.0 );
+	}
+	else {
+		const double c = d1.dot(r);
+		if( e <= eps ){
+			t = 0.0;
+			s = std::min( std::max( -c/a, 0.0 ), 1.0 );
+		}
+		else {
+			// Parallel segments (denom = 0) pick s = 0
+			const double b = d1.dot(d2), denom = a*e - b*b;
+			s = denom > eps ? std::min( std::max( ( b*f - c*e ) / denom, 0.0 ), 1.0 ) : 0.0;
+			t = ( b*s + f ) / e;
+			if( t < 0.0 ){ t = 0.0; s = std::min( std::max( -c/a, 0.0 ), 1.0 ); }
+			else if( t > 1.0 ){ t = 1.0; s = std::min( std::max( ( b-c )/a, 0.0 ), 1.0 ); }
+		}
+	}
+	return ( p0 + s*d1 - q0 - t*d2 ).squaredNorm();
+
+} // end closest points on segments
+
+} // end namespace admm
+
+#endif
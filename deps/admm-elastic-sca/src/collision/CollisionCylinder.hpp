@@ -32,6 +32,7 @@ class CollisionCylinder : public CollisionShape {
 	
 		double isColliding(Eigen::Vector3d pos) const;
 		Eigen::Vector3d projectOut(const Eigen::Vector3d currPos) const;
+		void bounds( Eigen::Vector3d &bmin, Eigen::Vector3d &bmax ) const;
 	
 		double radius;
 		double length;
@@ -64,6 +65,14 @@ Eigen::Vector3d CollisionCylinder::projectOut(const Eigen::Vector3d currPos) con
 	return center + (radius) * dir + Eigen::Vector3d(0,0,currPos[2]);
 }
 
+
+// Infinite along the z axis
+void CollisionCylinder::bounds( Eigen::Vector3d &bmin, Eigen::Vector3d &bmax ) const {
+	const double inf = std::numeric_limits<double>::infinity();
+	bmin = Eigen::Vector3d( center[0]-radius, center[1]-radius, -inf );
+	bmax = Eigen::Vector3d( center[0]+radius, center[1]+radius, inf );
+}
+
 } // end of namespace admm
 
 #endif
@@ -32,6 +32,7 @@ class CollisionFloor : public CollisionShape {
 		
 		double isColliding(Eigen::Vector3d pos) const;
 		Eigen::Vector3d projectOut(const Eigen::Vector3d currPos) const;
+		void bounds( Eigen::Vector3d &bmin, Eigen::Vector3d &bmax ) const;
 		
 		double radius;
 		
@@ -54,6 +55,13 @@ Eigen::Vector3d CollisionFloor::projectOut(const Eigen::Vector3d currPos) const{
 	return Eigen::Vector3d(currPos[0],center[1],currPos[2]);
 }
 
+// Everything below the floor
+void CollisionFloor::bounds( Eigen::Vector3d &bmin, Eigen::Vector3d &bmax ) const {
+	const double inf = std::numeric_limits<double>::infinity();
+	bmin = Eigen::Vector3d( -inf, -inf, -inf );
+	bmax = Eigen::Vector3d( inf, center[1], inf );
+}
+
 
 
 } // end of namespace admm
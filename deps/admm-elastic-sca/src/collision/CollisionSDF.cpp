@@ -0,0 +1,182 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "CollisionSDF.hpp"
+#include <fstream>
+#include <cstring>
+
+using namespace admm;
+
+static const char sdf_magic[8] = { 'A','D','M','M','S','D','F','1' };
+
+void CollisionSDF::resize( const Eigen::Vector3d &origin_, double dx_, const Eigen::Vector3i &dims_, double band_ ){
+	origin = origin_;
+	dx = dx_;
+	dims = dims_.cwiseMax( 2 );
+	band = band_;
+	phi.assign( dims[0]*dims[1]*dims[2], float(band) );
+	center = origin + 0.5*dx*( dims - Eigen::Vector3i::Ones() ).cast<double>();
+	finalize();
+}
+
+
+double CollisionSDF::isColliding(Eigen::Vector3d pos) const {
+	return -distance( pos );
+}
+
+
+Eigen::Vector3d CollisionSDF::projectOut(const Eigen::Vector3d currPos) const {
+	// The grid distances are only piecewise linear, so take
+	// a few steps along the gradient to reach the surface.
+	Eigen::Vector3d pos = currPos;
+	for( int iter=0; iter<4; ++iter ){
+		Eigen::Vector3d grad;
+		double d = distance( pos, &grad );
+		double gnorm = grad.norm();
+		if( d >= 0.0 || gnorm <= 0.0 ){ break; }
+		pos -= ( d / gnorm ) * ( grad / gnorm );
+	}
+	return pos;
+}
+
+
+Eigen::Vector3d CollisionSDF::normal( const Eigen::Vector3d &pos ) const {
+	Eigen::Vector3d grad;
+	distance( pos, &grad );
+	double gnorm = grad.norm();
+	if( gnorm <= 0.0 ){ return CollisionShape::normal( pos ); }
+	return grad / gnorm;
+}
+
+
+// Trilinear values can only be negative in cells
+// with a negative node, which are within dx of one.
+void CollisionSDF::bounds( Eigen::Vector3d &bmin, Eigen::Vector3d &bmax ) const {
+	bmin = inside_min;
+	bmax = inside_max;
+}
+
+
+double CollisionSDF::distance( const Eigen::Vector3d &pos, Eigen::Vector3d *grad ) const {
+
+	if( phi.size()==0 ){
+		if( grad ){ grad->setZero(); }
+		return std::numeric_limits<double>::max();
+	}
+
+	// Points outside of the grid use the closest point on its
+	// boundary plus the distance to it.
+	Eigen::Vector3d bmax = origin + dx*( dims - Eigen::Vector3i::Ones() ).cast<double>();
+	Eigen::Vector3d q = pos.cwiseMax( origin ).cwiseMin( bmax );
+	Eigen::Vector3d out = pos - q;
+	double d_out = out.norm();
+
+	Eigen::Vector3d g = ( q - origin ) / dx;
+	int c[3]; double f[3];
+	for( int i=0; i<3; ++i ){
+		c[i] = std::min( int(g[i]), dims[i]-2 );
+		f[i] = g[i] - c[i];
+	}
+
+	const float *p000 = &phi[ index( c[0], c[1], c[2] ) ];
+	const int sy = dims[0], sz = dims[0]*dims[1];
+	const double v000 = p000[0], v100 = p000[1], v010 = p000[sy], v110 = p000[sy+1];
+	const double v001 = p000[sz], v101 = p000[sz+1], v011 = p000[sz+sy], v111 = p000[sz+sy+1];
+
+	// Interpolate along x, then y, then z
+	const double v00 = v000 + f[0]*( v100-v000 ), v10 = v010 + f[0]*( v110-v010 );
+	const double v01 = v001 + f[0]*( v101-v001 ), v11 = v011 + f[0]*( v111-v011 );
+	const double v0 = v00 + f[1]*( v10-v00 ), v1 = v01 + f[1]*( v11-v01 );
+	const double d = v0 + f[2]*( v1-v0 );
+
+	if( grad ){
+		if( d_out > 0.0 ){ *grad = out / d_out; }
+		else {
+			const double dx00 = v100-v000, dx10 = v110-v010, dx01 = v101-v001, dx11 = v111-v011;
+			const double gx = ( 1.0-f[2] )*( dx00 + f[1]*( dx10-dx00 ) ) + f[2]*( dx01 + f[1]*( dx11-dx01 ) );
+			const double gy = ( 1.0-f[2] )*( v10-v00 ) + f[2]*( v11-v01 );
+			const double gz = v1 - v0;
+			*grad = Eigen::Vector3d( gx, gy, gz ) / dx;
+		}
+	}
+
+	return d + d_out;
+}
+
+
+void CollisionSDF::finalize(){
+	const double inf = std::numeric_limits<double>::infinity();
+	inside_min = Eigen::Vector3d( inf, inf, inf );
+	inside_max = -inside_min;
+	for( int k=0; k<dims[2]; ++k ){
+		for( int j=0; j<dims[1]; ++j ){
+			for( int i=0; i<dims[0]; ++i ){
+				if( phi[ index(i,j,k) ] >= 0.f ){ continue; }
+				Eigen::Vector3d x = node( i, j, k );
+				inside_min = inside_min.cwiseMin( x );
+				inside_max = inside_max.cwiseMax( x );
+			}
+		}
+	}
+	if( inside_min[0] <= inside_max[0] ){
+		inside_min.array() -= dx;
+		inside_max.array() += dx;
+	}
+}
+
+
+bool CollisionSDF::save( const std::string &filename ) const {
+	std::ofstream out( filename.c_str(), std::ios::binary );
+	if( !out.good() ){ return false; }
+	out.write( sdf_magic, sizeof(sdf_magic) );
+	out.write( (const char*)&key, sizeof(key) );
+	out.write( (const char*)dims.data(), 3*sizeof(int) );
+	out.write( (const char*)origin.data(), 3*sizeof(double) );
+	out.write( (const char*)&dx, sizeof(dx) );
+	out.write( (const char*)&band, sizeof(band) );
+	out.write( (const char*)phi.data(), phi.size()*sizeof(float) );
+	return out.good();
+}
+
+
+bool CollisionSDF::load( const std::string &filename, uint64_t key_ ){
+	std::ifstream in( filename.c_str(), std::ios::binary );
+	if( !in.good() ){ return false; }
+
+	char magic[8];
+	uint64_t file_key = 0;
+	Eigen::Vector3i file_dims;
+	Eigen::Vector3d file_origin;
+	double file_dx = 0.0, file_band = 0.0;
+	in.read( magic, sizeof(magic) );
+	in.read( (char*)&file_key, sizeof(file_key) );
+	in.read( (char*)file_dims.data(), 3*sizeof(int) );
+	in.read( (char*)file_origin.data(), 3*sizeof(double) );
+	in.read( (char*)&file_dx, sizeof(file_dx) );
+	in.read( (char*)&file_band, sizeof(file_band) );
+	if( !in.good() || std::memcmp( magic, sdf_magic, sizeof(magic) ) != 0 || file_key != key_ ){ return false; }
+	if( file_dims.minCoeff() < 2 || file_dx <= 0.0 ){ return false; }
+
+	resize( file_origin, file_dx, file_dims, file_band );
+	in.read( (char*)phi.data(), phi.size()*sizeof(float) );
+	if( !in.good() ){ return false; }
+	key = key_;
+	finalize();
+	return true;
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef COLLISION_SDF_HPP
+#define COLLISION_SDF_HPP
+
+#include "CollisionShape.hpp"
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace admm {
+
+//
+//	Signed distance grid obstacle for arbitrary static geometry.
+//	Distances are sampled at the nodes of a regular grid (negative inside)
+//	and only exact within band of the surface, farther nodes are +/- band.
+//	Queries are trilinear lookups. The grid itself is filled in by whoever
+//	bakes it (e.g. from a scene mesh), and can be saved to/loaded from disk.
+//
+class CollisionSDF : public CollisionShape {
+	
+	public:
+	
+		CollisionSDF() : CollisionShape(Eigen::Vector3d::Zero()), dx(1.0), band(1.0), key(0) { dims.setZero(); }
+
+		// Allocates the grid with all distances set to band
+		void resize( const Eigen::Vector3d &origin_, double dx_, const Eigen::Vector3i &dims_, double band_ );
+
+		double isColliding(Eigen::Vector3d pos) const;
+		Eigen::Vector3d projectOut(const Eigen::Vector3d currPos) const;
+		void bounds( Eigen::Vector3d &bmin, Eigen::Vector3d &bmax ) const;
+		Eigen::Vector3d normal( const Eigen::Vector3d &pos ) const;
+
+		// Trilinear signed distance and its gradient
+		double distance( const Eigen::Vector3d &pos, Eigen::Vector3d *grad=NULL ) const;
+
+		// Binary cache files. Load fails (returns false) if the file is
+		// missing or was saved with a different key.
+		bool save( const std::string &filename ) const;
+		bool load( const std::string &filename, uint64_t key_ );
+
+		inline int index( int i, int j, int k ) const { return i + dims[0]*( j + dims[1]*k ); }
+		inline Eigen::Vector3d node( int i, int j, int k ) const { return origin + dx*Eigen::Vector3d(i,j,k); }
+
+		Eigen::Vector3d origin; // position of node (0,0,0)
+		double dx; // grid spacing
+		Eigen::Vector3i dims; // number of nodes per axis
+		double band; // distances are clamped to +/- band
+		uint64_t key; // hash of the baked geometry and settings
+		std::vector<float> phi; // signed distance at each node
+
+		// Box of the nodes inside the geometry, set by finalize
+		Eigen::Vector3d inside_min, inside_max;
+		void finalize();
+		
+};
+
+} // end of namespace admm
+
+#endif
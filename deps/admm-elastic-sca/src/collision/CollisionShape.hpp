@@ -22,6 +22,8 @@
 #define COLLISION_SHAPE_HPP
 
 #include <Eigen/Dense>
+#include <limits>
+#include <algorithm>
 
 namespace admm{
 
@@ -37,7 +39,74 @@ class CollisionShape {
 		virtual double isColliding(Eigen::Vector3d pos) const = 0;
 
 		virtual Eigen::Vector3d projectOut(const Eigen::Vector3d currPos) const = 0;
+
+		// Axis aligned box containing every point with isColliding > 0,
+		// used by the broad phase. Entries may be infinite (default is unbounded).
+		virtual void bounds( Eigen::Vector3d &bmin, Eigen::Vector3d &bmax ) const {
+			const double inf = std::numeric_limits<double>::infinity();
+			bmin = Eigen::Vector3d(-inf,-inf,-inf);
+			bmax = Eigen::Vector3d(inf,inf,inf);
+		}
 		
+		// Outward unit normal near the surface. The default takes central
+		// differences of isColliding, shapes with a gradient should override it.
+		virtual Eigen::Vector3d normal( const Eigen::Vector3d &pos ) const {
+			const double h = 1e-6;
+			Eigen::Vector3d n;
+			for( int i=0; i<3; ++i ){
+				Eigen::Vector3d dp = Eigen::Vector3d::Zero(); dp[i] = h;
+				n[i] = isColliding(pos-dp) - isColliding(pos+dp);
+			}
+			const double len = n.norm();
+			return len > 0.0 ? Eigen::Vector3d(n/len) : Eigen::Vector3d(0,1,0);
+		}
+
+		// Earliest t in [0,1] at which the segment p0 + t*(p1-p0) comes within
+		// offset of the shape, or -1 if it does not. Uses conservative advancement,
+		// which only needs isColliding to not overestimate the distance outside.
+		// Steps are at least tol so a grazing segment still moves along, and a hit is
+		// only reported once the point is within offset (t may be up to tol/len late).
+		// At shallow angles the march may not get there in max_toi_iters, in which case
+		// the end point is tested and the crossing bisected between the last t and 1.
+		virtual double timeOfImpact( const Eigen::Vector3d &p0, const Eigen::Vector3d &p1, double offset=0.0 ) const {
+			const Eigen::Vector3d d = p1 - p0;
+			const double len = d.norm();
+			const double tol = 1e-3*len + 1e-10;
+			double t = 0.0;
+			for( int i=0; i<max_toi_iters; ++i ){
+				const double dist = -isColliding( p0 + t*d ) - offset;
+				if( dist <= 0.0 ){ return t; }
+				if( len <= 0.0 || t >= 1.0 ){ return -1.0; }
+				t = std::min( t + std::max( dist, tol ) / len, 1.0 );
+			}
+			if( -isColliding( p1 ) - offset > 0.0 ){ return -1.0; }
+			double hi = 1.0;
+			for( int i=0; i<max_toi_iters && ( hi-t )*len > tol; ++i ){
+				const double mid = 0.5*( t+hi );
+				if( -isColliding( p0 + mid*d ) - offset <= 0.0 ){ hi = mid; }
+				else{ t = mid; }
+			}
+			return hi;
+		}
+		static const int max_toi_iters = 32;
+
+		// Swept test of a point moving from p0 (start of the step) to p1 (end of the step).
+		// Returns the time of impact and sets contact to where the point touches the
+		// surface at the end of the step, or returns -1 if there is no hit or p0 was
+		// already inside (left to projectOut).
+		virtual double sweep( const Eigen::Vector3d &p0, const Eigen::Vector3d &p1, Eigen::Vector3d &contact ) const {
+			if( isColliding(p0) > 0 ){ return -1.0; }
+			const double t = timeOfImpact( p0, p1 );
+			if( t >= 0.0 ){ contact = p0 + t*(p1-p0); }
+			return t;
+		}
+
+		// Moving shapes (see KinematicShape) return true, and are set to their
+		// pose over the step [t0,t1] with set_time before each step. Queries only
+		// read that pose, so they are safe to call in parallel during the step.
+		virtual bool kinematic() const { return false; }
+		virtual void set_time( double t0, double t1 ){}
+
 		Eigen::Vector3d center;
 		
 	protected:
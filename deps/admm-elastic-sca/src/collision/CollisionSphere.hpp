@@ -33,6 +33,7 @@ class CollisionSphere : public CollisionShape {
 		
 		double isColliding(Eigen::Vector3d pos) const;
 		Eigen::Vector3d projectOut(const Eigen::Vector3d currPos) const;
+		void bounds( Eigen::Vector3d &bmin, Eigen::Vector3d &bmax ) const;
 		
 		double radius;
 		
@@ -61,6 +62,11 @@ Eigen::Vector3d CollisionSphere::projectOut(const Eigen::Vector3d currPos) const
 	return center + radius * dir;
 }
 
+void CollisionSphere::bounds( Eigen::Vector3d &bmin, Eigen::Vector3d &bmax ) const {
+	bmin = center - Eigen::Vector3d(radius,radius,radius);
+	bmax = center + Eigen::Vector3d(radius,radius,radius);
+}
+
 } // end of namespace admm
 
 #endif
@@ -0,0 +1,134 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "KinematicShape.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace admm;
+
+KinematicShape::KinematicShape( std::shared_ptr<CollisionShape> shape_, const Eigen::Vector3d &pivot_ ) :
+	CollisionShape(shape_->center), shape(shape_), pivot(pivot_) {}
+
+
+void KinematicShape::add_keyframe( double t, const Eigen::Vector3d &translate, const Eigen::Quaterniond &rotate ){
+	Keyframe k;
+	k.t = t;
+	k.translate = translate;
+	k.rotate = rotate.normalized();
+	keyframes.push_back( k );
+	std::stable_sort( keyframes.begin(), keyframes.end(),
+		[]( const Keyframe &a, const Keyframe &b ){ return a.t < b.t; } );
+}
+
+
+KinematicShape::Pose KinematicShape::pose( double t ) const {
+
+	Pose p;
+	if( keyframes.size() == 0 ){ return p; }
+
+	// Hold the first and last poses
+	Eigen::Vector3d translate;
+	Eigen::Quaterniond rotate;
+	if( t <= keyframes.front().t ){
+		translate = keyframes.front().translate;
+		rotate = keyframes.front().rotate;
+	}
+	else if( t >= keyframes.back().t ){
+		translate = keyframes.back().translate;
+		rotate = keyframes.back().rotate;
+	}
+	else{
+		int k = 0;
+		while( keyframes[k+1].t <= t ){ ++k; }
+		const Keyframe &k0 = keyframes[k], &k1 = keyframes[k+1];
+		const double alpha = ( t - k0.t ) / ( k1.t - k0.t );
+		translate = (1.0-alpha)*k0.translate + alpha*k1.translate;
+		rotate = k0.rotate.slerp( alpha, k1.rotate );
+	}
+
+	p.R = rotate.toRotationMatrix();
+	p.T = pivot - p.R*pivot + translate;
+	return p;
+}
+
+
+void KinematicShape::set_time( double t0, double t1 ){
+	start = pose( t0 );
+	end = pose( t1 );
+	center = end.apply( shape->center );
+}
+
+
+double KinematicShape::isColliding(Eigen::Vector3d pos) const {
+	return shape->isColliding( end.inverse(pos) );
+}
+
+
+Eigen::Vector3d KinematicShape::projectOut(const Eigen::Vector3d currPos) const {
+	return end.apply( shape->projectOut( end.inverse(currPos) ) );
+}
+
+
+Eigen::Vector3d KinematicShape::normal( const Eigen::Vector3d &pos ) const {
+	return end.R * shape->normal( end.inverse(pos) );
+}
+
+
+double KinematicShape::timeOfImpact( const Eigen::Vector3d &p0, const Eigen::Vector3d &p1, double offset ) const {
+	return shape->timeOfImpact( start.inverse(p0), end.inverse(p1), offset );
+}
+
+
+double KinematicShape::sweep( const Eigen::Vector3d &p0, const Eigen::Vector3d &p1, Eigen::Vector3d &contact ) const {
+	Eigen::Vector3d local_contact;
+	const double t = shape->sweep( start.inverse(p0), end.inverse(p1), local_contact );
+	if( t >= 0.0 ){ contact = end.apply( local_contact ); }
+	return t;
+}
+
+
+// Covers the shape over the whole step, so the broad phase
+// also finds the swept tests against it.
+void KinematicShape::bounds( Eigen::Vector3d &bmin, Eigen::Vector3d &bmax ) const {
+	Eigen::Vector3d bmin1, bmax1;
+	pose_bounds( start, bmin, bmax );
+	pose_bounds( end, bmin1, bmax1 );
+	bmin = bmin.cwiseMin( bmin1 );
+	bmax = bmax.cwiseMax( bmax1 );
+}
+
+
+// Interval arithmetic on the rest box, which keeps one-sided
+// infinite boxes (e.g. floors) bounded on their finite side.
+void KinematicShape::pose_bounds( const Pose &p, Eigen::Vector3d &bmin, Eigen::Vector3d &bmax ) const {
+	Eigen::Vector3d lmin, lmax;
+	shape->bounds( lmin, lmax );
+	for( int i=0; i<3; ++i ){
+		bmin[i] = p.T[i];
+		bmax[i] = p.T[i];
+		for( int j=0; j<3; ++j ){
+			const double r = p.R(i,j);
+			if( std::abs(r) < 1e-12 ){ continue; }
+			const double a = r*lmin[j], b = r*lmax[j];
+			bmin[i] += std::min( a, b );
+			bmax[i] += std::max( a, b );
+		}
+	}
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef KINEMATIC_SHAPE_HPP
+#define KINEMATIC_SHAPE_HPP
+
+#include "CollisionShape.hpp"
+#include <Eigen/Geometry>
+#include <vector>
+#include <memory>
+
+namespace admm {
+
+//
+//	Collision shape moved by a keyframed rigid transform.
+//	The wrapped shape is in its own (rest) frame, and each keyframe rotates it
+//	about pivot and then translates it. Between keyframes the translation is
+//	linear and the rotation is slerped, before the first and after the last
+//	the pose is held.
+//
+//	set_time evaluates the pose at the start and end of a step once, and all
+//	other queries only read those two poses. Queries use the end of the step,
+//	except the swept ones, which are done in the shape's frame so they see the
+//	relative motion of the point and the shape. That is the only place the motion
+//	is used: contacts are frictionless, so they don't need the surface velocity.
+//
+class KinematicShape : public CollisionShape {
+	
+	public:
+
+		struct Keyframe {
+			double t;
+			Eigen::Vector3d translate;
+			Eigen::Quaterniond rotate;
+			EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+		};
+
+		// Rigid transform x -> R*x + T
+		struct Pose {
+			Eigen::Matrix3d R;
+			Eigen::Vector3d T;
+			Pose() : R(Eigen::Matrix3d::Identity()), T(Eigen::Vector3d::Zero()) {}
+			inline Eigen::Vector3d apply( const Eigen::Vector3d &x ) const { return R*x + T; }
+			inline Eigen::Vector3d inverse( const Eigen::Vector3d &x ) const { return R.transpose()*(x - T); }
+		};
+
+		KinematicShape( std::shared_ptr<CollisionShape> shape_, const Eigen::Vector3d &pivot_=Eigen::Vector3d::Zero() );
+
+		// Keyframes can be added in any order
+		void add_keyframe( double t, const Eigen::Vector3d &translate, const Eigen::Quaterniond &rotate );
+
+		// Pose at time t
+		Pose pose( double t ) const;
+
+		double isColliding(Eigen::Vector3d pos) const;
+		Eigen::Vector3d projectOut(const Eigen::Vector3d currPos) const;
+		void bounds( Eigen::Vector3d &bmin, Eigen::Vector3d &bmax ) const;
+		Eigen::Vector3d normal( const Eigen::Vector3d &pos ) const;
+		double timeOfImpact( const Eigen::Vector3d &p0, const Eigen::Vector3d &p1, double offset=0.0 ) const;
+		double sweep( const Eigen::Vector3d &p0, const Eigen::Vector3d &p1, Eigen::Vector3d &contact ) const;
+
+		bool kinematic() const { return true; }
+		void set_time( double t0, double t1 );
+
+		std::shared_ptr<CollisionShape> shape; // in its rest frame
+		Eigen::Vector3d pivot; // rotations are about this point (rest frame)
+		std::vector<Keyframe, Eigen::aligned_allocator<Keyframe> > keyframes; // sorted by t
+
+		// Poses at the start and end of the current step, set by set_time
+		Pose start, end;
+
+	protected:
+		// Box of the shape at a pose
+		void pose_bounds( const Pose &p, Eigen::Vector3d &bmin, Eigen::Vector3d &bmax ) const;
+	
+};
+
+} // end of namespace admm
+
+#endif
@@ -0,0 +1,43 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "ShapeBVH.hpp"
+#include <cmath>
+
+using namespace admm;
+
+void ShapeBVH::build( const std::vector< std::shared_ptr<CollisionShape> > &shapes ){
+
+	const int n = shapes.size();
+	box_min.resize( n );
+	box_max.resize( n );
+	std::vector<Eigen::Vector3d> centers( n );
+	for( int i=0; i<n; ++i ){
+		shapes[i]->bounds( box_min[i], box_max[i] );
+		for( int j=0; j<3; ++j ){
+			const double lo = box_min[i][j], hi = box_max[i][j];
+			if( std::isfinite(lo) && std::isfinite(hi) ){ centers[i][j] = 0.5*(lo+hi); }
+			else if( std::isfinite(lo) ){ centers[i][j] = lo; }
+			else if( std::isfinite(hi) ){ centers[i][j] = hi; }
+			else{ centers[i][j] = 0.0; }
+		}
+	}
+	BoxBVH::build( centers );
+	refit();
+}
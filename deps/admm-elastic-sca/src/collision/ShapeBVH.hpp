@@ -0,0 +1,47 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SHAPE_BVH_HPP
+#define SHAPE_BVH_HPP
+
+#include "BoxBVH.hpp"
+#include "CollisionShape.hpp"
+#include <memory>
+
+namespace admm {
+
+//
+//	Bounding volume hierarchy over collision shapes (broad phase).
+//	Boxes may be infinite (e.g. floors), in which case the finite
+//	sides are used as the center.
+//
+class ShapeBVH : public BoxBVH {
+public:
+	// Rebuild if the shapes (or their bounds) change
+	void build( const std::vector< std::shared_ptr<CollisionShape> > &shapes );
+
+	// Calls f(shape_index) for each shape whose box is within r of p (in no particular order)
+	template<typename F> void query( const Eigen::Vector3d &p, double r, F f ) const {
+		BoxBVH::query( Eigen::Vector3d( p.array()-r ), Eigen::Vector3d( p.array()+r ), f );
+	}
+};
+
+} // end of namespace admm
+
+#endif
@@ -0,0 +1,54 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "TriangleBVH.hpp"
+
+using namespace admm;
+
+void TriangleBVH::build( const std::vector<Eigen::Vector3i> &faces_, const Eigen::VectorXd &x ){
+
+	faces = faces_;
+	const int n = faces.size();
+	std::vector<Eigen::Vector3d> centers( n );
+	for( int i=0; i<n; ++i ){
+		centers[i] = ( x.segment<3>( 3*faces[i][0] ) + x.segment<3>( 3*faces[i][1] ) + x.segment<3>( 3*faces[i][2] ) ) / 3.0;
+	}
+	BoxBVH::build( centers );
+	refit( x, x, 0.0 );
+}
+
+
+void TriangleBVH::refit( const Eigen::VectorXd &x0, const Eigen::VectorXd &x, double pad ){
+
+	const int n = faces.size();
+	box_min.resize( n );
+	box_max.resize( n );
+#pragma omp parallel for
+	for( int i=0; i<n; ++i ){
+		Eigen::Vector3d bmin = x0.segment<3>( 3*faces[i][0] ), bmax = bmin;
+		for( int j=0; j<3; ++j ){
+			const Eigen::Vector3d p0 = x0.segment<3>( 3*faces[i][j] ), p1 = x.segment<3>( 3*faces[i][j] );
+			bmin = bmin.cwiseMin( p0 ).cwiseMin( p1 );
+			bmax = bmax.cwiseMax( p0 ).cwiseMax( p1 );
+		}
+		box_min[i] = bmin.array() - pad;
+		box_max[i] = bmax.array() + pad;
+	}
+	BoxBVH::refit();
+}
@@ -0,0 +1,47 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef TRIANGLE_BVH_HPP
+#define TRIANGLE_BVH_HPP
+
+#include "BoxBVH.hpp"
+
+namespace admm {
+
+//
+//	Bounding volume hierarchy over the triangles of a deforming mesh.
+//	The topology is built once from the rest positions, and then refit
+//	to new positions each step, which only updates boxes.
+//	query and closest (see BoxBVH) call f with face indices.
+//
+class TriangleBVH : public BoxBVH {
+public:
+	// Builds the tree. Faces index nodes of x (3 per node).
+	void build( const std::vector<Eigen::Vector3i> &faces_, const Eigen::VectorXd &x );
+
+	// Refits the boxes to contain each triangle at both x0 and x (the motion
+	// over a step), grown by pad.
+	void refit( const Eigen::VectorXd &x0, const Eigen::VectorXd &x, double pad );
+
+	std::vector<Eigen::Vector3i> faces;
+};
+
+} // end of namespace admm
+
+#endif
@@ -43,6 +43,14 @@ void StaticAnchor::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::T
 	}
 }
 
+void StaticAnchor::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	Dx.segment<3>( global_idx ) = x.segment<3>( 3*idx );
+}
+
+void StaticAnchor::apply_DiT( const VectorXd &v, VectorXd &Dtv ) const {
+	helper::add3( Dtv, idx, v.segment<3>( global_idx ) );
+}
+
 void StaticAnchor::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
 
 	Vector3d Dix = Dx.segment<3>( global_idx );
@@ -67,6 +75,14 @@ void MovingAnchor::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::T
 	}
 }
 
+void MovingAnchor::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	Dx.segment<3>( global_idx ) = x.segment<3>( 3*idx );
+}
+
+void MovingAnchor::apply_DiT( const VectorXd &v, VectorXd &Dtv ) const {
+	helper::add3( Dtv, idx, v.segment<3>( global_idx ) );
+}
+
 
 void MovingAnchor::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
 	int Di_rows = 3;
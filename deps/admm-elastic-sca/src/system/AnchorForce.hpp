@@ -61,6 +61,10 @@ public:
 	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
 	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
 	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
+	bool matrix_free() const { return true; }
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	const char *name() const { return "StaticAnchor"; }
 
 	int idx;
 	Eigen::Vector3d pos;
@@ -97,6 +101,10 @@ public:
 	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep ){}
 	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
 	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
+	bool matrix_free() const { return true; }
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	const char *name() const { return "MovingAnchor"; }
 
 	int idx;
 	std::shared_ptr<ControlPoint> point;
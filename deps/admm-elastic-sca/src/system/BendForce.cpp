@@ -22,142 +22,169 @@
 using namespace Eigen;
 using namespace admm;
 
+namespace admm {
+namespace helper {
+
+	typedef Eigen::Matrix<double,9,1> Vector9d;
+
+	// Hinge weights of the bending constraint, from the rest positions
+	static inline void init_bend( const int *idx, const Eigen::VectorXd &x, double *alpha ){
+
+		Eigen::Vector3d x0( x[ idx[0]*3 ], x[ idx[0]*3+1 ], x[ idx[0]*3+2 ] );
+		Eigen::Vector3d x1( x[ idx[1]*3 ], x[ idx[1]*3+1 ], x[ idx[1]*3+2 ] );
+		Eigen::Vector3d x2( x[ idx[2]*3 ], x[ idx[2]*3+1 ], x[ idx[2]*3+2 ] );
+		Eigen::Vector3d x3( x[ idx[3]*3 ], x[ idx[3]*3+1 ], x[ idx[3]*3+2 ] );
+
+		Eigen::Vector3d xA = x0 - x2;
+		Eigen::Vector3d xB = x1 - x2;
+		Eigen::Vector3d xC = Eigen::Vector3d(0,0,0);
+		Eigen::Vector3d xD = x3 - x2;
+
+		double area1 = 0.5*(xA.cross(xD)).norm();
+		double area2 = 0.5*(xD.cross(xB)).norm();
+
+		double hA = 2.0 * area1 / xD.norm();
+		double hB = 2.0 * area2 / xD.norm();
+
+		Eigen::Vector3d nC = (xC - xB).cross(xC - xA);
+		Eigen::Vector3d nD = (xD - xA).cross(xD - xB);
+
+		alpha[0] = hB / (hA + hB);
+		alpha[1] = hA / (hA + hB);
+		alpha[2] = -nD.norm() / ( nC.norm() + nD.norm() );
+		alpha[3] = -nC.norm() / ( nC.norm() + nD.norm() );
+	}
+
+	// Rows of Di are x0-x2, x3-x2 and x1-x2
+	static inline void init_bend_Di( const int *idx, int constraint_idx, std::vector<Eigen::Triplet<double> > &triplets ){
+		const int pos[3] = { idx[0], idx[3], idx[1] };
+		for( int r=0; r<3; ++r ){
+			for( int j=0; j<3; ++j ){
+				triplets.push_back( Eigen::Triplet<double>( 3*r+j+constraint_idx, 3*pos[r]+j, 1.0 ) );
+				triplets.push_back( Eigen::Triplet<double>( 3*r+j+constraint_idx, 3*idx[2]+j, -1.0 ) );
+			}
+		}
+	}
+
+	static inline void apply_bend_Di( const int *idx, int r, const Eigen::VectorXd &x, Eigen::VectorXd &Dx ){
+		Eigen::Vector3d x2 = x.segment<3>( 3*idx[2] );
+		Dx.segment<3>( r ) = x.segment<3>( 3*idx[0] ) - x2;
+		Dx.segment<3>( r+3 ) = x.segment<3>( 3*idx[3] ) - x2;
+		Dx.segment<3>( r+6 ) = x.segment<3>( 3*idx[1] ) - x2;
+	}
+
+	static inline void apply_bend_DiT( const int *idx, int r, const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ){
+		Eigen::Vector3d v0 = v.segment<3>( r );
+		Eigen::Vector3d v1 = v.segment<3>( r+3 );
+		Eigen::Vector3d v2 = v.segment<3>( r+6 );
+		add3( Dtv, idx[0], v0 );
+		add3( Dtv, idx[3], v1 );
+		add3( Dtv, idx[1], v2 );
+		add3( Dtv, idx[2], -(v0+v1+v2) );
+	}
+
+	// Bend update for the element at row r
+	static inline void project_bend( int r, const double *alpha, double stiffness, double weight,
+		const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ){
+
+		// Computing Di * x + ui
+		Vector9d Dix = Dx.segment<9>( r );
+		Vector9d ui = u.segment<9>( r );
+		Vector9d DixPlusUi = Dix+ui;
+
+		// Projection onto the flat hinge
+		Eigen::Vector3d c1 = DixPlusUi.segment<3>(0);
+		Eigen::Vector3d c2 = DixPlusUi.segment<3>(3);
+		Eigen::Vector3d c3 = DixPlusUi.segment<3>(6);
+		Eigen::Vector3d lam = 2.0 * ( alpha[0]*c1 + alpha[3]*c2 + alpha[1]*c3 ) / ( alpha[0]*alpha[0] + alpha[3]*alpha[3] + alpha[1]*alpha[1] );
+		Vector9d p;
+		p.segment<3>(0) = c1 - 0.5*alpha[0]*lam;
+		p.segment<3>(3) = c2 - 0.5*alpha[3]*lam;
+		p.segment<3>(6) = c3 - 0.5*alpha[1]*lam;
+
+		Vector9d zi = ( 1.0 / (weight*weight + stiffness) ) * (stiffness*p + weight*weight*(DixPlusUi));
+
+		ui.noalias() += ( Dix - zi );
+		u.segment<9>( r ) = ui;
+		z.segment<9>( r ) = zi;
+	}
 
-void BendForce::initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const VectorXd &masses, const double timestep ){
-		
-	Eigen::Vector3d x0( x[ idx[0]*3 ], x[ idx[0]*3+1 ], x[ idx[0]*3+2 ] );
-	Eigen::Vector3d x1( x[ idx[1]*3 ], x[ idx[1]*3+1 ], x[ idx[1]*3+2 ] );
-	Eigen::Vector3d x2( x[ idx[2]*3 ], x[ idx[2]*3+1 ], x[ idx[2]*3+2 ] );
-	Eigen::Vector3d x3( x[ idx[3]*3 ], x[ idx[3]*3+1 ], x[ idx[3]*3+2 ] );
+}
+}
 
-	weight = sqrt(stiffness);
+//
+//	BendForce
+//
 
-	Eigen::Vector3d xA = x0 - x2;
-	Eigen::Vector3d xB = x1 - x2;
-	Eigen::Vector3d xC = Eigen::Vector3d(0,0,0);
-	Eigen::Vector3d xD = x3 - x2;
-	
-	double area1 = 0.5*(xA.cross(xD)).norm();
-	double area2 = 0.5*(xD.cross(xB)).norm();
-	
-	double hA = 2.0 * area1 / xD.norm();
-	double hB = 2.0 * area2 / xD.norm();
-	
-	
-	Eigen::Vector3d nA = (xA - xC).cross(xA - xD);
-	Eigen::Vector3d nB = (xB - xD).cross(xB - xC);
-	Eigen::Vector3d nC = (xC - xB).cross(xC - xA);
-	Eigen::Vector3d nD = (xD - xA).cross(xD - xB);
-	
-	alpha[0] = hB / (hA + hB);
-	alpha[1] = hA / (hA + hB);
-	alpha[2]= -nD.norm() / ( nC.norm() + nD.norm() );
-	alpha[3] = -nC.norm() / ( nC.norm() + nD.norm() );
-	
-	double lambda = (2.0/3.0) * ( hA + hB ) / pow( hA * hB , 2.0) * (xD - xC).norm() * stiffness;
-	
-	Eigen::Matrix3d I;
-	I.setIdentity();
-	
-	Eigen::MatrixXd jac(9,9);
-	
-	jac.block(0,0,3,3) = -lambda * alpha[0] * alpha[0] * I;
-	jac.block(0,3,3,3) = -lambda * alpha[0] * alpha[3] * I;
-	jac.block(0,6,3,3) = -lambda * alpha[0] * alpha[1] * I;
-	jac.block(3,0,3,3) = -lambda * alpha[3] * alpha[0] * I;
-	jac.block(3,3,3,3) = -lambda * alpha[3] * alpha[3] * I;
-	jac.block(3,6,3,3) = -lambda * alpha[3] * alpha[1] * I;
-	jac.block(6,0,3,3) = -lambda * alpha[1] * alpha[0] * I;
-	jac.block(6,3,3,3) = -lambda * alpha[1] * alpha[3] * I;
-	jac.block(6,6,3,3) = -lambda * alpha[1] * alpha[1] * I;
+void BendForce::initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const VectorXd &masses, const double timestep ){
+	weight = sqrt(stiffness);
+	helper::init_bend( idx, x, alpha.data() );
 }
 
 void BendForce::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
-
 	global_idx = weights.size();
 	for( int i=0; i<9; ++i ){ weights.push_back(weight); }
+	helper::init_bend_Di( idx, global_idx, triplets );
+}
 
-	int col0 = 3*idx[0];
-	int col1 = 3*idx[1];
-	int col2 = 3*idx[2];
-	int col3 = 3*idx[3];
-	
-	// Setting nonzero terms of first row of Di
-//	newDi.coeffRef(0,col0) = 1.0;
-//	newDi.coeffRef(1,col0+1) = 1.0;
-//	newDi.coeffRef(2,col0+2) = 1.0;
-	triplets.push_back( Triplet<double>( 0+global_idx, col0, 1.0 ) );
-	triplets.push_back( Triplet<double>( 1+global_idx, col0+1, 1.0 ) );
-	triplets.push_back( Triplet<double>( 2+global_idx, col0+2, 1.0 ) );
-	
-//	newDi.coeffRef(0,col2) = -1.0;
-//	newDi.coeffRef(1,col2+1) = -1.0;
-//	newDi.coeffRef(2,col2+2) = -1.0;
-	triplets.push_back( Triplet<double>( 0+global_idx, col2, -1.0 ) );
-	triplets.push_back( Triplet<double>( 1+global_idx, col2+1, -1.0 ) );
-	triplets.push_back( Triplet<double>( 2+global_idx, col2+2, -1.0 ) );
-
-	// Setting nonzero terms of second row of Di
-//	newDi.coeffRef(3,col3) = 1.0;
-//	newDi.coeffRef(4,col3+1) = 1.0;
-//	newDi.coeffRef(5,col3+2) = 1.0;
-	triplets.push_back( Triplet<double>( 3+global_idx, col3, 1.0 ) );
-	triplets.push_back( Triplet<double>( 4+global_idx, col3+1, 1.0 ) );
-	triplets.push_back( Triplet<double>( 5+global_idx, col3+2, 1.0 ) );
-
-//	newDi.coeffRef(3,col2) = -1.0;
-//	newDi.coeffRef(4,col2+1) = -1.0;
-//	newDi.coeffRef(5,col2+2) = -1.0;
-	triplets.push_back( Triplet<double>( 3+global_idx, col2, -1.0 ) );
-	triplets.push_back( Triplet<double>( 4+global_idx, col2+1, -1.0 ) );
-	triplets.push_back( Triplet<double>( 5+global_idx, col2+2, -1.0 ) );
-	
-	// Setting nonzero terms of third row of Di
-//	newDi.coeffRef(6,col1) = 1.0;
-//	newDi.coeffRef(7,col1+1) = 1.0;
-//	newDi.coeffRef(8,col1+2) = 1.0;
-	triplets.push_back( Triplet<double>( 6+global_idx, col1, 1.0 ) );
-	triplets.push_back( Triplet<double>( 7+global_idx, col1+1, 1.0 ) );
-	triplets.push_back( Triplet<double>( 8+global_idx, col1+2, 1.0 ) );
-	
-//	newDi.coeffRef(6,col2) = -1.0;
-//	newDi.coeffRef(7,col2+1) = -1.0;
-//	newDi.coeffRef(8,col2+2) = -1.0;
-	triplets.push_back( Triplet<double>( 6+global_idx, col2, -1.0 ) );
-	triplets.push_back( Triplet<double>( 7+global_idx, col2+1, -1.0 ) );
-	triplets.push_back( Triplet<double>( 8+global_idx, col2+2, -1.0 ) );
-	
+void BendForce::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	helper::apply_bend_Di( idx, global_idx, x, Dx );
+}
 
+void BendForce::apply_DiT( const VectorXd &v, VectorXd &Dtv ) const {
+	helper::apply_bend_DiT( idx, global_idx, v, Dtv );
 }
 
+void BendForce::project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const{
+	helper::project_bend( global_idx, alpha.data(), stiffness, weight, Dx, u, z );
+}
 
-inline void BendForce::computeUsingProjection( Vector9d& p, Vector9d& Dix) const{
 
-	Eigen::Vector3d c1 = Dix.segment<3>(0);
-	Eigen::Vector3d c2 = Dix.segment<3>(3);
-	Eigen::Vector3d c3 = Dix.segment<3>(6);
-	Eigen::Vector3d lam = 2.0 * ( alpha[0]*c1 + alpha[3]*c2 + alpha[1]*c3 ) / ( alpha[0]*alpha[0] + alpha[3]*alpha[3] + alpha[1]*alpha[1] );
-	p.segment<3>(0) = c1 - 0.5*alpha[0]*lam;
-	p.segment<3>(3) = c2 - 0.5*alpha[3]*lam;
-	p.segment<3>(6) = c3 - 0.5*alpha[1]*lam;
-	
-}
+//
+//	BendForceBatch
+//
 
-void BendForce::project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const{
+int BendForceBatch::add( int idx0, int idx1, int idx2, int idx3, double stiffness_ ){
+	int p[4] = { idx0, idx1, idx2, idx3 };
+	idx.insert( idx.end(), p, p+4 );
+	stiffness.push_back( stiffness_ );
+	return stiffness.size()-1;
+}
 
-	// Computing Di * x + ui
-	Vector9d Dix = Dx.segment<9>( global_idx );
-	Vector9d ui = u.segment<9>( global_idx );
-	Vector9d DixPlusUi = Dix+ui;
+void BendForceBatch::initialize( const VectorXd &x, const VectorXd &v, const VectorXd &masses, const double timestep ){
+	const int n = size();
+	alpha.resize( 4*n );
+	weight.resize( n );
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){
+		helper::init_bend( &idx[4*e], x, &alpha[4*e] );
+		weight[e] = sqrt( stiffness[e] );
+	}
+}
 
-	Vector9d p;
-	computeUsingProjection(p,DixPlusUi);
-	Vector9d zi = ( 1.0 / (weight*weight + stiffness) ) * (stiffness*p + weight*weight*(DixPlusUi));		
-	
-	ui.noalias() += ( Dix - zi );
-	u.segment<9>( global_idx ) = ui;
-	z.segment<9>( global_idx ) = zi;
+void BendForceBatch::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
+	const int n = size();
+	global_idx = weights.size();
+	triplets.reserve( triplets.size() + 18*n );
+	weights.reserve( weights.size() + 9*n );
+	for( int e=0; e<n; ++e ){
+		helper::init_bend_Di( &idx[4*e], global_idx+9*e, triplets );
+		for( int i=0; i<9; ++i ){ weights.push_back( weight[e] ); }
+	}
+}
 
+void BendForceBatch::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
+	const int n = size();
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){ helper::project_bend( global_idx+9*e, &alpha[4*e], stiffness[e], weight[e], Dx, u, z ); }
 }
 
+void BendForceBatch::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	const int n = size();
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){ helper::apply_bend_Di( &idx[4*e], global_idx+9*e, x, Dx ); }
+}
 
+void BendForceBatch::apply_DiT_range( int begin, int end, const VectorXd &v, VectorXd &Dtv ) const {
+	for( int e=begin; e<end; ++e ){ helper::apply_bend_DiT( &idx[4*e], global_idx+9*e, v, Dtv ); }
+}
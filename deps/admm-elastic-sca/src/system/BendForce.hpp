@@ -34,8 +34,10 @@ public:
 	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
 	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
 	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
-
-	inline void computeUsingProjection( Vector9d& p, Vector9d& Dix) const;
+	bool matrix_free() const { return true; }
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	const char *name() const { return "BendForce"; }
 
 	int idx[4];
 	Eigen::Vector4d alpha;
@@ -43,6 +45,30 @@ public:
 };
 
 
+//
+//	BendForceBatch
+//	Same as BendForce, for all hinges in flat arrays.
+//
+class BendForceBatch : public ForceBatch {
+public:
+	// Adds a hinge and returns its index in the batch
+	int add( int idx0, int idx1, int idx2, int idx3, double stiffness_ );
+
+	int size() const { return stiffness.size(); }
+	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
+	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
+	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT_range( int begin, int end, const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	const char *name() const { return "BendForce"; }
+
+	std::vector<int> idx; // 4 per hinge
+	std::vector<double> alpha; // 4 per hinge
+	std::vector<double> stiffness, weight;
+
+}; // end class BendForceBatch
+
+
 } // end of namespace admm
 
 
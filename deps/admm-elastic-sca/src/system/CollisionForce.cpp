@@ -23,26 +23,109 @@ using namespace admm;
 using namespace Eigen;
 
 //// PUBLIC METHODS ////
+
+void CollisionForce::initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep ){
+	n_nodes = x.size()/3;
+	has_kinematic = false;
+	for( int i=0; i<collisionShapes.size(); ++i ){ has_kinematic = has_kinematic || collisionShapes[i]->kinematic(); }
+	bvh.build( collisionShapes );
+}
+
+void CollisionForce::begin_step( double t, double dt ){
+	for( int i=0; i<collisionShapes.size(); ++i ){
+		if( collisionShapes[i]->kinematic() ){ collisionShapes[i]->set_time( t, t+dt ); }
+	}
+	bvh.build( collisionShapes );
+}
 	
 void CollisionForce::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
+	// Active set rows are added by get_active, and global_idx is set by the System
+	if( use_active_set ){ return; }
+
 	global_idx = weights.size();
+
 	Di_rows = x.size();
 	for( int i=0; i<Di_rows; ++i ){
 		triplets.push_back( Triplet<double>(i+global_idx,i,1.0) );
 		weights.push_back( weight );
 	}
 }
+
+void CollisionForce::get_active( const Eigen::VectorXd &x0, const Eigen::VectorXd &x, std::vector<int> &dofs, std::vector<double> &weights ){
+	const int n = x.size()/3;
+	near_shape.assign( n, 0 );
+#pragma omp parallel for
+	for( int i=0; i<n; ++i ){
+		const Eigen::Vector3d point = x.segment<3>( 3*i );
+		if( swept ){
+			// Anything the path from x0 passes near, or that x ends up near
+			const Eigen::Vector3d p0 = x0.segment<3>( 3*i );
+			const Eigen::Vector3d mid = 0.5*( p0 + point );
+			const double r = 0.5*( point - p0 ).norm() + margin;
+			bvh.query( mid, r, [&]( int j ){
+				if( near_shape[i] ){ return; }
+				if( collisionShapes[j]->isColliding(point) > -margin ||
+					collisionShapes[j]->timeOfImpact( p0, point, margin ) >= 0.0 ){ near_shape[i] = 1; }
+			});
+			continue;
+		}
+		bvh.query( point, margin, [&]( int j ){
+			if( !near_shape[i] && collisionShapes[j]->isColliding(point) > -margin ){ near_shape[i] = 1; }
+		});
+	}
+
+	active_nodes.clear();
+	for( int i=0; i<n; ++i ){
+		if( near_shape[i] ){ active_nodes.push_back(i); }
+	}
+	const int n_active = active_nodes.size();
+	if( swept ){
+		start.resize( n_active );
+		for( int a=0; a<n_active; ++a ){ start[a] = x0.segment<3>( 3*active_nodes[a] ); }
+	}
+	for( int a=0; a<n_active; ++a ){
+		for( int j=0; j<3; ++j ){
+			dofs.push_back( 3*active_nodes[a]+j );
+			weights.push_back( weight );
+		}
+	}
+	Di_rows = 3*n_active;
+}
+
+void CollisionForce::apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const {
+	if( use_active_set ){
+		const int n_active = active_nodes.size();
+#pragma omp parallel for
+		for( int a=0; a<n_active; ++a ){ Dx.segment<3>( global_idx+3*a ) = x.segment<3>( 3*active_nodes[a] ); }
+		return;
+	}
+	Dx.segment( global_idx, Di_rows ) = x;
+}
+
+// Called outside of the parallel loop over forces (see threaded),
+// and each node has its own rows, so no atomics are needed.
+void CollisionForce::apply_DiT( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const {
+	if( use_active_set ){
+		const int n_active = active_nodes.size();
+#pragma omp parallel for
+		for( int a=0; a<n_active; ++a ){ Dtv.segment<3>( 3*active_nodes[a] ) += v.segment<3>( global_idx+3*a ); }
+		return;
+	}
+	Dtv.head( Di_rows ) += v.segment( global_idx, Di_rows );
+}
 		
 void CollisionForce::project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const { 
-	// Computing Di * x + ui
-	Eigen::VectorXd Dix = Dx.segment( global_idx, Di_rows );
-	Eigen::VectorXd ui = u.segment( global_idx, Di_rows );
-	Eigen::VectorXd DixPlusUi = Dix + ui;
-	Eigen::VectorXd zi(DixPlusUi.size());
-	handleCollisions(zi,DixPlusUi);  // perturb zi as needed to handle collisions
-	ui += ( Dix - zi );
-	u.segment( global_idx, Di_rows ) = ui;
-	z.segment( global_idx, Di_rows ) = zi;
+	const int n = use_active_set ? active_nodes.size() : Di_rows/3;
+#pragma omp parallel for
+	for( int a=0; a<n; ++a ){
+		const int r = global_idx+3*a;
+		Eigen::Vector3d Dix = Dx.segment<3>( r );
+		Eigen::Vector3d zi = Dix + u.segment<3>( r );
+		if( swept ){ sweepOut( start[a], zi ); }
+		projectOut( zi );  // perturb zi as needed to handle collisions
+		u.segment<3>( r ) += ( Dix - zi );
+		z.segment<3>( r ) = zi;
+	}
 }
 
 
@@ -53,23 +136,53 @@ void CollisionForce::project( double dt, const Eigen::VectorXd &Dx, Eigen::Vecto
 void CollisionForce::handleCollisions(Eigen::VectorXd &zi, const Eigen::VectorXd& collFreePositions) const{
 	zi = collFreePositions;
 	const int n_zi = zi.size();
+#pragma omp parallel for
 	for(int i = 0; i < n_zi; i += 3){
-		// Collision shape:
 		Eigen::Vector3d point(zi[i],zi[i+1],zi[i+2]);
-		for(int j = 0; j < collisionShapes.size(); j++){
-			double err = collisionShapes[j]->isColliding(point);
-			if( err > 0 ){
-				point = collisionShapes[j] -> projectOut(point);
-				zi[i] = point[0];
-				zi[i+1] = point[1];
-				zi[i+2] = point[2];
-			} 
-		}	
-
+		projectOut( point );
+		zi[i] = point[0];
+		zi[i+1] = point[1];
+		zi[i+2] = point[2];
 	}
 }
 
+void CollisionForce::projectOut( Eigen::Vector3d &point ) const {
+	// Shapes are visited in order as before, but only ones whose bounds
+	// contain the point (which moves with each projection) are tested.
+	int last = -1;
+	while( true ){
+		int next = -1;
+		bvh.query( point, 0.0, [&]( int j ){
+			if( j > last && ( next < 0 || j < next ) ){ next = j; }
+		});
+		if( next < 0 ){ break; }
+		if( collisionShapes[next]->isColliding(point) > 0 ){
+			point = collisionShapes[next]->projectOut(point);
+		}
+		last = next;
+	}
+}
 
+void CollisionForce::sweepOut( const Eigen::Vector3d &p0, Eigen::Vector3d &point ) const {
+	const Eigen::Vector3d mid = 0.5*( p0 + point );
+	const double r = 0.5*( point - p0 ).norm();
 
+	// Earliest hit among shapes the node started outside of
+	// (ones it is already inside of are left to projectOut).
+	double toi = 2.0;
+	int hit = -1;
+	Eigen::Vector3d contact;
+	bvh.query( mid, r, [&]( int j ){
+		Eigen::Vector3d c;
+		double t = collisionShapes[j]->sweep( p0, point, c );
+		if( t >= 0.0 && ( t < toi || ( t == toi && j < hit ) ) ){ toi = t; hit = j; contact = c; }
+	});
+	if( hit < 0 ){ return; }
 
-
+	// Stop at the contact and slide along the surface
+	const Eigen::Vector3d n = collisionShapes[hit]->normal( contact );
+	Eigen::Vector3d rest = point - contact;
+	const double dn = rest.dot( n );
+	if( dn < 0.0 ){ rest -= dn*n; }
+	point = contact + rest;
+}
@@ -22,22 +22,70 @@
 
 #include "Force.hpp"
 #include "CollisionShape.hpp"
+#include "ShapeBVH.hpp"
 
 namespace admm {
 
+//
+//	Collision Force
+//
+//	By default the force has an identity row for every dof in the system. With
+//	active_set, rows are only added for nodes within margin of a shape at the
+//	start of each step (see Force::active_set), so the cost scales with the
+//	number of contacts instead of the number of nodes.
+//
+//	Shapes are culled with a BVH over their bounds (built in initialize, so
+//	call initialize again if shapes are added or moved), and the loops over
+//	nodes are parallelized by the force itself.
+//
+//	With swept set, each projection is also tested along the path from the
+//	node's position at the start of the step (time of impact), so fast nodes
+//	stop at the first surface they cross instead of tunneling through thin
+//	shapes. The start positions come from get_active, so swept implies active_set.
+//
+//	Kinematic shapes (see KinematicShape) are posed in begin_step, which also
+//	rebuilds the BVH since their bounds move.
+//
 class CollisionForce : public Force {
 public:
-	CollisionForce( std::vector< std::shared_ptr<CollisionShape> > &collShapes, double use_weight=32.0 ) : collisionShapes(collShapes) { weight = use_weight; }
-	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep ){ n_nodes = x.size()/3; }
+	CollisionForce( std::vector< std::shared_ptr<CollisionShape> > &collShapes, double use_weight=32.0, bool active_set_=false, double margin_=0.1, bool swept_=false ) :
+		collisionShapes(collShapes), use_active_set(active_set_ || swept_), swept(swept_), has_kinematic(false), margin(margin_), Di_rows(0) { weight = use_weight; }
+	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
 
 	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
 	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
+	bool matrix_free() const { return true; }
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	bool active_set() const { return use_active_set; }
+	void get_active( const Eigen::VectorXd &x0, const Eigen::VectorXd &x, std::vector<int> &dofs, std::vector<double> &weights );
+	bool threaded() const { return true; }
+	bool time_dependent() const { return has_kinematic; }
+	void begin_step( double t, double dt );
+	const char *name() const { return "CollisionForce"; }
 	void handleCollisions(Eigen::VectorXd &zi, const Eigen::VectorXd& collFreePositions) const;
 	std::vector< std::shared_ptr<CollisionShape> > collisionShapes;
 
+	bool use_active_set;
+	bool swept; // continuous collision detection from the start of step positions
+	bool has_kinematic; // any shape moves, set in initialize
+	double margin; // active set: distance from a shape at which a node gets rows
+	std::vector<int> active_nodes; // active set: node of each 3 rows
+	std::vector<Eigen::Vector3d> start; // swept: start of step position of each active node
+	ShapeBVH bvh;
+
 	// Returns squared constraint violation
 	int Di_rows;
 	int n_nodes;
+
+protected:
+	// Projects a point out of all shapes (in order) it is colliding with
+	void projectOut( Eigen::Vector3d &point ) const;
+
+	// Clamps a point moving from p0 at the first shape surface along the
+	// way, keeping the tangential part of the remaining motion.
+	void sweepOut( const Eigen::Vector3d &p0, Eigen::Vector3d &point ) const;
+	std::vector<char> near_shape; // get_active: per node flag
 };
 
 
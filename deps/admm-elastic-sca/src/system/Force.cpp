@@ -22,6 +22,42 @@
 using namespace admm;
 using namespace Eigen;
 
+namespace admm {
+namespace helper {
+
+	static inline void init_spring_Di( int idx0, int idx1, int constraint_idx, std::vector<Eigen::Triplet<double> > &triplets ){
+		for( int i=0; i<3; ++i ){
+			triplets.push_back( Eigen::Triplet<double>( i+constraint_idx, 3*idx0+i, 1.0 ) );
+			triplets.push_back( Eigen::Triplet<double>( i+constraint_idx, 3*idx1+i, -1.0 ) );
+		}
+	}
+
+	// Spring update for the element at row r
+	static inline void project_spring( int r, double stiffness, double rest_length, double weight,
+		const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ){
+		using namespace Eigen;
+
+		// Computing Di * x + ui
+		Vector3d Dix = Dx.segment<3>( r );
+		Vector3d ui = u.segment<3>( r );
+		Vector3d DixUi = Dix + ui;
+
+		// Analytical update using projection p
+		double DixUi_norm = DixUi.norm();
+		Vector3d DixUi_normed = DixUi / DixUi_norm;
+		if( DixUi_norm <= 0.0 ){ DixUi_normed.setZero(); }
+
+		Vector3d p = rest_length * DixUi_normed;
+		Vector3d zi = ( 1.0 / (weight*weight + stiffness) ) * (stiffness*p + weight*weight*(DixUi));
+
+		ui += ( Dix - zi );
+		u.segment<3>( r ) = ui;
+		z.segment<3>( r ) = zi;
+	}
+
+}
+}
+
 //
 //	Spring Force
 //
@@ -39,34 +75,74 @@ void Spring::initialize( const VectorXd &x, const VectorXd &v, const VectorXd &m
 
 void Spring::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
 	global_idx = weights.size();
-	const int col0 = 3 * idx0; const int col1 = 3 * idx1;
-
-	for( int i=0; i<3; ++i ){
-		triplets.push_back( Triplet<double>( i+global_idx, col0+i, 1.0 ) );
-		triplets.push_back( Triplet<double>( i+global_idx, col1+i, -1.0 ) );
-	}
-
+	helper::init_spring_Di( idx0, idx1, global_idx, triplets );
 	for( int i=0; i<3; ++i ){ weights.push_back(weight); }
 }
 
 void Spring::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
+	helper::project_spring( global_idx, stiffness, rest_length, weight, Dx, u, z );
+}
 
-	// Computing Di * x + ui
-	Vector3d Dix = Dx.segment<3>( global_idx );
-	Vector3d ui = u.segment<3>( global_idx );
-	Vector3d DixUi = Dix + ui;
+void Spring::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	Dx.segment<3>( global_idx ) = x.segment<3>( 3*idx0 ) - x.segment<3>( 3*idx1 );
+}
 
-	// Analytical update using projection p
-	double DixUi_norm = DixUi.norm();
-	Vector3d DixUi_normed = DixUi / DixUi_norm;
-	if( DixUi_norm <= 0.0 ){ DixUi_normed.setZero(); }
+void Spring::apply_DiT( const VectorXd &v, VectorXd &Dtv ) const {
+	Vector3d vi = v.segment<3>( global_idx );
+	helper::add3( Dtv, idx0, vi );
+	helper::add3( Dtv, idx1, -vi );
+}
+
+
+//
+//	SpringBatch
+//
+
+int SpringBatch::add( int idx0, int idx1, double stiffness_ ){
+	idx.push_back( idx0 );
+	idx.push_back( idx1 );
+	stiffness.push_back( stiffness_ );
+	return stiffness.size()-1;
+}
+
+void SpringBatch::initialize( const VectorXd &x, const VectorXd &v, const VectorXd &masses, const double timestep ){
+	const int n = size();
+	rest_length.resize( n );
+	weight.resize( n );
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){
+		rest_length[e] = ( x.segment<3>( 3*idx[2*e] ) - x.segment<3>( 3*idx[2*e+1] ) ).norm();
+		weight[e] = sqrt( stiffness[e] );
+	}
+}
 
-	Vector3d p = rest_length * DixUi_normed;
-	Vector3d zi = ( 1.0 / (weight*weight + stiffness) ) * (stiffness*p + weight*weight*(DixUi));
+void SpringBatch::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
+	const int n = size();
+	global_idx = weights.size();
+	triplets.reserve( triplets.size() + 6*n );
+	weights.reserve( weights.size() + 3*n );
+	for( int e=0; e<n; ++e ){
+		helper::init_spring_Di( idx[2*e], idx[2*e+1], global_idx+3*e, triplets );
+		for( int i=0; i<3; ++i ){ weights.push_back( weight[e] ); }
+	}
+}
 
-	ui += ( Dix - zi );
-	u.segment<3>( global_idx ) = ui;
-	z.segment<3>( global_idx ) = zi;
+void SpringBatch::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
+	const int n = size();
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){ helper::project_spring( global_idx+3*e, stiffness[e], rest_length[e], weight[e], Dx, u, z ); }
+}
 
+void SpringBatch::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	const int n = size();
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){ Dx.segment<3>( global_idx+3*e ) = x.segment<3>( 3*idx[2*e] ) - x.segment<3>( 3*idx[2*e+1] ); }
 }
 
+void SpringBatch::apply_DiT_range( int begin, int end, const VectorXd &v, VectorXd &Dtv ) const {
+	for( int e=begin; e<end; ++e ){
+		Vector3d vi = v.segment<3>( global_idx+3*e );
+		helper::add3( Dtv, idx[2*e], vi );
+		helper::add3( Dtv, idx[2*e+1], -vi );
+	}
+}
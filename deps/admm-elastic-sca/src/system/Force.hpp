@@ -28,6 +28,34 @@
 
 namespace admm {
 
+namespace helper {
+
+	// Adds g to node in Dtv. Used when scattering Dit*v, where parallel
+	// callers give each thread its own Dtv (see System::apply_Dt).
+	static inline void add3( Eigen::VectorXd &Dtv, int node, const Eigen::Vector3d &g ){
+		Dtv.segment<3>( 3*node ) += g;
+	}
+
+	// Matrix-free selector for element forces with F = X*B, where the columns of X
+	// are the positions of the N element nodes. Di*x is F stacked by column.
+	// B is the NxC (column major) matrix from the element's rest shape.
+	template<int N, int C> static inline void apply_Di_B( const int *idx, const double *B,
+		int global_idx, const Eigen::VectorXd &x, Eigen::VectorXd &Dx ){
+		Eigen::Matrix<double,3,N> X;
+		for( int c=0; c<N; ++c ){ X.col(c) = x.segment<3>( 3*idx[c] ); }
+		Eigen::Matrix<double,3,C> F = X * Eigen::Map< const Eigen::Matrix<double,N,C> >( B );
+		Dx.segment<3*C>( global_idx ) = Eigen::Map< Eigen::Matrix<double,3*C,1> >( F.data() );
+	}
+
+	template<int N, int C> static inline void apply_DiT_B( const int *idx, const double *B,
+		int global_idx, const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ){
+		Eigen::Matrix<double,3,C> V = Eigen::Map< const Eigen::Matrix<double,3,C> >( v.data()+global_idx );
+		Eigen::Matrix<double,3,N> G = V * Eigen::Map< const Eigen::Matrix<double,N,C> >( B ).transpose();
+		for( int c=0; c<N; ++c ){ add3( Dtv, idx[c], G.col(c) ); }
+	}
+
+} // end namespace helper
+
 //
 //	Force base class
 //
@@ -54,9 +82,80 @@ public:
 	// Set an epsilon for collision/sliding/etc...
 	virtual void set_eps( double eps ){}
 
+	// Matrix-free selector, used instead of the global D matrix when
+	// System::Settings::matrix_free_D is set. Forces that return true
+	// here must implement apply_Di and apply_DiT to match get_selector.
+	virtual bool matrix_free() const { return false; }
+
+	// Sets the rows of Dx at global_idx to Di*x
+	virtual void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const {}
+
+	// Adds Dit*vi to Dtv, where vi are the rows of v at global_idx.
+	// Called for all forces in parallel, but each thread has its own Dtv
+	// (summed after), so writes don't need to be atomic.
+	virtual void apply_DiT( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const {}
+
+	// Active-set forces (e.g. contacts) constrain a subset of dofs that changes
+	// from step to step, with one identity row per dof. They add no rows in
+	// get_selector (and the System skips them there). Instead, at the start of each step the System calls get_active
+	// with the positions at the start of the step (x0) and the predicted positions (x),
+	// which appends the constrained dofs and their weights. These rows come after all of the static ones, starting at global_idx
+	// (set before the call). Active-set forces must support the matrix-free selector.
+	virtual bool active_set() const { return false; }
+	virtual void get_active( const Eigen::VectorXd &x0, const Eigen::VectorXd &x, std::vector<int> &dofs, std::vector<double> &weights ){}
+
+	// Forces that parallelize their own project, apply_Di and apply_DiT (e.g. over
+	// nodes) return true. Like batches, they are called after the parallel loop
+	// over the other forces, one at a time.
+	virtual bool threaded() const { return false; }
+
+	// Forces with data that changes over time (e.g. moving obstacles) return true,
+	// and the System calls begin_step with the time at the start of each step,
+	// before the active set and the admm loop. They update that data here once,
+	// so it stays fixed while project is called in parallel.
+	virtual bool time_dependent() const { return false; }
+	virtual void begin_step( double t, double dt ){}
+
+	// Class name, which groups the local step timings (see StepStats)
+	virtual const char *name() const { return "Force"; }
+
 }; // end class force
 
 
+//
+//	Force batch base class
+//	Stores all elements of one force type in flat arrays, and runs each
+//	operation in a single (parallel) loop over them instead of a virtual call
+//	per element. Elements take consecutive rows of D starting at global_idx.
+//	Batches always support the matrix-free selector.
+//
+class ForceBatch {
+public:
+	ForceBatch() : global_idx(0) {}
+	virtual ~ForceBatch(){}
+
+	// Number of elements in the batch
+	virtual int size() const = 0;
+
+	// Same as Force, but for all elements
+	virtual void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep ) = 0;
+	virtual void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ) = 0;
+	virtual void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const = 0;
+	virtual void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const = 0;
+
+	// Adds Dit*vi of elements [begin,end) to Dtv, without threading. System::apply_Dt
+	// splits the batch over its threads, each with its own Dtv.
+	virtual void apply_DiT_range( int begin, int end, const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const = 0;
+	void apply_DiT( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const { apply_DiT_range( 0, size(), v, Dtv ); }
+
+	// Type name of the elements, see Force::name
+	virtual const char *name() const = 0;
+
+	int global_idx; // row of the first element in the global matrix
+
+}; // end class force batch
+
+
 //
 //	Spring Force
 //
@@ -66,11 +165,37 @@ public:
 	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
 	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
 	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
+	bool matrix_free() const { return true; }
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	const char *name() const { return "Spring"; }
 	int idx0, idx1;
 	double stiffness, rest_length;
 
 }; // end class spring
 
+//
+//	Spring Batch
+//	Same as Spring, for all springs in flat arrays.
+//
+class SpringBatch : public ForceBatch {
+public:
+	// Adds a spring and returns its index in the batch
+	int add( int idx0, int idx1, double stiffness_ );
+
+	int size() const { return stiffness.size(); }
+	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
+	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
+	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT_range( int begin, int end, const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	const char *name() const { return "Spring"; }
+
+	std::vector<int> idx; // 2 per spring
+	std::vector<double> stiffness, rest_length, weight;
+
+}; // end class SpringBatch
+
 
 } // end namespace admm
 
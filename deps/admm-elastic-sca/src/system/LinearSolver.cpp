@@ -0,0 +1,163 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "LinearSolver.hpp"
+#include <iostream>
+
+using namespace admm;
+using namespace Eigen;
+
+
+std::shared_ptr<LinearSolver> LinearSolver::create( std::string type, int max_iters, double tol, double rho ){
+	if( type == "ldlt" ){ return std::shared_ptr<LinearSolver>( new LDLTSolver() ); }
+	else if( type == "llt" ){ return std::shared_ptr<LinearSolver>( new LLTSolver() ); }
+	else if( type == "pcg" ){ return std::shared_ptr<LinearSolver>( new PCGSolver( max_iters, tol ) ); }
+	else if( type == "chebyshev" ){ return std::shared_ptr<LinearSolver>( new ChebyshevSolver( max_iters, tol, rho ) ); }
+	return NULL;
+}
+
+//
+//	Direct solvers
+//
+
+bool LDLTSolver::analyze( const GlobalTerms &terms ){
+	if( terms.A == NULL ){ return false; }
+	solver.analyzePattern( *terms.A );
+	return ( solver.info() == Eigen::Success );
+}
+
+bool LDLTSolver::factorize( const GlobalTerms &terms ){
+	if( terms.A == NULL ){ return false; }
+	solver.factorize( *terms.A );
+	return ( solver.info() == Eigen::Success );
+}
+
+bool LLTSolver::analyze( const GlobalTerms &terms ){
+	if( terms.A == NULL ){ return false; }
+	solver.analyzePattern( *terms.A );
+	return ( solver.info() == Eigen::Success );
+}
+
+bool LLTSolver::factorize( const GlobalTerms &terms ){
+	if( terms.A == NULL ){ return false; }
+	solver.factorize( *terms.A );
+	return ( solver.info() == Eigen::Success );
+}
+
+//
+//	Matrix-free solvers
+//
+
+bool MatrixFreeSolver::factorize( const GlobalTerms &terms_ ){
+
+	terms = terms_;
+	const SparseMatrix<double> &D = *terms.D;
+	const int dof = D.cols();
+	if( terms.masses->size() != dof || terms.W_diag->size() < D.rows() ){ return false; }
+	W2 = terms.W_diag->head( D.rows() ).cwiseProduct( terms.W_diag->head( D.rows() ) );
+	Dx.resize( D.rows() );
+	last_iters = 0;
+
+	// Diagonal of M + dt^2 Dt W^2 D, one column of D at a time
+	inv_diag.resize( dof );
+#pragma omp parallel for
+	for( int j=0; j<dof; ++j ){
+		double d = 0.0;
+		for( SparseMatrix<double>::InnerIterator it(D,j); it; ++it ){ d += W2[it.row()] * it.value() * it.value(); }
+		d = (*terms.masses)[j] + terms.dt2 * d;
+		if( terms.active_diag ){ d += (*terms.active_diag)[j]; }
+		inv_diag[j] = ( d > 0.0 ? 1.0/d : 0.0 );
+	}
+
+	return true;
+}
+
+void MatrixFreeSolver::apply( const VectorXd &x, VectorXd &Ax ){
+	const SparseMatrix<double> &D = *terms.D;
+	Dx.noalias() = D * x;
+	Dx.array() *= W2.array();
+	Ax.noalias() = D.transpose() * Dx;
+	Ax = terms.masses->cwiseProduct( x ) + terms.dt2 * Ax;
+	if( terms.active_diag ){ Ax += terms.active_diag->cwiseProduct( x ); }
+}
+
+void PCGSolver::solve( const VectorXd &b, VectorXd &x ){
+
+	if( x.size() != b.size() ){ x = inv_diag.cwiseProduct( b ); }
+	const double b_norm = b.norm();
+	Ap.resize( b.size() );
+
+	apply( x, Ap );
+	r = b - Ap;
+	z = inv_diag.cwiseProduct( r );
+	p = z;
+	double rz = r.dot( z );
+
+	int i = 0;
+	for( ; i<max_iters; ++i ){
+
+		if( r.norm() <= tol*b_norm ){ break; }
+
+		apply( p, Ap );
+		double pAp = p.dot( Ap );
+		if( pAp <= 0.0 ){ break; }
+		double alpha = rz / pAp;
+		x.noalias() += alpha * p;
+		r.noalias() -= alpha * Ap;
+
+		z = inv_diag.cwiseProduct( r );
+		double rz_new = r.dot( z );
+		p = z + ( rz_new / rz ) * p;
+		rz = rz_new;
+	}
+
+	last_iters = i;
+}
+
+void ChebyshevSolver::solve( const VectorXd &b, VectorXd &x ){
+
+	if( x.size() != b.size() ){ x = inv_diag.cwiseProduct( b ); }
+	const double b_norm = b.norm();
+	const double rho2 = rho*rho;
+	const double gamma = 0.9; // under-relaxation of the jacobi step
+	Ax.resize( b.size() );
+	x_prev = x;
+
+	double omega = 1.0;
+	int i = 0;
+	for( ; i<max_iters; ++i ){
+
+		apply( x, Ax );
+		Ax = b - Ax; // residual
+		if( Ax.norm() <= tol*b_norm ){ break; }
+
+		// Jacobi step, then the Chebyshev update
+		x_next = x + gamma * inv_diag.cwiseProduct( Ax );
+		if( i == 1 ){ omega = 2.0 / ( 2.0 - rho2 ); }
+		else if( i > 1 ){ omega = 4.0 / ( 4.0 - rho2*omega ); }
+		x_next = omega * ( x_next - x_prev ) + x_prev;
+
+		x_prev = x;
+		x = x_next;
+	}
+
+	last_iters = i;
+}
+
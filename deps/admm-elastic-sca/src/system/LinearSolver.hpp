@@ -0,0 +1,164 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef ADMM_LINEARSOLVER_H
+#define ADMM_LINEARSOLVER_H 1
+
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+#ifdef ADMME_USE_CHOLMOD
+#include <Eigen/CholmodSupport>
+#endif
+#include <memory>
+#include <string>
+
+namespace admm {
+
+//
+//	The global step solves ( M + dt^2 Dt W^2 D ) x = b. GlobalTerms holds
+//	pointers to the parts of that matrix, which are owned by the System.
+//	A is only assembled if the solver asks for it (see needs_matrix).
+//
+//	Active-set rows (see Force::active_set) aren't in D. They select single dofs,
+//	so they only add dt^2 w^2 to the diagonal, which is passed as active_diag.
+//
+struct GlobalTerms {
+	GlobalTerms() : masses(0), D(0), W_diag(0), active_diag(0), A(0), dt2(0.0) {}
+	const Eigen::VectorXd *masses; // diagonal of M, scaled x3
+	const Eigen::SparseMatrix<double> *D; // reduction matrix
+	const Eigen::VectorXd *W_diag; // diagonal of the weight matrix, the first D.rows() are for D
+	const Eigen::VectorXd *active_diag; // added to the diagonal by active-set rows, or NULL
+	const Eigen::SparseMatrix<double> *A; // assembled global matrix, or NULL
+	double dt2; // timestep squared
+};
+
+//
+//	Linear solver base class for the global step.
+//
+class LinearSolver {
+public:
+	virtual ~LinearSolver() {}
+
+	// Returns true if the solver needs the assembled global matrix.
+	// Matrix-free solvers return false so the System never forms it.
+	virtual bool needs_matrix() const { return true; }
+
+	// Called once in System::initialize. The sparsity of the global matrix
+	// doesn't change after that, so this is where symbolic analysis goes.
+	virtual bool analyze( const GlobalTerms &terms ){ return true; }
+
+	// Called after analyze and on every System::recompute_weights with
+	// new values in the same pattern. Returns false on a failure.
+	virtual bool factorize( const GlobalTerms &terms ) = 0;
+
+	// On input x is the initial guess (iterative solvers use it as a warm start).
+	virtual void solve( const Eigen::VectorXd &b, Eigen::VectorXd &x ) = 0;
+
+	// Creates a solver by name: ldlt, llt, pcg, or chebyshev.
+	// Returns NULL if the name is unknown.
+	static std::shared_ptr<LinearSolver> create( std::string type, int max_iters, double tol, double rho );
+};
+
+
+//
+//	Simplicial LDLT, the default
+//
+class LDLTSolver : public LinearSolver {
+public:
+	bool analyze( const GlobalTerms &terms );
+	bool factorize( const GlobalTerms &terms );
+	void solve( const Eigen::VectorXd &b, Eigen::VectorXd &x ){ x = solver.solve(b); }
+	Eigen::SimplicialLDLT< Eigen::SparseMatrix<double> > solver;
+};
+
+
+//
+//	Supernodal LLT (Cholmod). Falls back to a simplicial LLT
+//	if admm-elastic was built without ADMME_CHOLMOD.
+//
+class LLTSolver : public LinearSolver {
+public:
+	bool analyze( const GlobalTerms &terms );
+	bool factorize( const GlobalTerms &terms );
+	void solve( const Eigen::VectorXd &b, Eigen::VectorXd &x ){ x = solver.solve(b); }
+#ifdef ADMME_USE_CHOLMOD
+	Eigen::CholmodSupernodalLLT< Eigen::SparseMatrix<double> > solver;
+#else
+	Eigen::SimplicialLLT< Eigen::SparseMatrix<double> > solver;
+#endif
+};
+
+
+//
+//	Matrix-free iterative solvers. The global matrix is applied as
+//	M x + dt^2 Dt ( W^2 ( D x ) ) and never formed.
+//
+class MatrixFreeSolver : public LinearSolver {
+public:
+	MatrixFreeSolver( int max_iters_, double tol_ ) : max_iters(max_iters_), tol(tol_) {}
+	bool needs_matrix() const { return false; }
+	bool factorize( const GlobalTerms &terms ); // stores the terms and computes the diagonal
+
+	int max_iters;
+	double tol; // relative residual tolerance
+	int last_iters; // iterations used by the last solve
+
+protected:
+	void apply( const Eigen::VectorXd &x, Eigen::VectorXd &Ax ); // Ax = A*x
+	GlobalTerms terms;
+	Eigen::VectorXd W2; // squared weights
+	Eigen::VectorXd inv_diag; // Jacobi preconditioner
+	Eigen::VectorXd Dx; // temporary for apply
+};
+
+
+//
+//	Jacobi preconditioned conjugate gradient
+//
+class PCGSolver : public MatrixFreeSolver {
+public:
+	PCGSolver( int max_iters_, double tol_ ) : MatrixFreeSolver(max_iters_,tol_) {}
+	void solve( const Eigen::VectorXd &b, Eigen::VectorXd &x );
+
+protected:
+	Eigen::VectorXd r, z, p, Ap;
+};
+
+
+//
+//	Jacobi iterations with Chebyshev acceleration (Wang 2015).
+//	rho is an estimate of the spectral radius of the Jacobi iteration matrix,
+//	and should be a bit below 1. If it's too high the solve diverges.
+//
+class ChebyshevSolver : public MatrixFreeSolver {
+public:
+	ChebyshevSolver( int max_iters_, double tol_, double rho_ ) : MatrixFreeSolver(max_iters_,tol_), rho(rho_) {}
+	void solve( const Eigen::VectorXd &b, Eigen::VectorXd &x );
+	double rho;
+
+protected:
+	Eigen::VectorXd Ax, x_prev, x_next;
+};
+
+
+} // end namespace admm
+
+#endif
+
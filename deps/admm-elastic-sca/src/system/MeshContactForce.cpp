@@ -0,0 +1,254 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "MeshContactForce.hpp"
+#include "ClosestPoint.hpp"
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+using namespace admm;
+using namespace Eigen;
+
+//// PUBLIC METHODS ////
+
+void MeshContactForce::initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep ){
+
+	n_nodes = x.size()/3;
+	node_slot.assign( n_nodes, -1 );
+	normals.assign( n_nodes, Vector3d::Zero() );
+
+	const int n_objects = surfaces.size();
+	objects.resize( n_objects );
+	for( int o=0; o<n_objects; ++o ){
+		Surface &surf = objects[o];
+		const int n_tris = surfaces[o].size()/3;
+		surf.tris.resize( n_tris );
+		surf.verts.clear();
+
+		// Flip the faces if the surface encloses a negative volume
+		double volume = 0.0;
+		for( int t=0; t<n_tris; ++t ){
+			surf.tris[t] = Vector3i( surfaces[o][3*t], surfaces[o][3*t+1], surfaces[o][3*t+2] );
+			volume += x.segment<3>( 3*surf.tris[t][0] ).dot( x.segment<3>( 3*surf.tris[t][1] ).cross( x.segment<3>( 3*surf.tris[t][2] ) ) );
+		}
+		if( volume < 0.0 ){
+			for( int t=0; t<n_tris; ++t ){ std::swap( surf.tris[t][1], surf.tris[t][2] ); }
+		}
+
+		// Unique nodes and the faces around them
+		std::vector<int> local( n_nodes, -1 );
+		for( int t=0; t<n_tris; ++t ){
+			for( int j=0; j<3; ++j ){
+				int &l = local[ surf.tris[t][j] ];
+				if( l < 0 ){ l = surf.verts.size(); surf.verts.push_back( surf.tris[t][j] ); }
+			}
+		}
+		const int n_verts = surf.verts.size();
+		surf.vert_offsets.assign( n_verts+1, 0 );
+		for( int t=0; t<n_tris; ++t ){
+			for( int j=0; j<3; ++j ){ surf.vert_offsets[ local[ surf.tris[t][j] ]+1 ]++; }
+		}
+		for( int i=0; i<n_verts; ++i ){ surf.vert_offsets[i+1] += surf.vert_offsets[i]; }
+		surf.vert_faces.resize( 3*n_tris );
+		std::vector<int> fill( surf.vert_offsets.begin(), surf.vert_offsets.end()-1 );
+		for( int t=0; t<n_tris; ++t ){
+			for( int j=0; j<3; ++j ){ surf.vert_faces[ fill[ local[ surf.tris[t][j] ] ]++ ] = t; }
+		}
+
+		// Neighboring face across each edge, from the faces around its first vertex
+		surf.adj.assign( n_tris, Vector3i(-1,-1,-1) );
+		for( int t=0; t<n_tris; ++t ){
+			for( int j=0; j<3; ++j ){
+				const int a = surf.tris[t][j], b = surf.tris[t][(j+1)%3], l = local[a];
+				for( int k=surf.vert_offsets[l]; k<surf.vert_offsets[l+1]; ++k ){
+					const Vector3i &f = surf.tris[ surf.vert_faces[k] ];
+					if( surf.vert_faces[k] != t && ( f[0]==b || f[1]==b || f[2]==b ) ){ surf.adj[t][j] = surf.vert_faces[k]; }
+				}
+			}
+		}
+
+		surf.bvh.build( surf.tris, x );
+		surf.refit = false;
+	}
+}
+
+
+void MeshContactForce::get_active( const Eigen::VectorXd &x0, const Eigen::VectorXd &x, std::vector<int> &dofs, std::vector<double> &weights ){
+
+	const double reach = thickness + margin;
+	const int n_objects = objects.size();
+
+	// Boxes of each object over the step. Usually objects are apart, and
+	// this is all that is done.
+#pragma omp parallel for
+	for( int o=0; o<n_objects; ++o ){
+		Surface &surf = objects[o];
+		surf.refit = false;
+		if( surf.verts.size()==0 ){ continue; }
+		surf.bmin = x0.segment<3>( 3*surf.verts[0] ); surf.bmax = surf.bmin;
+		for( int i=0; i<surf.verts.size(); ++i ){
+			const int v = surf.verts[i];
+			surf.bmin = surf.bmin.cwiseMin( x0.segment<3>( 3*v ) ).cwiseMin( x.segment<3>( 3*v ) );
+			surf.bmax = surf.bmax.cwiseMax( x0.segment<3>( 3*v ) ).cwiseMax( x.segment<3>( 3*v ) );
+		}
+		surf.bmin.array() -= reach;
+		surf.bmax.array() += reach;
+	}
+
+	std::vector< std::pair<int,int> > near;
+	for( int a=0; a<n_objects; ++a ){
+		for( int b=a+1; b<n_objects; ++b ){
+			const Surface &sa = objects[a], &sb = objects[b];
+			if( sa.verts.size()==0 || sb.verts.size()==0 ){ continue; }
+			if( ( sa.bmax.array() < sb.bmin.array() ).any() || ( sb.bmax.array() < sa.bmin.array() ).any() ){ continue; }
+			near.push_back( std::make_pair( a, b ) );
+			near.push_back( std::make_pair( b, a ) );
+			objects[a].refit = true;
+			objects[b].refit = true;
+		}
+	}
+
+	// Refit the trees and update the normals of objects that are close to another
+	for( int o=0; o<n_objects; ++o ){
+		Surface &surf = objects[o];
+		if( !surf.refit ){ continue; }
+		surf.bvh.refit( x0, x, reach );
+		const int n_verts = surf.verts.size();
+#pragma omp parallel for
+		for( int i=0; i<n_verts; ++i ){
+			const int v = surf.verts[i];
+			Vector3d n = Vector3d::Zero();
+			for( int j=surf.vert_offsets[i]; j<surf.vert_offsets[i+1]; ++j ){
+				const Vector3i &f = surf.tris[ surf.vert_faces[j] ];
+				const int k = f[0]==v ? 0 : ( f[1]==v ? 1 : 2 );
+				const Vector3d e1 = x0.segment<3>( 3*f[(k+1)%3] ) - x0.segment<3>( 3*v );
+				const Vector3d e2 = x0.segment<3>( 3*f[(k+2)%3] ) - x0.segment<3>( 3*v );
+				const Vector3d c = e1.cross( e2 );
+				const double len = c.norm();
+				if( len > 0.0 ){ n += std::atan2( len, e1.dot( e2 ) ) / len * c; }
+			}
+			normals[ v ] = n.normalized();
+		}
+	}
+
+	// Surface vertices of one object against the triangles of the other
+	pairs.clear();
+	for( int k=0; k<near.size(); ++k ){
+		const Surface &sa = objects[ near[k].first ], &sb = objects[ near[k].second ];
+		const int n_verts = sa.verts.size();
+
+		// Vertex v against triangle f, with the interpolated normal
+		auto vt_pair = [&]( int v, const Vector3i &f, const Vector3d &bary ){
+			Pair p;
+			p.slot[0] = v; p.slot[1] = f[0]; p.slot[2] = f[1]; p.slot[3] = f[2];
+			p.w[0] = 1.0; p.w[1] = -bary[0]; p.w[2] = -bary[1]; p.w[3] = -bary[2];
+			p.n = bary[0]*normals[ f[0] ] + bary[1]*normals[ f[1] ] + bary[2]*normals[ f[2] ];
+			return p;
+		};
+
+#pragma omp parallel
+		{
+			std::vector<Pair> local;
+
+#pragma omp for schedule(dynamic,64) nowait
+			for( int i=0; i<n_verts; ++i ){
+				const int v = sa.verts[i];
+				const Vector3d p0 = x0.segment<3>( 3*v );
+				const Vector3d bmin = p0.cwiseMin( x.segment<3>( 3*v ) ), bmax = p0.cwiseMax( x.segment<3>( 3*v ) );
+				if( ( bmax.array() < sb.bmin.array() ).any() || ( sb.bmax.array() < bmin.array() ).any() ){ continue; }
+
+				// The closest triangle tells if the vertex is inside at x0
+				const int first = local.size();
+				double closest_d = std::numeric_limits<double>::max();
+				int closest_t = -1;
+				Vector3d closest_bary;
+				sb.bvh.query( bmin, bmax, [&]( int t ){
+					const Vector3i &f = sb.tris[t];
+					Vector3d bary;
+					Vector3d c0 = closest_point::triangle( p0, x0.segment<3>( 3*f[0] ), x0.segment<3>( 3*f[1] ), x0.segment<3>( 3*f[2] ), bary );
+					const double d0 = ( p0-c0 ).norm();
+					if( d0 < closest_d ){ closest_d = d0; closest_t = t; closest_bary = bary; }
+					if( d0 <= 1e-12 ){ return; } // no separating direction
+
+					// Kept if within reach at x0 or closer than that at x
+					Pair p = vt_pair( v, f, bary );
+					p.n = ( p0-c0 ) / d0;
+					Vector3d y = Vector3d::Zero();
+					for( int j=0; j<4; ++j ){ y += p.w[j] * x.segment<3>( 3*p.slot[j] ); }
+					if( d0 < reach || p.n.dot( y ) < reach ){ local.push_back( p ); }
+				});
+
+				// Triangles within reach of p0 are all found above. Past that, a vertex in
+				// the other object's box may be deep inside, with its closest triangle
+				// anywhere, so it is searched for over the whole tree.
+				if( closest_d >= reach && ( p0.array() >= sb.bmin.array() ).all() && ( p0.array() <= sb.bmax.array() ).all() ){
+					sb.bvh.closest( p0, [&]( int t ){
+						const Vector3i &f = sb.tris[t];
+						Vector3d bary;
+						const double d2 = ( p0 - closest_point::triangle( p0, x0.segment<3>( 3*f[0] ), x0.segment<3>( 3*f[1] ), x0.segment<3>( 3*f[2] ), bary ) ).squaredNorm();
+						if( d2 < closest_d*closest_d ){ closest_d = std::sqrt( d2 ); closest_t = t; closest_bary = bary; }
+						return d2;
+					});
+				}
+
+				// Inside: only the closest triangle, pushing out along its normal
+				if( closest_t >= 0 ){
+					const Vector3i &f = sb.tris[ closest_t ];
+					Pair p = vt_pair( v, f, closest_bary );
+					Vector3d c0 = Vector3d::Zero();
+					for( int j=0; j<3; ++j ){ c0 += closest_bary[j] * x0.segment<3>( 3*f[j] ); }
+					if( ( p0-c0 ).dot( pseudo_normal( sb, closest_t, closest_bary, x0 ) ) < 0.0 && p.n.squaredNorm() > 0.0 ){
+						local.resize( first );
+						p.n.normalize();
+						local.push_back( p );
+					}
+				}
+			}
+
+#pragma omp critical
+			{ pairs.insert( pairs.end(), local.begin(), local.end() ); }
+		}
+	}
+
+	set_active( dofs, weights );
+}
+
+
+//// PROTECTED METHODS ////
+
+Eigen::Vector3d MeshContactForce::pseudo_normal( const Surface &surf, int t, const Eigen::Vector3d &bary, const Eigen::VectorXd &x0 ) const {
+
+	const Vector3i &f = surf.tris[t];
+	const int n_zero = ( bary[0]==0.0 ) + ( bary[1]==0.0 ) + ( bary[2]==0.0 );
+	if( n_zero == 2 ){ return normals[ f[ bary[0]!=0.0 ? 0 : ( bary[1]!=0.0 ? 1 : 2 ) ] ]; }
+
+	auto face_normal = [&]( int s ){
+		const Vector3i &g = surf.tris[s];
+		const Vector3d a = x0.segment<3>( 3*g[0] );
+		return Vector3d( ( x0.segment<3>( 3*g[1] ) - a ).cross( x0.segment<3>( 3*g[2] ) - a ).normalized() );
+	};
+	Vector3d n = face_normal( t );
+	if( n_zero == 1 ){
+		// Edge (j,j+1) is the one opposite the zero weight
+		const int j = ( bary[0]==0.0 ? 1 : ( bary[1]==0.0 ? 2 : 0 ) );
+		if( surf.adj[t][j] >= 0 ){ n += face_normal( surf.adj[t][j] ); }
+	}
+	return n;
+}
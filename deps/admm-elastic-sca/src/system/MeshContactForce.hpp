@@ -0,0 +1,76 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef MESH_CONTACT_FORCE_HPP
+#define MESH_CONTACT_FORCE_HPP
+
+#include "SelfCollisionForce.hpp"
+
+namespace admm {
+
+//
+//	Contact between deformable objects (e.g. the surfaces of tet meshes)
+//
+//	Each object has its own TriangleBVH over its surface, which is only refit
+//	in steps where the object's box comes within reach of another object. Surface
+//	vertices are tested against the triangles of the other objects, in parallel.
+//	A vertex outside of the other object makes a pair with each triangle within
+//	reach, separated along the closest point direction at x0. A vertex that is
+//	already inside makes one pair with the closest triangle, separated along the
+//	outward (vertex interpolated) normal. Inside is the sign against the angle-weighted
+//	pseudo-normal of the closest feature, and vertices deeper than reach find their
+//	closest triangle with an unbounded BVH search. Pairs are the vertex-triangle constraints
+//	of SelfCollisionForce and are projected the same way. Edge-edge contacts are not
+//	handled, which is fine for volumetric objects.
+//
+class MeshContactForce : public SelfCollisionForce {
+public:
+	// Surfaces are three (system) node indices per triangle, one list per object.
+	// They must be closed, and are reoriented at initialize to face outwards.
+	MeshContactForce( const std::vector< std::vector<int> > &surfaces_, double thickness_=0.005, double use_weight=32.0 ) :
+		SelfCollisionForce( std::vector<int>(), thickness_, use_weight ), surfaces(surfaces_) {}
+
+	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
+	void get_active( const Eigen::VectorXd &x0, const Eigen::VectorXd &x, std::vector<int> &dofs, std::vector<double> &weights );
+	const char *name() const { return "MeshContactForce"; }
+
+	std::vector< std::vector<int> > surfaces;
+
+protected:
+	struct Surface {
+		TriangleBVH bvh;
+		std::vector<Eigen::Vector3i> tris;
+		std::vector<int> verts; // unique nodes
+		std::vector<int> vert_offsets, vert_faces; // faces of each vert
+		std::vector<Eigen::Vector3i> adj; // face across edge (tris[t][j],tris[t][j+1]), or -1
+		Eigen::Vector3d bmin, bmax; // over the step, grown by thickness+margin
+		bool refit;
+	};
+	std::vector<Surface> objects;
+	std::vector<Eigen::Vector3d> normals; // angle-weighted normal of each surface node at x0 (if refit)
+
+	// Pseudo-normal at x0 of the feature of triangle t where bary lies (Baerentzen and
+	// Aanaes 2005): the face normal, the sum of the two face normals of an edge, or the
+	// vertex normal. Its sign against p-c tells if p is inside, c its closest point.
+	Eigen::Vector3d pseudo_normal( const Surface &surf, int t, const Eigen::Vector3d &bary, const Eigen::VectorXd &x0 ) const;
+};
+
+} // end of namespace admm
+
+#endif
@@ -0,0 +1,99 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "SVD3.hpp"
+
+using namespace admm;
+using namespace Eigen;
+
+namespace admm {
+namespace svd3 {
+
+#ifdef ADMME_SVD3_DISPATCH
+// Widest lanes supported by the cpu, checked once
+static int detect_width(){
+	__builtin_cpu_init();
+	if( __builtin_cpu_supports( "avx512f" ) ){ return 8; }
+	if( __builtin_cpu_supports( "avx2" ) ){ return 4; }
+	return 1;
+}
+#endif
+
+int simd_width(){
+#if defined(ADMME_SVD3_DISPATCH)
+	static const int width = detect_width();
+	return width;
+#elif defined(__AVX512F__)
+	return 8;
+#elif defined(__AVX2__)
+	return 4;
+#else
+	return 1;
+#endif
+}
+
+void svd( int n, const double *A, double *U, double *S, double *V ){
+	int i = 0;
+	switch( simd_width() ){
+		case 8: i = avx512::svd( n, A, U, S, V ); break;
+		case 4: i = avx2::svd( n, A, U, S, V ); break;
+	}
+	for( ; i<n; ++i ){
+		Matrix3d Ai = Map<const Matrix3d>( &A[9*i] ), Ui, Vi;
+		Vector3d Si;
+		svd( Ai, Ui, Si, Vi );
+		Map<Matrix3d>( U+9*i ) = Ui;
+		Map<Vector3d>( S+3*i ) = Si;
+		Map<Matrix3d>( V+9*i ) = Vi;
+	}
+}
+
+void polar( int n, const double *A, double *R ){
+	int i = 0;
+	switch( simd_width() ){
+		case 8: i = avx512::polar( n, A, R ); break;
+		case 4: i = avx2::polar( n, A, R ); break;
+	}
+	for( ; i<n; ++i ){
+		Matrix3d Ai = Map<const Matrix3d>( &A[9*i] ), Ri;
+		polar( Ai, Ri );
+		Map<Matrix3d>( R+9*i ) = Ri;
+	}
+}
+
+void svd32( int n, const double *A, double *U, double *S, double *V ){
+	int i = 0;
+	switch( simd_width() ){
+		case 8: i = avx512::svd32( n, A, U, S, V ); break;
+		case 4: i = avx2::svd32( n, A, U, S, V ); break;
+	}
+	for( ; i<n; ++i ){ svd32<double>( &A[6*i], &U[6*i], &S[2*i], &V[4*i] ); }
+}
+
+void polar32( int n, const double *A, double *R ){
+	int i = 0;
+	switch( simd_width() ){
+		case 8: i = avx512::polar32( n, A, R ); break;
+		case 4: i = avx2::polar32( n, A, R ); break;
+	}
+	for( ; i<n; ++i ){ polar32<double>( &A[6*i], &R[6*i] ); }
+}
+
+} // end namespace svd3
+} // end namespace admm
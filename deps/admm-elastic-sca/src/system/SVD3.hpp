@@ -0,0 +1,436 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+
+#ifndef ADMM_SVD3_H
+#define ADMM_SVD3_H 1
+
+#include <Eigen/Dense>
+#include <cmath>
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace admm {
+namespace svd3 {
+
+//
+//	3x3 (and 3x2) SVD with minimal branching, following McAdams et al. 2011, "Computing the
+//	Singular Value Decomposition of 3x3 matrices with minimal branching and elementary
+//	floating point operations". The symmetric eigenproblem of At*A is solved with a fixed
+//	number of Jacobi sweeps, the columns of A*V are sorted, and a Givens QR gives U and S.
+//	We use exact (instead of approximate) Jacobi rotations to get double precision.
+//
+//	The kernel is a template on the lane type, so the same code runs on one matrix (double),
+//	or 4 or 8 matrices at once (Vec4d/Vec8d) in translation units compiled with AVX2/AVX-512.
+//	The batched versions pick the widest lanes the cpu supports at runtime (see SVD3.cpp).
+//	All matrices are column major.
+//
+
+static const int jacobi_sweeps = 4;
+
+//
+//	Lane types
+//
+static inline double sqrt_( double a ){ return std::sqrt(a); }
+static inline double abs_( double a ){ return std::fabs(a); }
+static inline double max_( double a, double b ){ return a > b ? a : b; }
+static inline double select_lt( double a, double b, double x, double y ){ return a < b ? x : y; }
+
+// The vector lane types have internal linkage so that code built with
+// different -m flags isn't merged by the linker.
+namespace {
+
+#ifdef __AVX2__
+struct Vec4d {
+	static const int width = 4;
+	Vec4d(){}
+	Vec4d( __m256d v_ ) : v(v_) {}
+	Vec4d( double a ) : v(_mm256_set1_pd(a)) {}
+	static Vec4d load( const double *p ){ return _mm256_loadu_pd(p); }
+	void store( double *p ) const { _mm256_storeu_pd(p,v); }
+	__m256d v;
+};
+static inline Vec4d operator+( Vec4d a, Vec4d b ){ return _mm256_add_pd(a.v,b.v); }
+static inline Vec4d operator-( Vec4d a, Vec4d b ){ return _mm256_sub_pd(a.v,b.v); }
+static inline Vec4d operator*( Vec4d a, Vec4d b ){ return _mm256_mul_pd(a.v,b.v); }
+static inline Vec4d operator/( Vec4d a, Vec4d b ){ return _mm256_div_pd(a.v,b.v); }
+static inline Vec4d operator-( Vec4d a ){ return _mm256_xor_pd(a.v,_mm256_set1_pd(-0.0)); }
+static inline Vec4d sqrt_( Vec4d a ){ return _mm256_sqrt_pd(a.v); }
+static inline Vec4d abs_( Vec4d a ){ return _mm256_andnot_pd(_mm256_set1_pd(-0.0),a.v); }
+static inline Vec4d max_( Vec4d a, Vec4d b ){ return _mm256_max_pd(a.v,b.v); }
+static inline Vec4d select_lt( Vec4d a, Vec4d b, Vec4d x, Vec4d y ){
+	return _mm256_blendv_pd( y.v, x.v, _mm256_cmp_pd(a.v,b.v,_CMP_LT_OQ) );
+}
+#endif
+
+#ifdef __AVX512F__
+struct Vec8d {
+	static const int width = 8;
+	Vec8d(){}
+	Vec8d( __m512d v_ ) : v(v_) {}
+	Vec8d( double a ) : v(_mm512_set1_pd(a)) {}
+	static Vec8d load( const double *p ){ return _mm512_loadu_pd(p); }
+	void store( double *p ) const { _mm512_storeu_pd(p,v); }
+	__m512d v;
+};
+static inline Vec8d operator+( Vec8d a, Vec8d b ){ return _mm512_add_pd(a.v,b.v); }
+static inline Vec8d operator-( Vec8d a, Vec8d b ){ return _mm512_sub_pd(a.v,b.v); }
+static inline Vec8d operator*( Vec8d a, Vec8d b ){ return _mm512_mul_pd(a.v,b.v); }
+static inline Vec8d operator/( Vec8d a, Vec8d b ){ return _mm512_div_pd(a.v,b.v); }
+static inline Vec8d operator-( Vec8d a ){ return _mm512_sub_pd(_mm512_setzero_pd(),a.v); }
+static inline Vec8d sqrt_( Vec8d a ){ return _mm512_sqrt_pd(a.v); }
+static inline Vec8d abs_( Vec8d a ){ return _mm512_max_pd(a.v,_mm512_sub_pd(_mm512_setzero_pd(),a.v)); }
+static inline Vec8d max_( Vec8d a, Vec8d b ){ return _mm512_max_pd(a.v,b.v); }
+static inline Vec8d select_lt( Vec8d a, Vec8d b, Vec8d x, Vec8d y ){
+	return _mm512_mask_blend_pd( _mm512_cmp_pd_mask(a.v,b.v,_CMP_LT_OQ), y.v, x.v );
+}
+#endif
+
+} // end anonymous namespace
+
+
+//
+//	Kernel
+//
+
+// Jacobi rotation that zeros apq of a symmetric matrix, r is the remaining index
+template<typename T> static inline void jacobi_rotate( T &app, T &aqq, T &apq, T &arp, T &arq, T vp[3], T vq[3] ){
+	const T d = aqq - app;
+	const T denom = abs_(d) + sqrt_( d*d + T(4.0)*apq*apq );
+	const T t = select_lt( d, T(0.0), T(-2.0), T(2.0) ) * apq / max_( denom, T(1e-300) );
+	const T c = T(1.0) / sqrt_( T(1.0) + t*t );
+	const T s = t*c;
+	app = app - t*apq;
+	aqq = aqq + t*apq;
+	apq = T(0.0);
+	const T rp = arp, rq = arq;
+	arp = c*rp - s*rq;
+	arq = s*rp + c*rq;
+	for( int i=0; i<3; ++i ){
+		const T p = vp[i], q = vq[i];
+		vp[i] = c*p - s*q;
+		vq[i] = s*p + c*q;
+	}
+}
+
+// Swaps columns a and b of B and V if rho_a < rho_b, negating one to keep det(V)=1
+template<typename T> static inline void cond_swap( T &rho_a, T &rho_b, T *Ba, T *Bb, T *Va, T *Vb ){
+	const T ra = rho_a, rb = rho_b;
+	for( int i=0; i<3; ++i ){
+		const T ba = Ba[i], bb = Bb[i], va = Va[i], vb = Vb[i];
+		Ba[i] = select_lt( ra, rb, bb, ba );
+		Bb[i] = select_lt( ra, rb, -ba, bb );
+		Va[i] = select_lt( ra, rb, vb, va );
+		Vb[i] = select_lt( ra, rb, -va, vb );
+	}
+	rho_a = max_( ra, rb );
+	rho_b = select_lt( ra, rb, ra, rb );
+}
+
+// Givens rotation that zeros row q of B in column p, applied to rows p and q of B and columns of U
+template<typename T> static inline void qr_givens( int p, int q, T B[9], T U[9] ){
+	const T a = B[p+3*p], b = B[q+3*p];
+	const T rsq = a*a + b*b;
+	const T inv = T(1.0) / sqrt_( max_( rsq, T(1e-300) ) );
+	const T c = select_lt( rsq, T(1e-300), T(1.0), a*inv );
+	const T s = select_lt( rsq, T(1e-300), T(0.0), b*inv );
+	for( int j=0; j<3; ++j ){
+		const T bp = B[p+3*j], bq = B[q+3*j];
+		B[p+3*j] = c*bp + s*bq;
+		B[q+3*j] = c*bq - s*bp;
+		const T up = U[j+3*p], uq = U[j+3*q];
+		U[j+3*p] = c*up + s*uq;
+		U[j+3*q] = c*uq - s*up;
+	}
+}
+
+// A = U diag(S) Vt, with U and V rotations and |S[0]| >= |S[1]| >= |S[2]|.
+// S[2] is negative if det(A) < 0 (same as helper::oriented_svd).
+template<typename T> static inline void svd( const T A[9], T U[9], T S[3], T V[9] ){
+
+	// Scale A so that At*A doesn't under/overflow
+	T m = abs_(A[0]);
+	for( int i=1; i<9; ++i ){ m = max_( m, abs_(A[i]) ); }
+	const T inv_m = T(1.0) / max_( m, T(1e-300) );
+	T B[9];
+	for( int i=0; i<9; ++i ){ B[i] = A[i]*inv_m; }
+
+	// Symmetric eigenproblem of At*A
+	T s00 = B[0]*B[0] + B[1]*B[1] + B[2]*B[2];
+	T s11 = B[3]*B[3] + B[4]*B[4] + B[5]*B[5];
+	T s22 = B[6]*B[6] + B[7]*B[7] + B[8]*B[8];
+	T s01 = B[0]*B[3] + B[1]*B[4] + B[2]*B[5];
+	T s02 = B[0]*B[6] + B[1]*B[7] + B[2]*B[8];
+	T s12 = B[3]*B[6] + B[4]*B[7] + B[5]*B[8];
+	for( int i=0; i<9; ++i ){ V[i] = T( i%4==0 ? 1.0 : 0.0 ); }
+	for( int sweep=0; sweep<jacobi_sweeps; ++sweep ){
+		jacobi_rotate( s00, s11, s01, s02, s12, &V[0], &V[3] );
+		jacobi_rotate( s00, s22, s02, s01, s12, &V[0], &V[6] );
+		jacobi_rotate( s11, s22, s12, s01, s02, &V[3], &V[6] );
+	}
+
+	// B = A*V, with columns sorted by decreasing norm
+	T AV[9];
+	for( int c=0; c<3; ++c ){
+		for( int r=0; r<3; ++r ){
+			AV[r+3*c] = B[r]*V[3*c] + B[r+3]*V[3*c+1] + B[r+6]*V[3*c+2];
+		}
+	}
+	T rho[3];
+	for( int c=0; c<3; ++c ){ rho[c] = AV[3*c]*AV[3*c] + AV[3*c+1]*AV[3*c+1] + AV[3*c+2]*AV[3*c+2]; }
+	cond_swap( rho[0], rho[1], &AV[0], &AV[3], &V[0], &V[3] );
+	cond_swap( rho[0], rho[2], &AV[0], &AV[6], &V[0], &V[6] );
+	cond_swap( rho[1], rho[2], &AV[3], &AV[6], &V[3], &V[6] );
+
+	// QR of A*V gives U and S
+	for( int i=0; i<9; ++i ){ U[i] = T( i%4==0 ? 1.0 : 0.0 ); }
+	qr_givens( 0, 1, AV, U );
+	qr_givens( 0, 2, AV, U );
+	qr_givens( 1, 2, AV, U );
+	for( int i=0; i<3; ++i ){ S[i] = AV[4*i]*m; }
+}
+
+// Rotation closest to A (polar decomposition), R = U Vt
+template<typename T> static inline void polar( const T A[9], T R[9] ){
+	T U[9], S[3], V[9];
+	svd( A, U, S, V );
+	for( int c=0; c<3; ++c ){
+		for( int r=0; r<3; ++r ){
+			R[r+3*c] = U[r]*V[c] + U[r+3]*V[c+3] + U[r+6]*V[c+6];
+		}
+	}
+}
+
+
+
+//
+//	3x2 kernel (triangles), in closed form from the 2x2 At*A. V comes from the
+//	eigenvectors of At*A, and U = A*V*inv(S) is re-orthogonalized so that the
+//	second column stays accurate when S[1] is small.
+//
+
+// Returns a unit vector orthogonal to u
+template<typename T> static inline void orthogonal( const T u[3], T o[3] ){
+	// Cross with x or y, whichever gives the longer vector
+	const T cx[3] = { T(0.0), u[2], -u[1] };
+	const T cy[3] = { -u[2], T(0.0), u[0] };
+	const T nx = cx[1]*cx[1] + cx[2]*cx[2];
+	const T ny = cy[0]*cy[0] + cy[2]*cy[2];
+	const T inv = T(1.0) / sqrt_( max_( max_( nx, ny ), T(1e-300) ) );
+	for( int i=0; i<3; ++i ){ o[i] = select_lt( nx, ny, cy[i], cx[i] ) * inv; }
+}
+
+// A = U diag(S) Vt, with U 3x2 (orthonormal columns), V 2x2, and S[0] >= S[1] >= 0
+template<typename T> static inline void svd32( const T A[6], T U[6], T S[2], T V[4] ){
+
+	// Scale A so that At*A doesn't under/overflow
+	T m = abs_(A[0]);
+	for( int i=1; i<6; ++i ){ m = max_( m, abs_(A[i]) ); }
+	const T inv_m = T(1.0) / max_( m, T(1e-300) );
+	T B[6];
+	for( int i=0; i<6; ++i ){ B[i] = A[i]*inv_m; }
+
+	// At*A = [ a b; b c ] and its largest eigenvalue
+	const T a = B[0]*B[0] + B[1]*B[1] + B[2]*B[2];
+	const T c = B[3]*B[3] + B[4]*B[4] + B[5]*B[5];
+	const T b = B[0]*B[3] + B[1]*B[4] + B[2]*B[5];
+	const T hd = ( a - c ) * T(0.5);
+	const T l1 = ( a + c ) * T(0.5) + sqrt_( hd*hd + b*b );
+
+	// Its eigenvector is in the null space of At*A - l1*I, from the longer of the two rows
+	const T x0 = l1 - c, y0 = b; // from row 2
+	const T x1 = b, y1 = l1 - a; // from row 1
+	const T n0 = x0*x0 + y0*y0, n1 = x1*x1 + y1*y1;
+	T vx = select_lt( n0, n1, x1, x0 );
+	T vy = select_lt( n0, n1, y1, y0 );
+	const T nv = max_( n0, n1 );
+	const T inv_nv = T(1.0) / sqrt_( max_( nv, T(1e-300) ) );
+	vx = select_lt( nv, T(1e-300), T(1.0), vx*inv_nv );
+	vy = select_lt( nv, T(1e-300), T(0.0), vy*inv_nv );
+	V[0] = vx; V[1] = vy; V[2] = -vy; V[3] = vx;
+
+	// U = A*V*inv(S)
+	T u0[3], u1[3], o[3];
+	for( int i=0; i<3; ++i ){
+		u0[i] = B[i]*vx + B[i+3]*vy;
+		u1[i] = B[i+3]*vx - B[i]*vy;
+	}
+	const T s0 = sqrt_( u0[0]*u0[0] + u0[1]*u0[1] + u0[2]*u0[2] );
+	const T inv_s0 = T(1.0) / max_( s0, T(1e-300) );
+	for( int i=0; i<3; ++i ){ u0[i] = select_lt( s0, T(1e-300), T( i==0 ? 1.0 : 0.0 ), u0[i]*inv_s0 ); }
+	const T d = u0[0]*u1[0] + u0[1]*u1[1] + u0[2]*u1[2];
+	for( int i=0; i<3; ++i ){ u1[i] = u1[i] - d*u0[i]; }
+	const T s1 = sqrt_( u1[0]*u1[0] + u1[1]*u1[1] + u1[2]*u1[2] );
+	const T inv_s1 = T(1.0) / max_( s1, T(1e-300) );
+	orthogonal( u0, o );
+	const T tol = T(1e-12)*s0; // second column is numerically zero if s1 <= tol
+	for( int i=0; i<3; ++i ){
+		U[i] = u0[i];
+		U[i+3] = select_lt( tol, s1, u1[i]*inv_s1, o[i] );
+	}
+	S[0] = s0*m;
+	S[1] = s1*m;
+}
+
+// Closest matrix to A with orthonormal columns (polar decomposition), R = U Vt
+template<typename T> static inline void polar32( const T A[6], T R[6] ){
+	T U[6], S[2], V[4];
+	svd32( A, U, S, V );
+	for( int c=0; c<2; ++c ){
+		for( int r=0; r<3; ++r ){
+			R[r+3*c] = U[r]*V[c] + U[r+3]*V[c+2];
+		}
+	}
+}
+
+
+//
+//	Lane loops for the batched versions, over the first n - n%width matrices
+//
+
+// Loads W packed matrices with N entries each into lanes (one per entry)
+template<typename L, int N> static inline void pack( const double *A, L *a ){
+	const int W = L::width;
+	double buf[W];
+	for( int i=0; i<N; ++i ){
+		for( int k=0; k<W; ++k ){ buf[k] = A[N*k+i]; }
+		a[i] = L::load( buf );
+	}
+}
+
+// Stores lanes back to W packed matrices with N entries each
+template<typename L, int N> static inline void unpack( const L *a, double *A ){
+	const int W = L::width;
+	double buf[W];
+	for( int i=0; i<N; ++i ){
+		a[i].store( buf );
+		for( int k=0; k<W; ++k ){ A[N*k+i] = buf[k]; }
+	}
+}
+
+template<typename L> static inline int svd_lanes( int n, const double *A, double *U, double *S, double *V ){
+	int i = 0;
+	for( ; i+L::width <= n; i+=L::width ){
+		L a[9], u[9], s[3], v[9];
+		pack<L,9>( &A[9*i], a );
+		svd( a, u, s, v );
+		unpack<L,9>( u, &U[9*i] );
+		unpack<L,3>( s, &S[3*i] );
+		unpack<L,9>( v, &V[9*i] );
+	}
+	return i;
+}
+
+template<typename L> static inline int polar_lanes( int n, const double *A, double *R ){
+	int i = 0;
+	for( ; i+L::width <= n; i+=L::width ){
+		L a[9], r[9];
+		pack<L,9>( &A[9*i], a );
+		polar( a, r );
+		unpack<L,9>( r, &R[9*i] );
+	}
+	return i;
+}
+
+template<typename L> static inline int svd32_lanes( int n, const double *A, double *U, double *S, double *V ){
+	int i = 0;
+	for( ; i+L::width <= n; i+=L::width ){
+		L a[6], u[6], s[2], v[4];
+		pack<L,6>( &A[6*i], a );
+		svd32( a, u, s, v );
+		unpack<L,6>( u, &U[6*i] );
+		unpack<L,2>( s, &S[2*i] );
+		unpack<L,4>( v, &V[4*i] );
+	}
+	return i;
+}
+
+template<typename L> static inline int polar32_lanes( int n, const double *A, double *R ){
+	int i = 0;
+	for( ; i+L::width <= n; i+=L::width ){
+		L a[6], r[6];
+		pack<L,6>( &A[6*i], a );
+		polar32( a, r );
+		unpack<L,6>( r, &R[6*i] );
+	}
+	return i;
+}
+
+
+// Single 3x3 matrices use JacobiSVD, which beats the scalar kernel on the near
+// rotations of a simulation (see samples/svdbench). Same conventions as svd<T>.
+static inline void svd( const Eigen::Matrix3d &A, Eigen::Matrix3d &U, Eigen::Vector3d &S, Eigen::Matrix3d &V ){
+	Eigen::JacobiSVD< Eigen::Matrix3d > jsvd( A, Eigen::ComputeFullU | Eigen::ComputeFullV );
+	S = jsvd.singularValues();
+	U = jsvd.matrixU();
+	V = jsvd.matrixV();
+	if( U.determinant() < 0.0 ){ U.col(2) *= -1.0; S[2] *= -1.0; }
+	if( V.determinant() < 0.0 ){ V.col(2) *= -1.0; S[2] *= -1.0; }
+}
+
+static inline void polar( const Eigen::Matrix3d &A, Eigen::Matrix3d &R ){
+	Eigen::Matrix3d U, V;
+	Eigen::Vector3d S;
+	svd( A, U, S, V );
+	R = U * V.transpose();
+}
+
+// 3x2 matrices use the closed form kernel
+
+static inline void svd( const Eigen::Matrix<double,3,2> &A, Eigen::Matrix<double,3,2> &U, Eigen::Vector2d &S, Eigen::Matrix2d &V ){
+	svd32<double>( A.data(), U.data(), S.data(), V.data() );
+}
+
+static inline void polar( const Eigen::Matrix<double,3,2> &A, Eigen::Matrix<double,3,2> &R ){
+	polar32<double>( A.data(), R.data() );
+}
+
+
+//
+//	Batched versions over n packed matrices (9 or 6 doubles each). These use the
+//	widest lanes the cpu supports, and the single matrix versions for the remainder.
+//
+void svd( int n, const double *A, double *U, double *S, double *V );
+void polar( int n, const double *A, double *R );
+void svd32( int n, const double *A, double *U, double *S, double *V );
+void polar32( int n, const double *A, double *R );
+
+// Number of matrices per kernel call in the batched versions (1, 4, or 8)
+int simd_width();
+
+// Lane kernels over the first n - n%width matrices, returning how many were done.
+// Defined in SVD3Avx2.cpp and SVD3Avx512.cpp, which are compiled with the matching flags.
+namespace avx2 {
+int svd( int n, const double *A, double *U, double *S, double *V );
+int polar( int n, const double *A, double *R );
+int svd32( int n, const double *A, double *U, double *S, double *V );
+int polar32( int n, const double *A, double *R );
+}
+namespace avx512 {
+int svd( int n, const double *A, double *U, double *S, double *V );
+int polar( int n, const double *A, double *R );
+int svd32( int n, const double *A, double *U, double *S, double *V );
+int polar32( int n, const double *A, double *R );
+}
+
+} // end namespace svd3
+} // end namespace admm
+
+#endif
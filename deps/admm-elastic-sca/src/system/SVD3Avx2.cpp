@@ -0,0 +1,42 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Lane kernels for cpus with AVX2, built with -mavx2 and picked at runtime by
+// the batched versions in SVD3.cpp. Without the flag these do nothing.
+#include "SVD3.hpp"
+
+namespace admm {
+namespace svd3 {
+namespace avx2 {
+
+#ifdef __AVX2__
+int svd( int n, const double *A, double *U, double *S, double *V ){ return svd_lanes<Vec4d>( n, A, U, S, V ); }
+int polar( int n, const double *A, double *R ){ return polar_lanes<Vec4d>( n, A, R ); }
+int svd32( int n, const double *A, double *U, double *S, double *V ){ return svd32_lanes<Vec4d>( n, A, U, S, V ); }
+int polar32( int n, const double *A, double *R ){ return polar32_lanes<Vec4d>( n, A, R ); }
+#else
+int svd( int n, const double *A, double *U, double *S, double *V ){ return 0; }
+int polar( int n, const double *A, double *R ){ return 0; }
+int svd32( int n, const double *A, double *U, double *S, double *V ){ return 0; }
+int polar32( int n, const double *A, double *R ){ return 0; }
+#endif
+
+} // end namespace avx2
+} // end namespace svd3
+} // end namespace admm
@@ -0,0 +1,262 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "SelfCollisionForce.hpp"
+#include "ClosestPoint.hpp"
+#include <unordered_map>
+#include <algorithm>
+
+using namespace admm;
+using namespace Eigen;
+
+//// PUBLIC METHODS ////
+
+void SelfCollisionForce::initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep ){
+
+	n_nodes = x.size()/3;
+	node_slot.assign( n_nodes, -1 );
+
+	// Triangles, their unique edges, and the unique nodes
+	const int n_tris = faces.size()/3;
+	tris.resize( n_tris );
+	tri_edges.resize( n_tris );
+	edges.clear();
+	verts.clear();
+	std::unordered_map< long long, int > edge_ids;
+	std::vector<char> is_vert( n_nodes, 0 );
+	for( int t=0; t<n_tris; ++t ){
+		tris[t] = Vector3i( faces[3*t], faces[3*t+1], faces[3*t+2] );
+		for( int j=0; j<3; ++j ){
+			const int a = std::min( tris[t][j], tris[t][(j+1)%3] ), b = std::max( tris[t][j], tris[t][(j+1)%3] );
+			const long long key = (long long)a * n_nodes + b;
+			std::unordered_map< long long, int >::iterator it = edge_ids.find( key );
+			if( it == edge_ids.end() ){
+				it = edge_ids.insert( std::make_pair( key, (int)edges.size() ) ).first;
+				edges.push_back( Vector2i( a, b ) );
+			}
+			tri_edges[t][j] = it->second;
+			if( !is_vert[ tris[t][j] ] ){ is_vert[ tris[t][j] ] = 1; verts.push_back( tris[t][j] ); }
+		}
+	}
+
+	bvh.build( tris, x );
+}
+
+
+void SelfCollisionForce::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
+	// Rows are added by get_active, and global_idx is set by the System
+}
+
+
+void SelfCollisionForce::get_active( const Eigen::VectorXd &x0, const Eigen::VectorXd &x, std::vector<int> &dofs, std::vector<double> &weights ){
+
+	// Triangle boxes cover the motion over the step and the distance
+	// at which pairs are kept, so the queries use unpadded boxes.
+	const double reach = thickness + margin;
+	bvh.refit( x0, x, reach );
+
+	// Keeps a pair (with nodes in slot) if it's within reach at
+	// x0 or would be closer than thickness+margin at x.
+	auto keep = [&]( const Pair &p, double d0 ){
+		if( d0 < reach ){ return true; }
+		Vector3d y = Vector3d::Zero();
+		for( int k=0; k<4; ++k ){ y += p.w[k] * x.segment<3>( 3*p.slot[k] ); }
+		return p.n.dot( y ) < reach;
+	};
+
+	pairs.clear();
+	const int n_verts = verts.size(), n_edges = edges.size();
+#pragma omp parallel
+	{
+		std::vector<Pair> local;
+		std::vector<int> seen( n_edges, -1 ); // last edge that tested each edge
+
+		// Vertex-triangle pairs
+#pragma omp for schedule(dynamic,64) nowait
+		for( int i=0; i<n_verts; ++i ){
+			const int v = verts[i];
+			const Vector3d p0 = x0.segment<3>( 3*v );
+			const Vector3d bmin = p0.cwiseMin( x.segment<3>( 3*v ) ), bmax = p0.cwiseMax( x.segment<3>( 3*v ) );
+			bvh.query( bmin, bmax, [&]( int t ){
+				const Vector3i &f = tris[t];
+				if( f[0]==v || f[1]==v || f[2]==v ){ return; }
+				Vector3d bary;
+				Vector3d c0 = closest_point::triangle( p0, x0.segment<3>( 3*f[0] ), x0.segment<3>( 3*f[1] ), x0.segment<3>( 3*f[2] ), bary );
+				Vector3d n = p0 - c0;
+				const double d0 = n.norm();
+				if( d0 <= 1e-12 ){ return; } // no separating direction
+				Pair p;
+				p.slot[0] = v; p.slot[1] = f[0]; p.slot[2] = f[1]; p.slot[3] = f[2];
+				p.w[0] = 1.0; p.w[1] = -bary[0]; p.w[2] = -bary[1]; p.w[3] = -bary[2];
+				p.n = n / d0;
+				if( keep( p, d0 ) ){ local.push_back( p ); }
+			});
+		}
+
+		// Edge-edge pairs, each found from the lower edge index. Pairs that are
+		// closest at an end point are vertex-triangle pairs and are skipped.
+#pragma omp for schedule(dynamic,64) nowait
+		for( int e=0; e<n_edges; ++e ){
+			const Vector2i &ea = edges[e];
+			const Vector3d a0 = x0.segment<3>( 3*ea[0] ), a1 = x0.segment<3>( 3*ea[1] );
+			const Vector3d bmin = a0.cwiseMin( a1 ).cwiseMin( x.segment<3>( 3*ea[0] ) ).cwiseMin( x.segment<3>( 3*ea[1] ) );
+			const Vector3d bmax = a0.cwiseMax( a1 ).cwiseMax( x.segment<3>( 3*ea[0] ) ).cwiseMax( x.segment<3>( 3*ea[1] ) );
+			bvh.query( bmin, bmax, [&]( int t ){
+				for( int j=0; j<3; ++j ){
+					const int e2 = tri_edges[t][j];
+					if( e2 <= e || seen[e2] == e ){ continue; }
+					seen[e2] = e;
+					const Vector2i &eb = edges[e2];
+					if( eb[0]==ea[0] || eb[0]==ea[1] || eb[1]==ea[0] || eb[1]==ea[1] ){ continue; }
+
+					// The triangle's box is much larger than the edge's
+					const Vector3d b0 = x0.segment<3>( 3*eb[0] ), b1 = x0.segment<3>( 3*eb[1] );
+					const Vector3d cmin = b0.cwiseMin( b1 ).cwiseMin( x.segment<3>( 3*eb[0] ) ).cwiseMin( x.segment<3>( 3*eb[1] ) );
+					const Vector3d cmax = b0.cwiseMax( b1 ).cwiseMax( x.segment<3>( 3*eb[0] ) ).cwiseMax( x.segment<3>( 3*eb[1] ) );
+					if( ( ( cmin - bmax ).array() > reach ).any() || ( ( bmin - cmax ).array() > reach ).any() ){ continue; }
+
+					double s = 0.0, r = 0.0;
+					const double d0 = std::sqrt( closest_point::segments( a0, a1, b0, b1, s, r ) );
+					if( s <= 0.0 || s >= 1.0 || r <= 0.0 || r >= 1.0 || d0 <= 1e-12 ){ continue; }
+					Pair p;
+					p.slot[0] = ea[0]; p.slot[1] = ea[1]; p.slot[2] = eb[0]; p.slot[3] = eb[1];
+					p.w[0] = 1.0-s; p.w[1] = s; p.w[2] = r-1.0; p.w[3] = -r;
+					p.n = ( ( a0 + s*( a1-a0 ) ) - ( b0 + r*( b1-b0 ) ) ) / d0;
+					if( keep( p, d0 ) ){ local.push_back( p ); }
+				}
+			});
+		}
+
+#pragma omp critical
+		{ pairs.insert( pairs.end(), local.begin(), local.end() ); }
+	}
+
+	set_active( dofs, weights );
+}
+
+
+void SelfCollisionForce::set_active( std::vector<int> &dofs, std::vector<double> &weights ){
+
+	// Threads finish in any order, so sort to keep the rows deterministic
+	std::sort( pairs.begin(), pairs.end(), []( const Pair &a, const Pair &b ){
+		for( int k=0; k<4; ++k ){ if( a.slot[k] != b.slot[k] ){ return a.slot[k] < b.slot[k]; } }
+		for( int k=0; k<4; ++k ){ if( a.w[k] != b.w[k] ){ return a.w[k] < b.w[k]; } }
+		return false;
+	});
+
+	// Rows for each node in a pair, and the pairs of each node
+	active_nodes.clear();
+	const int n_pairs = pairs.size();
+	for( int p=0; p<n_pairs; ++p ){
+		for( int k=0; k<4; ++k ){
+			int &slot = node_slot[ pairs[p].slot[k] ];
+			if( slot < 0 ){ slot = active_nodes.size(); active_nodes.push_back( pairs[p].slot[k] ); }
+			pairs[p].slot[k] = slot;
+		}
+	}
+	const int n_active = active_nodes.size();
+	for( int a=0; a<n_active; ++a ){ node_slot[ active_nodes[a] ] = -1; }
+
+	slot_offsets.assign( n_active+1, 0 );
+	for( int p=0; p<n_pairs; ++p ){
+		for( int k=0; k<4; ++k ){ slot_offsets[ pairs[p].slot[k]+1 ]++; }
+	}
+	for( int a=0; a<n_active; ++a ){ slot_offsets[a+1] += slot_offsets[a]; }
+	slot_entries.resize( 4*n_pairs );
+	std::vector<int> fill( slot_offsets.begin(), slot_offsets.end()-1 );
+	for( int p=0; p<n_pairs; ++p ){
+		for( int k=0; k<4; ++k ){ slot_entries[ fill[ pairs[p].slot[k] ]++ ] = 4*p+k; }
+	}
+	lambda.resize( n_pairs );
+
+	for( int a=0; a<n_active; ++a ){
+		for( int j=0; j<3; ++j ){
+			dofs.push_back( 3*active_nodes[a]+j );
+			weights.push_back( weight );
+		}
+	}
+}
+
+
+void SelfCollisionForce::apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const {
+	const int n_active = active_nodes.size();
+#pragma omp parallel for
+	for( int a=0; a<n_active; ++a ){ Dx.segment<3>( global_idx+3*a ) = x.segment<3>( 3*active_nodes[a] ); }
+}
+
+
+// Called outside of the parallel loop over forces (see threaded),
+// and each node has its own rows, so no atomics are needed.
+void SelfCollisionForce::apply_DiT( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const {
+	const int n_active = active_nodes.size();
+#pragma omp parallel for
+	for( int a=0; a<n_active; ++a ){ Dtv.segment<3>( 3*active_nodes[a] ) += v.segment<3>( global_idx+3*a ); }
+}
+
+
+void SelfCollisionForce::project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const {
+
+	const int n_active = active_nodes.size();
+	const int n_pairs = pairs.size();
+#pragma omp parallel for
+	for( int a=0; a<n_active; ++a ){
+		const int r = global_idx+3*a;
+		z.segment<3>( r ) = Dx.segment<3>( r ) + u.segment<3>( r );
+	}
+
+	for( int iter=0; iter<proj_iters; ++iter ){
+
+		// Projection of each pair onto its plane on its own
+		bool violated = false;
+#pragma omp parallel for reduction(||:violated)
+		for( int p=0; p<n_pairs; ++p ){
+			const Pair &pair = pairs[p];
+			Vector3d y = Vector3d::Zero();
+			double w2 = 0.0;
+			for( int k=0; k<4; ++k ){
+				y += pair.w[k] * z.segment<3>( global_idx+3*pair.slot[k] );
+				w2 += pair.w[k] * pair.w[k];
+			}
+			const double gap = pair.n.dot( y ) - thickness;
+			lambda[p] = gap < 0.0 ? -gap / w2 : 0.0;
+			if( gap < 0.0 ){ violated = true; }
+		}
+		if( !violated ){ break; }
+
+		// Average the corrections to each node
+#pragma omp parallel for
+		for( int a=0; a<n_active; ++a ){
+			Vector3d dz = Vector3d::Zero();
+			int n_dz = 0;
+			for( int i=slot_offsets[a]; i<slot_offsets[a+1]; ++i ){
+				const int p = slot_entries[i] / 4, k = slot_entries[i] % 4;
+				if( lambda[p] <= 0.0 ){ continue; }
+				dz += ( lambda[p] * pairs[p].w[k] ) * pairs[p].n;
+				n_dz++;
+			}
+			if( n_dz > 0 ){ z.segment<3>( global_idx+3*a ) += dz / double(n_dz); }
+		}
+	}
+
+#pragma omp parallel for
+	for( int a=0; a<n_active; ++a ){
+		const int r = global_idx+3*a;
+		u.segment<3>( r ) += Dx.segment<3>( r ) - z.segment<3>( r );
+	}
+}
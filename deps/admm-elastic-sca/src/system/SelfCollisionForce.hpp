@@ -0,0 +1,88 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef SELF_COLLISION_FORCE_HPP
+#define SELF_COLLISION_FORCE_HPP
+
+#include "Force.hpp"
+#include "TriangleBVH.hpp"
+
+namespace admm {
+
+//
+//	Self collision for triangle meshes (e.g. cloth)
+//
+//	At the start of each step the BVH over the mesh is refit to the motion
+//	from x0 to the predicted positions, and vertex-triangle and edge-edge pairs
+//	that are (or may become) closer than thickness are collected in parallel.
+//	Each pair is linearized at x0 into a separating plane, n.( sum_k w_k x_k ) >= thickness,
+//	with w_k the barycentric weights of the closest points. The force adds an identity
+//	row for every node in a pair (see Force::active_set), and the local step projects
+//	them onto all of the planes with a few Jacobi iterations (averaging the
+//	corrections to each node).
+//
+class SelfCollisionForce : public Force {
+public:
+	// Faces are three (system) node indices per triangle
+	SelfCollisionForce( const std::vector<int> &faces_, double thickness_=0.005, double use_weight=32.0 ) :
+		faces(faces_), thickness(thickness_), margin(thickness_), proj_iters(10), n_nodes(0) { weight = use_weight; }
+
+	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
+	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
+	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
+	bool matrix_free() const { return true; }
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	bool active_set() const { return true; }
+	void get_active( const Eigen::VectorXd &x0, const Eigen::VectorXd &x, std::vector<int> &dofs, std::vector<double> &weights );
+	bool threaded() const { return true; }
+	const char *name() const { return "SelfCollisionForce"; }
+
+	std::vector<int> faces;
+	double thickness; // minimum distance between the surfaces
+	double margin; // pairs within thickness+margin at x0 are kept even if they separate
+	int proj_iters; // Jacobi iterations in project
+
+	// A vertex-triangle or edge-edge pair, in terms of the active nodes
+	struct Pair {
+		int slot[4]; // index into active_nodes
+		double w[4]; // barycentric weights (negative for the second primitive)
+		Eigen::Vector3d n; // separating direction at x0
+	};
+	std::vector<Pair> pairs;
+	std::vector<int> active_nodes; // node of each 3 rows
+
+protected:
+	// Sorts the pairs, maps their nodes to active slots, and adds the rows
+	void set_active( std::vector<int> &dofs, std::vector<double> &weights );
+
+	int n_nodes;
+	TriangleBVH bvh;
+	std::vector<Eigen::Vector3i> tris; // faces by triangle
+	std::vector<Eigen::Vector2i> edges; // unique edges
+	std::vector<Eigen::Vector3i> tri_edges; // edges of each triangle
+	std::vector<int> verts; // unique nodes of the mesh
+	std::vector<int> node_slot; // active slot of each system node, or -1 (only set in get_active)
+	std::vector<int> slot_offsets, slot_entries; // pairs of each slot, as 4*pair+k
+	mutable std::vector<double> lambda; // project: correction of each pair
+};
+
+} // end of namespace admm
+
+#endif
@@ -0,0 +1,61 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "StepStats.hpp"
+#include <algorithm>
+
+using namespace admm;
+
+
+void StepStats::set_capacity( int n ){
+	steps.resize( std::max( n, 1 ) );
+	clear();
+}
+
+
+StepStats::Step &StepStats::push(){
+	Step &s = steps[ head ];
+	head = ( head + 1 ) % capacity();
+	count = std::min( count + 1, capacity() );
+
+	s.t = 0.0;
+	s.iters = 0; s.active_rows = 0; s.factorizations = 0; s.lowrank_updates = 0;
+	s.primal_residual = 0.0; s.dual_residual = 0.0;
+	s.total_s = 0.0; s.explicit_s = 0.0; s.active_set_s = 0.0;
+	s.Dx_s = 0.0; s.local_s = 0.0; s.rhs_s = 0.0; s.solve_s = 0.0;
+	s.local_type_s.assign( force_types.size(), 0.0 ); // keeps its capacity
+	return s;
+}
+
+
+void StepStats::dump( std::ostream &out ) const {
+	out << "t,iters,active_rows,factorizations,lowrank_updates,primal_residual,dual_residual," <<
+		"total_s,explicit_s,active_set_s,Dx_s,local_s,rhs_s,solve_s";
+	for( int j=0; j<force_types.size(); ++j ){ out << ",local_" << force_types[j] << "_s"; }
+	out << "\n";
+	for( int i=0; i<count; ++i ){
+		const Step &s = (*this)[i];
+		out << s.t << ',' << s.iters << ',' << s.active_rows << ',' << s.factorizations << ',' <<
+			s.lowrank_updates << ',' << s.primal_residual << ',' << s.dual_residual << ',' <<
+			s.total_s << ',' << s.explicit_s << ',' << s.active_set_s << ',' << s.Dx_s << ',' <<
+			s.local_s << ',' << s.rhs_s << ',' << s.solve_s;
+		for( int j=0; j<s.local_type_s.size(); ++j ){ out << ',' << s.local_type_s[j]; }
+		out << "\n";
+	}
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef ADMM_STEPSTATS_H
+#define ADMM_STEPSTATS_H 1
+
+#include <vector>
+#include <string>
+#include <iostream>
+
+namespace admm {
+
+//
+//	Per-step solver stats (timings, iteration counts and residuals) of the last
+//	capacity() steps, kept in a ring buffer by System::step. They are only taken
+//	with System::Settings::stats set, otherwise the step reads no clocks.
+//
+class StepStats {
+public:
+	struct Step {
+		double t; // simulation time at the start of the step
+		int iters; // admm iterations
+		int active_rows; // rows of the active-set forces
+		int factorizations; // global matrix (re)factorizations
+		int lowrank_updates; // low-rank corrections of the factorization
+		double primal_residual; // rms of W(Dx-z) at the last iteration
+		double dual_residual; // rms of Dt W^2 (z-z_last) over the dofs, at the last iteration
+
+		// Wall times in seconds. The last four are summed over the admm iterations.
+		double total_s;
+		double explicit_s; // explicit forces and begin_step
+		double active_set_s; // collecting the active-set rows and updating the solver
+		double Dx_s; // D*x
+		double local_s; // force projections
+		double rhs_s; // right hand side of the global step
+		double solve_s; // back-substitution and low-rank correction
+		std::vector<double> local_type_s; // local_s by force type (see force_types)
+	};
+
+	// Wall times in seconds of System::initialize, which are always taken
+	struct Init {
+		double forces_s; // force and batch initialize
+		double selector_s; // D and W
+		double solver_s; // global matrix, symbolic and numeric factorization
+		double total_s;
+		Init() : forces_s(0), selector_s(0), solver_s(0), total_s(0) {}
+	} init;
+
+	StepStats() : head(0), count(0) { set_capacity( 256 ); }
+
+	// Number of steps kept. Changing it clears the stats.
+	void set_capacity( int n );
+	int capacity() const { return steps.size(); }
+
+	// Number of recorded steps, at most capacity()
+	int size() const { return count; }
+
+	// Recorded steps, with 0 the oldest and size()-1 the latest.
+	const Step &operator[]( int i ) const { return steps[ ( head + capacity() - count + i ) % capacity() ]; }
+	const Step &last() const { return (*this)[ count-1 ]; }
+
+	void clear(){ head = 0; count = 0; }
+
+	// Writes the recorded steps as csv, one row per step after a header.
+	void dump( std::ostream &out ) const;
+
+	// Force types in local_type_s, set by System::initialize
+	std::vector<std::string> force_types;
+
+	// Returns the record for a new step, reset to zeros.
+	// Overwrites the oldest one when full.
+	Step &push();
+
+private:
+	std::vector<Step> steps;
+	int head; // where the next step goes
+	int count;
+
+}; // end class StepStats
+
+} // end namespace admm
+
+#endif
@@ -18,59 +18,176 @@
 // OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "System.hpp"
+#include <algorithm>
+#include <chrono>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Timeline spans, recorded into mclscene's tracer when built with ADMME_TRACE
+#ifdef ADMME_TRACE
+#include "MCL/Trace.hpp"
+#define ADMM_TRACE_SPAN( name ) MCL_TRACE_SPAN( "admm", name )
+#else
+#define ADMM_TRACE_SPAN( name )
+#endif
 
 using namespace admm;
 using namespace Eigen;
 
 
+//
+//	Adds the time since the last lap to a stat. Reads the clock only
+//	if on (recording stats), otherwise the laps do nothing.
+//
+typedef std::chrono::steady_clock StepClock;
+struct StepTimer {
+	bool on;
+	StepClock::time_point t;
+	StepTimer( bool on_ ) : on(on_) { if( on ){ t = StepClock::now(); } }
+	inline void lap( double &s ){
+		if( !on ){ return; }
+		StepClock::time_point now = StepClock::now();
+		s += std::chrono::duration<double>( now - t ).count();
+		t = now;
+	}
+	inline void reset(){ if( on ){ t = StepClock::now(); } }
+};
+
+
 bool System::step(){
 
+	ADMM_TRACE_SPAN( "System::step" );
+	StepStats::Step unused;
+	StepStats::Step &rec = settings.stats ? stats.push() : unused;
+	StepTimer timer( settings.stats ), step_timer( settings.stats );
+	const int factorizations0 = n_factorizations, lowrank_updates0 = n_lowrank_updates;
+	if( settings.stats ){ rec.t = elapsed_s; }
+
 	// Loop the step callbacks
 	for( int cb_i=0; cb_i<pre_step_callbacks.size(); ++cb_i ){ pre_step_callbacks[cb_i](this); }
 
-	const int n_forces = forces.size();
 	const double dt = settings.timestep_s;
 
 	// Take an explicit step to get predicted node positions
 	// with simple forces (e.g. wind/gravity).
 	// These are parallelized internally.
-	for( int i=0; i<explicit_forces.size(); ++i ){
-		explicit_forces[i]->project( dt, m_x, m_v, m_masses );
+	{
+		ADMM_TRACE_SPAN( "explicit forces" );
+		for( int i=0; i<explicit_forces.size(); ++i ){
+			explicit_forces[i]->project( dt, m_x, m_v, m_masses );
+		}
 	}
 
-	// Initialize ADMM vars
-	// curr_u.setZero(); // Let curr_u be its values at last timestep (better convergence)
-	curr_z.noalias() = m_D*m_x;
-
 	// Position without constraints
 	VectorXd x_bar = m_x + dt * m_v;
+
+	// Poses of moving obstacles etc... for this step
+	for( int i=0; i<timed_forces.size(); ++i ){ forces[ timed_forces[i] ]->begin_step( elapsed_s, dt ); }
+	timer.lap( rec.explicit_s );
+
+	// Rows of the active-set forces (e.g. contacts) at the predicted positions
+	if( active_forces.size() > 0 ){ update_active_set( m_x, x_bar ); }
+	timer.lap( rec.active_set_s );
+
+	// Initialize ADMM vars
+	// curr_u.setZero(); // Let curr_u be its values at last timestep (better convergence)
+	if( use_matrix_free ){ apply_D( m_x, curr_z ); }
+	else{
+		curr_z.head( n_static_rows ) = m_D*m_x;
+		apply_active_D( m_x, curr_z );
+	}
+	timer.lap( rec.Dx_s );
 	VectorXd M_xbar = m_masses.asDiagonal() * x_bar;
 	VectorXd curr_x = x_bar; // Temperorary x used in optimization
 
+	// With converge set, admm_iters is ignored and we stop on the residuals
+	const int max_iters = settings.converge ? settings.max_admm_iters : settings.admm_iters;
+	const double rms_scale = 1.0 / std::sqrt( double( std::max( (int)curr_z.size(), 1 ) ) );
+	const double rms_scale_dof = 1.0 / std::sqrt( double( std::max( (int)m_x.size(), 1 ) ) );
+
 	// Run a timestep
-	for( int s_i=0; s_i < settings.admm_iters; ++s_i ){
+	int s_i = 0;
+	for( ; s_i < max_iters; ++s_i ){
+
+		ADMM_TRACE_SPAN( "admm iteration" );
+		// Residuals are needed each iteration to converge, otherwise only for the stats
+		const bool residuals = settings.converge || ( settings.stats && s_i == max_iters-1 );
+		if( residuals ){ last_z = curr_z; }
+		timer.reset(); // the residuals are only in total_s
 
 		// Do the matrix multiply here instead of per-force, and then just pass Dx.
-		Dx = m_D*curr_x;
+		if( use_matrix_free ){ apply_D( curr_x, Dx ); }
+		else{
+			Dx.head( n_static_rows ) = m_D*curr_x;
+			apply_active_D( curr_x, Dx );
+		}
+		timer.lap( rec.Dx_s );
 
-		// Local step (uses curr_x, and does zi and ui updates on each force)
-#pragma omp parallel for
-		for( int i = 0; i < n_forces; ++i ){ forces[i]->project(dt,Dx,curr_u,curr_z); }
+		// Local step (uses curr_x, and does zi and ui updates on each force).
+		project_forces( dt, Dx, curr_u, curr_z, settings.stats ? &rec : NULL );
+		timer.lap( rec.local_s );
 
 		// Global step (sets curr_x)
-		solver_termB.noalias() = M_xbar + solver_dt2_Dt_Wt_W * ( curr_z - curr_u );
-		curr_x = solver.solve( solver_termB );
-
-		// You can test for convergence and early exit by computing residuals (Eq. 22, 23):
+		{
+			ADMM_TRACE_SPAN( "global rhs" );
+			if( use_matrix_free ){
+				W2_zu.array() = m_W_diag.array().square() * ( curr_z - curr_u ).array();
+				apply_Dt( W2_zu, Dt_W2_zu );
+				solver_termB.noalias() = M_xbar + ( dt*dt ) * Dt_W2_zu;
+			}
+			else{
+				solver_termB.noalias() = M_xbar + solver_dt2_Dt_Wt_W * ( curr_z - curr_u ).head( n_static_rows );
+				const int n_active = active_dofs.size();
+				if( n_active > 0 ){
+					W2_zu.tail( n_active ).array() = ( dt*dt ) * m_W_diag.tail( n_active ).array().square() *
+						( curr_z.tail( n_active ) - curr_u.tail( n_active ) ).array();
+					apply_active_Dt( W2_zu, solver_termB );
+				}
+			}
+		}
+		timer.lap( rec.rhs_s );
+		{
+			ADMM_TRACE_SPAN( "global solve" );
+			solver->solve( solver_termB, curr_x );
+			if( lowrank_C.size() > 0 ){ lowrank_correct( curr_x ); }
+		}
+		timer.lap( rec.solve_s );
+
+		// Test for convergence and early exit by computing residuals (Eq. 22, 23):
 		// r = W*(Dx-curr_z), s = Dt*Wt*W*(curr_z-last_z)
+		// r uses the Dx of the local step, s costs one Dt product per check.
+		if( residuals ){
+			double r_norm = ( m_W_diag.asDiagonal() * ( Dx - curr_z ) ).norm() * rms_scale;
+			W2_dz.array() = m_W_diag.array().square() * ( curr_z - last_z ).array();
+			if( use_matrix_free ){ apply_Dt( W2_dz, Dt_W2_dz ); }
+			else{
+				Dt_W2_dz.noalias() = m_D.transpose() * W2_dz.head( n_static_rows );
+				apply_active_Dt( W2_dz, Dt_W2_dz );
+			}
+			double s_norm = Dt_W2_dz.norm() * rms_scale_dof;
+			rec.primal_residual = r_norm;
+			rec.dual_residual = s_norm;
+			if( settings.converge && r_norm < settings.primal_tol && s_norm < settings.dual_tol ){ ++s_i; break; }
+		}
 
 	} // end solver loop
+	last_iters = s_i;
+	if( settings.verbose > 1 ){ std::cout << "System::step: " << last_iters << " admm iterations" << std::endl; }
 
 	// Computing new velocity and setting the new state
 	m_v.noalias() = ( curr_x - m_x ) * ( 1.0 / dt );
 	m_x = curr_x;
 	elapsed_s += dt;
 
+	if( settings.stats ){
+		rec.iters = last_iters;
+		rec.active_rows = active_dofs.size();
+		rec.factorizations = n_factorizations - factorizations0;
+		rec.lowrank_updates = n_lowrank_updates - lowrank_updates0;
+		step_timer.lap( rec.total_s );
+	}
+
 	return true;
 }
 
@@ -97,8 +214,11 @@ int System::add_nodes( Eigen::VectorXd x, Eigen::VectorXd m ){
 
 bool System::initialize(){
 
+	ADMM_TRACE_SPAN( "System::initialize" );
 	const int dof = m_x.size();
 	if( settings.verbose > 0 ){ std::cout << "Solver::initialize: " << std::endl; }
+	StepTimer timer( true ), init_timer( true );
+	stats.init = StepStats::Init();
 
 	if( settings.timestep_s <= 0.0 ){
 		std::cerr << "\n**Solver Error: timestep set to " << settings.timestep_s <<
@@ -117,27 +237,91 @@ bool System::initialize(){
 	for(int i = 0; i < forces.size(); ++i){
 		forces[i]->initialize( m_x, m_v, m_masses, settings.timestep_s );
 	}
+	for(int i = 0; i < force_batches.size(); ++i){
+		force_batches[i]->initialize( m_x, m_v, m_masses, settings.timestep_s );
+	}
+	timer.lap( stats.init.forces_s );
 
 	// Set up the selector matrix (D) and weight (W) matrix
 	std::vector<Eigen::Triplet<double> > triplets;
 	std::vector<double> weights;
-	for(int i = 0; i < forces.size(); ++i){ forces[i]->get_selector( m_x, triplets, weights ); }
+	get_selector( triplets, weights );
 	m_W_diag = Eigen::Map<Eigen::VectorXd>(&weights[0], weights.size());
 	m_D.resize( weights.size(), dof );
 	m_D.setFromTriplets( triplets.begin(), triplets.end() );
-	SparseMatrix<double> Dt = m_D.transpose();
+	n_static_rows = weights.size();
+	timer.lap( stats.init.selector_s );
+
+	// Check if the forces can apply the selector themselves
+	use_matrix_free = settings.matrix_free_D;
+	for( int i=0; i<forces.size() && use_matrix_free; ++i ){
+		if( !forces[i]->matrix_free() ){
+			std::cerr << "\n**Solver Error: Force " << i << " does not support matrix_free_D, " <<
+				"using the global D matrix." << std::endl;
+			use_matrix_free = false;
+		}
+	}
 
-	// Compute mass matrix
-	Eigen::SparseMatrix<double> M( dof, dof );
-	Eigen::VectorXi nnz = Eigen::VectorXi::Ones( dof ); // non zeros per column
-	M.reserve(nnz);
-	for( int i=0; i<dof; ++i ){ M.coeffRef(i,i) = m_masses[i]; }
+	// Forces that parallelize themselves are kept out of the parallel loop
+	loop_forces.clear();
+	threaded_forces.clear();
+	for( int i=0; i<forces.size(); ++i ){
+		if( forces[i]->threaded() ){ threaded_forces.push_back( i ); }
+		else{ loop_forces.push_back( i ); }
+	}
+	timed_forces.clear();
+	for( int i=0; i<forces.size(); ++i ){
+		if( forces[i]->time_dependent() ){ timed_forces.push_back( i ); }
+	}
+
+	// Force types for the stats, with the loop forces grouped by type
+	stats.force_types.clear();
+	force_type.resize( forces.size() );
+	batch_type.resize( force_batches.size() );
+	for( int i=0; i<forces.size()+force_batches.size(); ++i ){
+		std::string name = i < forces.size() ? forces[i]->name() : force_batches[i-forces.size()]->name();
+		int type = std::find( stats.force_types.begin(), stats.force_types.end(), name ) - stats.force_types.begin();
+		if( type == stats.force_types.size() ){ stats.force_types.push_back( name ); }
+		if( i < forces.size() ){ force_type[i] = type; }
+		else{ batch_type[i-forces.size()] = type; }
+	}
+	std::stable_sort( loop_forces.begin(), loop_forces.end(),
+		[&]( int a, int b ){ return force_type[a] < force_type[b]; } );
+	loop_groups.clear();
+	for( int i=0; i<loop_forces.size(); ++i ){
+		if( i==0 || force_type[ loop_forces[i] ] != force_type[ loop_forces[i-1] ] ){ loop_groups.push_back( i ); }
+	}
+	loop_groups.push_back( loop_forces.size() );
+	stats.set_capacity( settings.stats_steps );
+
+	// Active-set forces add their rows at the start of each step
+	active_forces.clear();
+	for( int i=0; i<forces.size(); ++i ){
+		if( !forces[i]->active_set() ){ continue; }
+		if( !forces[i]->matrix_free() ){
+			std::cerr << "\n**Solver Error: Active-set force " << i << " needs a matrix-free selector" << std::endl;
+			return false;
+		}
+		active_forces.push_back( i );
+	}
+	active_dofs.clear();
+	factored_dofs.clear();
+	active_row.assign( dof, -1 );
+	active_diag = VectorXd::Zero( dof );
+	active_diag_factored = VectorXd::Zero( dof );
 
 	// Setup the solver
-	DiagonalMatrix<double,Dynamic> W = m_W_diag.asDiagonal();
-	Eigen::SparseMatrix<double> solver_termA = ( M + settings.timestep_s*settings.timestep_s * Dt * W * W * m_D );
-	solver_dt2_Dt_Wt_W = settings.timestep_s*settings.timestep_s * Dt * W * W;
-	solver.compute( solver_termA );
+	timer.reset();
+	solver = LinearSolver::create( settings.linear_solver, settings.linsolve_iters, settings.linsolve_tol, settings.cheby_rho );
+	if( solver == NULL ){
+		std::cerr << "\n**Solver Error: Unknown linear solver " << settings.linear_solver << std::endl;
+		return false;
+	}
+	if( !init_solver() ){
+		std::cerr << "\n**Solver Error: Failed to compute the " << settings.linear_solver << " solver" << std::endl;
+		return false;
+	}
+	timer.lap( stats.init.solver_s );
 
 	// Allocate space for our ADMM vars
 	solver_termB.resize( m_D.rows() );
@@ -145,37 +329,481 @@ bool System::initialize(){
 	curr_u.resize( m_D.rows() );
 	curr_u.setZero();
 	curr_z.resize( m_D.rows() );
+	last_z.resize( m_D.rows() );
+	W2_zu.resize( m_D.rows() );
+	W2_dz.resize( m_D.rows() );
+	Dt_W2_dz.resize( dof );
+	if( use_matrix_free ){
+		Dt_W2_zu.resize( dof );
+		release_selector_terms();
+	}
 
 	if( settings.verbose >= 1 ){
-		std::cout <<  m_x.size()/3 << " nodes, " << forces.size() << " forces" << std::endl;
+		int n_batched = 0;
+		for( int i=0; i<force_batches.size(); ++i ){ n_batched += force_batches[i]->size(); }
+		std::cout <<  m_x.size()/3 << " nodes, " << forces.size()+n_batched << " forces" << std::endl;
 	}
 
+	init_timer.lap( stats.init.total_s );
 	initialized = true;
 	return true;
 
 } // end init
 
 
-void System::recompute_weights(){
+void System::get_selector( std::vector<Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
+	for(int i = 0; i < forces.size(); ++i){
+		if( forces[i]->active_set() ){ continue; } // rows are added in update_active_set
+		forces[i]->get_selector( m_x, triplets, weights );
+	}
+	for(int i = 0; i < force_batches.size(); ++i){
+		force_batches[i]->get_selector( m_x, triplets, weights );
+	}
+}
+
 
-	int dof = m_masses.size();
+void System::recompute_weights(){
 
+	ADMM_TRACE_SPAN( "System::recompute_weights" );
 	// Update the weight matrix
 	std::vector<Eigen::Triplet<double> > triplets;
 	std::vector<double> weights;
-	for(int i = 0; i < forces.size(); ++i){
-		forces[i]->get_selector( m_x, triplets, weights );
+	get_selector( triplets, weights );
+	if( weights.size() != n_static_rows ){
+		std::cerr << "\n**Solver Error: Number of weights changed after initialize" << std::endl;
+		return;
+	}
+	Eigen::VectorXd W_old = m_W_diag.head( n_static_rows );
+	m_W_diag.head( n_static_rows ) = Eigen::Map<Eigen::VectorXd>(&weights[0], weights.size());
+
+	// The global terms are only kept while refactoring with a matrix-free selector
+	if( use_matrix_free ){
+		if( m_D.nonZeros() == 0 ){
+			m_D.resize( weights.size(), m_x.size() );
+			m_D.setFromTriplets( triplets.begin(), triplets.end() );
+		}
+		init_selector_terms();
 	}
-	m_W_diag = Eigen::Map<Eigen::VectorXd>(&weights[0], weights.size());
 
-	// Setup the solver
-	Eigen::SparseMatrix<double> M( dof, dof ); // needed because eigen doesn't like diagonal*sparse
-	Eigen::VectorXi nnz = Eigen::VectorXi::Ones( dof ); // non zeros per column
-	M.reserve(nnz); for( int i=0; i<dof; ++i ){ M.coeffRef(i,i) = m_masses[i]; }
-	DiagonalMatrix<double,Dynamic> W = m_W_diag.asDiagonal();
-	solver_dt2_Dt_Wt_W = settings.timestep_s*settings.timestep_s * m_D.transpose() * W * W;
-	SparseMatrix<double> solver_termA = ( M + solver_dt2_Dt_Wt_W * m_D );
-	solver.compute( solver_termA );
+	// Only a few weights changed, correct the existing factorization
+	bool updated = false;
+	if( solver->needs_matrix() && settings.lowrank_rows > 0 ){
+
+		const double dt2 = settings.timestep_s*settings.timestep_s;
+		double *S_vals = solver_dt2_Dt_Wt_W.valuePtr();
+		const int *S_outer = solver_dt2_Dt_Wt_W.outerIndexPtr();
+		for( int k=0; k<n_static_rows; ++k ){
+			if( m_W_diag[k] == W_old[k] ){ continue; }
+			const double w2 = dt2 * m_W_diag[k] * m_W_diag[k];
+			for( int p=S_outer[k]; p<S_outer[k+1]; ++p ){ S_vals[p] = w2 * m_D.valuePtr()[ solver_Dt_map[p] ]; }
+		}
+		updated = update_lowrank();
+	}
+
+	// The pattern of the global matrix is unchanged, so only the values
+	// are updated and the solver skips its symbolic analysis.
+	if( !updated && !update_solver() ){
+		std::cerr << "\n**Solver Error: Failed to recompute the " << settings.linear_solver << " solver" << std::endl;
+	}
+
+	if( use_matrix_free ){ release_selector_terms(); }
+}
+
+
+void System::init_selector_terms(){
+
+	const int dof = m_masses.size();
+	const double dt2 = settings.timestep_s*settings.timestep_s;
+	DiagonalMatrix<double,Dynamic> W = m_W_diag.head( n_static_rows ).asDiagonal();
+	solver_dt2_Dt_Wt_W = dt2 * m_D.transpose() * W * W;
+
+	// dt2_Dt_Wt_W has the pattern of Dt, so entry (i,k) comes from D(k,i).
+	// Store where each value comes from so update_solver can rescale it in place.
+	solver_Dt_map.resize( solver_dt2_Dt_Wt_W.nonZeros() );
+	std::vector<int> next( solver_dt2_Dt_Wt_W.outerIndexPtr(), solver_dt2_Dt_Wt_W.outerIndexPtr()+m_D.rows() );
+	const int *D_outer = m_D.outerIndexPtr();
+	const int *D_inner = m_D.innerIndexPtr();
+	for( int i=0; i<dof; ++i ){
+		for( int p=D_outer[i]; p<D_outer[i+1]; ++p ){ solver_Dt_map[ next[ D_inner[p] ]++ ] = p; }
+	}
+}
+
+
+void System::release_selector_terms(){
+	solver_dt2_Dt_Wt_W = SparseMatrix<double>();
+	std::vector<int>().swap( solver_Dt_map );
+	if( solver->needs_matrix() ){ m_D = SparseMatrix<double>(); }
+}
+
+
+void System::project_forces( double dt, const VectorXd &Dx_, VectorXd &u, VectorXd &z, StepStats::Step *rec ) const {
+
+	ADMM_TRACE_SPAN( "local step" );
+	if( rec == NULL ){
+		const int n_loop = loop_forces.size();
+#pragma omp parallel for
+		for( int i=0; i<n_loop; ++i ){ forces[ loop_forces[i] ]->project( dt, Dx_, u, z ); }
+
+		// Batches and threaded forces are parallelized internally
+		for( int i=0; i<threaded_forces.size(); ++i ){ forces[ threaded_forces[i] ]->project( dt, Dx_, u, z ); }
+		for( int i=0; i<force_batches.size(); ++i ){ force_batches[i]->project( dt, Dx_, u, z ); }
+		return;
+	}
+
+	// Same as above, but one parallel loop per force type so they can be timed
+	StepTimer timer( true );
+	for( int g=0; g+1<loop_groups.size(); ++g ){
+		const int begin = loop_groups[g], end = loop_groups[g+1];
+#pragma omp parallel for
+		for( int i=begin; i<end; ++i ){ forces[ loop_forces[i] ]->project( dt, Dx_, u, z ); }
+		timer.lap( rec->local_type_s[ force_type[ loop_forces[begin] ] ] );
+	}
+	for( int i=0; i<threaded_forces.size(); ++i ){
+		forces[ threaded_forces[i] ]->project( dt, Dx_, u, z );
+		timer.lap( rec->local_type_s[ force_type[ threaded_forces[i] ] ] );
+	}
+	for( int i=0; i<force_batches.size(); ++i ){
+		force_batches[i]->project( dt, Dx_, u, z );
+		timer.lap( rec->local_type_s[ batch_type[i] ] );
+	}
+}
+
+
+void System::apply_D( const VectorXd &x, VectorXd &Dx_ ) const {
+	ADMM_TRACE_SPAN( "System::apply_D" );
+	const int n_loop = loop_forces.size();
+#pragma omp parallel for
+	for( int i=0; i<n_loop; ++i ){ forces[ loop_forces[i] ]->apply_Di( x, Dx_ ); }
+	for( int i=0; i<threaded_forces.size(); ++i ){ forces[ threaded_forces[i] ]->apply_Di( x, Dx_ ); }
+	for( int i=0; i<force_batches.size(); ++i ){ force_batches[i]->apply_Di( x, Dx_ ); }
+}
+
+
+void System::apply_Dt( const VectorXd &v, VectorXd &Dtv ) const {
+	ADMM_TRACE_SPAN( "System::apply_Dt" );
+	const int dof = m_masses.size();
+	const int n_loop = loop_forces.size();
+
+	// Forces of different threads share nodes, so instead of atomic adds each
+	// thread scatters into its own vector (thread 0 into Dtv), which are summed after.
+#pragma omp parallel
+	{
+		int t = 0, n_threads = 1;
+#ifdef _OPENMP
+		t = omp_get_thread_num();
+		n_threads = omp_get_num_threads();
+#endif
+#pragma omp single
+		{ if( Dt_thread.size() < n_threads-1 ){ Dt_thread.resize( n_threads-1 ); } }
+		VectorXd &Dt_t = ( t==0 ? Dtv : Dt_thread[t-1] );
+		Dt_t.setZero( dof );
+
+#pragma omp for nowait
+		for( int i=0; i<n_loop; ++i ){ forces[ loop_forces[i] ]->apply_DiT( v, Dt_t ); }
+		for( int i=0; i<force_batches.size(); ++i ){
+			const long n = force_batches[i]->size();
+			force_batches[i]->apply_DiT_range( n*t/n_threads, n*(t+1)/n_threads, v, Dt_t );
+		}
+#pragma omp barrier
+#pragma omp for
+		for( int k=0; k<dof; ++k ){
+			for( int j=0; j<n_threads-1; ++j ){ Dtv[k] += Dt_thread[j][k]; }
+		}
+	}
+
+	// These parallelize themselves and write their own rows, see CollisionForce
+	for( int i=0; i<threaded_forces.size(); ++i ){ forces[ threaded_forces[i] ]->apply_DiT( v, Dtv ); }
+}
+
+
+void System::apply_active_D( const VectorXd &x, VectorXd &Dx_ ) const {
+	for( int i=0; i<active_forces.size(); ++i ){ forces[ active_forces[i] ]->apply_Di( x, Dx_ ); }
+}
+
+
+void System::apply_active_Dt( const VectorXd &v, VectorXd &Dtv ) const {
+	for( int i=0; i<active_forces.size(); ++i ){ forces[ active_forces[i] ]->apply_DiT( v, Dtv ); }
+}
+
+
+void System::update_active_set( const VectorXd &x0, const VectorXd &x ){
+
+	ADMM_TRACE_SPAN( "System::update_active_set" );
+	// Collect the rows, which go after the static ones
+	std::vector<int> dofs;
+	std::vector<double> weights;
+	for( int i=0; i<active_forces.size(); ++i ){
+		Force *f = forces[ active_forces[i] ].get();
+		f->global_idx = n_static_rows + dofs.size();
+		f->get_active( x0, x, dofs, weights );
+	}
+	const int n_active = dofs.size();
+	const int n_rows = n_static_rows + n_active;
+
+	// Dofs that stay active keep their dual
+	VectorXd u_active( n_active );
+	for( int k=0; k<n_active; ++k ){
+		const int r = active_row[ dofs[k] ];
+		u_active[k] = ( r >= 0 ? curr_u[r] : 0.0 );
+	}
+	for( int k=0; k<active_dofs.size(); ++k ){ active_row[ active_dofs[k] ] = -1; }
+	for( int k=0; k<n_active; ++k ){
+		if( active_row[ dofs[k] ] < 0 ){ active_row[ dofs[k] ] = n_static_rows + k; }
+	}
+
+	// Resize the admm vars
+	curr_u.conservativeResize( n_rows );
+	curr_u.tail( n_active ) = u_active;
+	m_W_diag.conservativeResize( n_rows );
+	if( n_active > 0 ){ m_W_diag.tail( n_active ) = Eigen::Map<Eigen::VectorXd>( &weights[0], n_active ); }
+	Dx.resize( n_rows );
+	curr_z.resize( n_rows );
+	last_z.resize( n_rows );
+	W2_zu.resize( n_rows );
+	W2_dz.resize( n_rows );
+
+	// Diagonal of the global matrix from the active rows
+	const double dt2 = settings.timestep_s*settings.timestep_s;
+	for( int k=0; k<active_dofs.size(); ++k ){ active_diag[ active_dofs[k] ] = 0.0; }
+	for( int k=0; k<n_active; ++k ){ active_diag[ dofs[k] ] += dt2 * weights[k] * weights[k]; }
+	active_dofs.swap( dofs );
+
+	bool changed = false;
+	for( int k=0; k<factored_dofs.size() && !changed; ++k ){
+		changed = active_diag[ factored_dofs[k] ] != active_diag_factored[ factored_dofs[k] ];
+	}
+	for( int k=0; k<n_active && !changed; ++k ){
+		changed = active_diag[ active_dofs[k] ] != active_diag_factored[ active_dofs[k] ];
+	}
+	// Back to the factored active diagonal. The low-rank correction is dropped if the
+	// static weights are also the factored ones, and kept if it only covers those.
+	if( !changed ){
+		if( m_W_diag.head( n_static_rows ) == solver_W_factored ){ lowrank_C.resize(0); return; }
+		if( lowrank_C.size() > 0 && lowrank_dofs == 0 ){ return; }
+	}
+
+	// Only a few dofs changed, correct the existing factorization
+	if( solver->needs_matrix() && settings.lowrank_rows > 0 ){
+		if( update_lowrank() ){ return; }
+	}
+
+	// Other weights changed since the last factorization, so refactor everything.
+	// The static weights in m_W_diag are current, so the selector is only needed
+	// to rebuild the global terms when they were released.
+	if( m_W_diag.head( n_static_rows ) != solver_W_factored ){
+		if( use_matrix_free ){
+			if( m_D.nonZeros() == 0 ){
+				std::vector<Eigen::Triplet<double> > triplets;
+				std::vector<double> weights;
+				get_selector( triplets, weights );
+				m_D.resize( weights.size(), m_x.size() );
+				m_D.setFromTriplets( triplets.begin(), triplets.end() );
+			}
+			init_selector_terms();
+		}
+		if( !update_solver() ){
+			std::cerr << "\n**Solver Error: Failed to refactor the " << settings.linear_solver << " solver" << std::endl;
+		}
+		if( use_matrix_free ){ release_selector_terms(); }
+		return;
+	}
+
+	// Otherwise only the diagonal changed, which is in the pattern of A
+	if( solver->needs_matrix() ){
+		for( int k=0; k<factored_dofs.size(); ++k ){
+			const int j = factored_dofs[k];
+			solver_termA.coeffRef( j, j ) -= active_diag_factored[j];
+		}
+		set_active_factored();
+		for( int k=0; k<factored_dofs.size(); ++k ){
+			const int j = factored_dofs[k];
+			solver_termA.coeffRef( j, j ) += active_diag[j];
+		}
+	}
+	else{ set_active_factored(); }
+
+	GlobalTerms terms = global_terms();
+	if( solver->needs_matrix() ){ terms.A = &solver_termA; }
+	lowrank_C.resize(0);
+	++n_factorizations;
+	if( !solver->factorize( terms ) ){
+		std::cerr << "\n**Solver Error: Failed to refactor the " << settings.linear_solver << " solver" << std::endl;
+	}
+}
+
+
+void System::set_active_factored(){
+	for( int k=0; k<factored_dofs.size(); ++k ){ active_diag_factored[ factored_dofs[k] ] = 0.0; }
+	factored_dofs = active_dofs;
+	std::sort( factored_dofs.begin(), factored_dofs.end() );
+	factored_dofs.erase( std::unique( factored_dofs.begin(), factored_dofs.end() ), factored_dofs.end() );
+	for( int k=0; k<factored_dofs.size(); ++k ){ active_diag_factored[ factored_dofs[k] ] = active_diag[ factored_dofs[k] ]; }
+}
+
+
+bool System::init_solver(){
+
+	ADMM_TRACE_SPAN( "System::init_solver" );
+	const int dof = m_masses.size();
+	init_selector_terms();
+
+	GlobalTerms terms = global_terms();
+	if( solver->needs_matrix() ){
+
+		Eigen::SparseMatrix<double> M( dof, dof ); // needed because eigen doesn't like diagonal*sparse
+		Eigen::VectorXi nnz = Eigen::VectorXi::Ones( dof ); // non zeros per column
+		M.reserve(nnz); for( int i=0; i<dof; ++i ){ M.coeffRef(i,i) = m_masses[i]; }
+		solver_termA = ( M + solver_dt2_Dt_Wt_W * m_D );
+		terms.A = &solver_termA;
+	}
+
+	solver_W_factored = m_W_diag.head( n_static_rows );
+	set_active_factored();
+	lowrank_C.resize(0);
+	if( !solver->analyze( terms ) ){ return false; }
+	++n_factorizations;
+	return solver->factorize( terms );
+}
+
+
+bool System::update_solver(){
+
+	ADMM_TRACE_SPAN( "System::update_solver" );
+	const int dof = m_masses.size();
+	const double dt2 = settings.timestep_s*settings.timestep_s;
+
+	// Rescale dt2_Dt_Wt_W in place with the new weights
+	const int n_rows = solver_dt2_Dt_Wt_W.outerSize();
+	double *S_vals = solver_dt2_Dt_Wt_W.valuePtr();
+	const int *S_outer = solver_dt2_Dt_Wt_W.outerIndexPtr();
+	const double *D_vals = m_D.valuePtr();
+#pragma omp parallel for
+	for( int k=0; k<n_rows; ++k ){
+		const double w2 = dt2 * m_W_diag[k] * m_W_diag[k];
+		for( int p=S_outer[k]; p<S_outer[k+1]; ++p ){ S_vals[p] = w2 * D_vals[ solver_Dt_map[p] ]; }
+	}
+
+	GlobalTerms terms = global_terms();
+	if( solver->needs_matrix() ){
+
+		// Recompute the values of A = M + dt2_Dt_Wt_W * D column by column,
+		// scattering into a dense work vector and gathering into the existing pattern.
+#pragma omp parallel
+		{
+			VectorXd work = VectorXd::Zero( dof );
+#pragma omp for
+			for( int j=0; j<dof; ++j ){
+				for( SparseMatrix<double>::InnerIterator d_it(m_D,j); d_it; ++d_it ){
+					for( SparseMatrix<double>::InnerIterator s_it(solver_dt2_Dt_Wt_W,d_it.row()); s_it; ++s_it ){
+						work[ s_it.row() ] += s_it.value() * d_it.value();
+					}
+				}
+				work[j] += m_masses[j] + active_diag[j];
+				for( SparseMatrix<double>::InnerIterator a_it(solver_termA,j); a_it; ++a_it ){
+					a_it.valueRef() = work[ a_it.row() ];
+					work[ a_it.row() ] = 0.0;
+				}
+			}
+		}
+		terms.A = &solver_termA;
+	}
+
+	solver_W_factored = m_W_diag.head( n_static_rows );
+	set_active_factored();
+	lowrank_C.resize(0);
+	++n_factorizations;
+	return solver->factorize( terms );
+}
+
+
+bool System::update_lowrank(){
+
+	ADMM_TRACE_SPAN( "System::update_lowrank" );
+	const double dt2 = settings.timestep_s*settings.timestep_s;
+	const int dof = m_masses.size();
+
+	// Rows of D with a weight that differs from the factored one
+	std::vector<int> rows;
+	for( int k=0; k<n_static_rows; ++k ){
+		if( m_W_diag[k] != solver_W_factored[k] ){
+			rows.push_back(k);
+			if( (int)rows.size() > settings.lowrank_rows ){ return false; }
+		}
+	}
+
+	// The selector terms are released with a matrix-free D
+	if( rows.size() > 0 && solver_Dt_map.size() == 0 ){ return false; }
+
+	// Dofs with an active-set diagonal that differs from the factored one
+	std::vector<int> dofs;
+	for( int k=0; k<factored_dofs.size(); ++k ){
+		const int j = factored_dofs[k];
+		if( active_diag[j] != active_diag_factored[j] ){ dofs.push_back(j); }
+	}
+	for( int k=0; k<active_dofs.size(); ++k ){
+		const int j = active_dofs[k];
+		if( active_diag[j] != active_diag_factored[j] ){ dofs.push_back(j); }
+	}
+	std::sort( dofs.begin(), dofs.end() );
+	dofs.erase( std::unique( dofs.begin(), dofs.end() ), dofs.end() );
+	if( (int)( rows.size() + dofs.size() ) > settings.lowrank_rows ){ return false; }
+
+	const int r = rows.size() + dofs.size();
+	lowrank_C.resize( r );
+	lowrank_dofs = dofs.size();
+	if( r == 0 ){ return true; }
+
+	// U = columns of Dt for the changed rows, which are
+	// the columns of dt2_Dt_Wt_W up to a scale.
+	std::vector< Eigen::Triplet<double> > triplets;
+	for( int c=0; c<rows.size(); ++c ){
+		const int k = rows[c];
+		const double w_new = m_W_diag[k], w_old = solver_W_factored[k];
+		lowrank_C[c] = dt2 * ( w_new*w_new - w_old*w_old );
+		for( int p=solver_dt2_Dt_Wt_W.outerIndexPtr()[k]; p<solver_dt2_Dt_Wt_W.outerIndexPtr()[k+1]; ++p ){
+			const int i = solver_dt2_Dt_Wt_W.innerIndexPtr()[p];
+			triplets.push_back( Eigen::Triplet<double>( i, c, m_D.valuePtr()[ solver_Dt_map[p] ] ) );
+		}
+	}
+	for( int c=0; c<dofs.size(); ++c ){
+		const int j = dofs[c];
+		lowrank_C[ rows.size()+c ] = active_diag[j] - active_diag_factored[j];
+		triplets.push_back( Eigen::Triplet<double>( j, rows.size()+c, 1.0 ) );
+	}
+	lowrank_U.resize( dof, r );
+	lowrank_U.setFromTriplets( triplets.begin(), triplets.end() );
+
+	// One back-substitution per changed row
+	lowrank_AinvU.resize( dof, r );
+	VectorXd u_c( dof ), AinvU_c( dof );
+	for( int c=0; c<r; ++c ){
+		u_c = lowrank_U.col(c);
+		solver->solve( u_c, AinvU_c );
+		lowrank_AinvU.col(c) = AinvU_c;
+	}
+
+	MatrixXd S = MatrixXd::Identity( r, r ) + ( lowrank_U.transpose() * lowrank_AinvU ) * lowrank_C.asDiagonal();
+	lowrank_S.compute( S );
+	++n_lowrank_updates;
+	return true;
+}
+
+
+void System::lowrank_correct( VectorXd &x ) const {
+	VectorXd Uty = lowrank_U.transpose() * x;
+	VectorXd t = lowrank_S.solve( Uty );
+	x.noalias() -= lowrank_AinvU * ( lowrank_C.asDiagonal() * t );
+}
+
+
+GlobalTerms System::global_terms(){
+	GlobalTerms terms;
+	terms.masses = &m_masses;
+	terms.D = &m_D;
+	terms.W_diag = &m_W_diag;
+	terms.active_diag = ( active_forces.size() > 0 ? &active_diag : NULL );
+	terms.dt2 = settings.timestep_s*settings.timestep_s;
+	return terms;
 }
 
 
@@ -189,11 +817,26 @@ void System::Settings::parse_args( int argc, char **argv ){
 		else if( arg == "-dt" ){ val >> timestep_s; }
 		else if( arg == "-v" ){ val >> verbose; }	
 		else if( arg == "-it" ){ val >> admm_iters; }
+		else if( arg == "-converge" ){ converge = true; }
+		else if( arg == "-maxit" ){ val >> max_admm_iters; }
+		else if( arg == "-rtol" ){ val >> primal_tol; }
+		else if( arg == "-stol" ){ val >> dual_tol; }
+		else if( arg == "-ls" ){ val >> linear_solver; }
+		else if( arg == "-lsit" ){ val >> linsolve_iters; }
+		else if( arg == "-lstol" ){ val >> linsolve_tol; }
+		else if( arg == "-rho" ){ val >> cheby_rho; }
+		else if( arg == "-lr" ){ val >> lowrank_rows; }
+		else if( arg == "-mfd" ){ matrix_free_D = true; }
+		else if( arg == "-stats" ){ stats = true; }
+		else if( arg == "-statsn" ){ val >> stats_steps; }
 	}
 
 	// Check if last arg is one of our no-param args
 	std::string arg( argv[argc-1] );
 	if( arg == "-help" ){ help(); }
+	else if( arg == "-converge" ){ converge = true; }
+	else if( arg == "-mfd" ){ matrix_free_D = true; }
+	else if( arg == "-stats" ){ stats = true; }
 
 } // end parse settings args
 
@@ -203,6 +846,18 @@ void System::Settings::help(){
 		"\t-dt: time step (s)\n" <<
 		"\t-v: verbosity (higher -> show more)\n" <<
 		"\t-it: # admm iters\n" <<
+		"\t-converge: stop admm iterations on the residuals instead of -it\n" <<
+		"\t-maxit: max # admm iters with -converge\n" <<
+		"\t-rtol: primal residual tolerance with -converge\n" <<
+		"\t-stol: dual residual tolerance with -converge\n" <<
+		"\t-ls: global step solver (ldlt, llt, pcg, chebyshev)\n" <<
+		"\t-lsit: max # iters for pcg/chebyshev\n" <<
+		"\t-lstol: residual tolerance for pcg/chebyshev\n" <<
+		"\t-rho: spectral radius estimate for chebyshev\n" <<
+		"\t-lr: max # changed weights for a low-rank update (0 to always refactor)\n" <<
+		"\t-mfd: apply the selector per-force instead of storing the global D matrix\n" <<
+		"\t-stats: record per-step timings and residuals (System::stats)\n" <<
+		"\t-statsn: # steps kept in the stats\n" <<
 	"==========================================\n";
 	printf( "%s", ss.str().c_str() );
 }
@@ -22,13 +22,15 @@
 
 #include "Force.hpp"
 #include "ExplicitForce.hpp"
-#include <Eigen/SparseCholesky>
+#include "LinearSolver.hpp"
+#include "StepStats.hpp"
 
 namespace admm {
 
 class System {
 public:
-	System() : elapsed_s(0.0), initialized(false) {}
+	System() : elapsed_s(0.0), last_iters(0), initialized(false), use_matrix_free(false),
+		n_factorizations(0), n_lowrank_updates(0), lowrank_dofs(0), n_static_rows(0) {}
 
 	// Solver settings
 	// Can be loaded from args: system.settings.parse_args(argc,argv)
@@ -38,10 +40,30 @@ public:
 		double timestep_s;	// -dt <flt>	timestep in seconds (don't change after initialize!)
 		int verbose;		// -v <int>	terminal output level (higher=more)
 		int admm_iters;		// -it <int>	number of admm-solver iterations
-		Settings() : timestep_s(0.04), verbose(1), admm_iters(10) {}
+		bool converge;		// -converge	run until the residuals are below tolerance instead of admm_iters
+		int max_admm_iters;	// -maxit <int>	hard cap on admm iterations when converge is set
+		double primal_tol;	// -rtol <flt>	tolerance on the primal residual, rms of W(Dx-z)
+		double dual_tol;	// -stol <flt>	tolerance on the dual residual, rms of Dt W^2 (z-z_last)
+		std::string linear_solver; // -ls <str>	global step solver: ldlt, llt, pcg, or chebyshev
+		int linsolve_iters;	// -lsit <int>	max iterations for pcg/chebyshev
+		double linsolve_tol;	// -lstol <flt>	relative residual tolerance for pcg/chebyshev
+		double cheby_rho;	// -rho <flt>	spectral radius estimate for chebyshev
+		int lowrank_rows;	// -lr <int>	max changed weights handled with a low-rank update instead of a refactor
+		bool matrix_free_D;	// -mfd	apply the selector per-force instead of storing the global D matrix
+		bool stats;		// -stats	record timings and residuals of each step in System::stats
+		int stats_steps;	// -statsn <int>	number of steps kept in System::stats (set at initialize)
+		Settings() : timestep_s(0.04), verbose(1), admm_iters(10),
+			converge(false), max_admm_iters(100), primal_tol(1e-4), dual_tol(1e-4),
+			linear_solver("ldlt"), linsolve_iters(50), linsolve_tol(1e-6), cheby_rho(0.99),
+			lowrank_rows(64), matrix_free_D(false), stats(false), stats_steps(256) {}
 	} settings ;
 
 	double elapsed_s; // accumulated time in seconds
+	int last_iters; // number of admm iterations taken by the last step
+
+	// Stats of the last settings.stats_steps steps, recorded while settings.stats is set.
+	// It can be turned on or off between steps.
+	StepStats stats;
 
 	// Per-node (x3) data (for x, y, and z)
 	Eigen::VectorXd m_x; // node positions, scaled x3
@@ -50,6 +72,19 @@ public:
 
 	std::vector< std::shared_ptr<ExplicitForce> > explicit_forces; // forces applied explicitly
 	std::vector< std::shared_ptr<Force> > forces; // minimized (implicit)
+	std::vector< std::shared_ptr<ForceBatch> > force_batches; // minimized (implicit), one per force type
+
+	// Returns the batch of type T, adding an empty one if there isn't one yet.
+	// Elements should be added to batches before initialize.
+	template<typename T> std::shared_ptr<T> get_batch(){
+		for( int i=0; i<force_batches.size(); ++i ){
+			std::shared_ptr<T> batch = std::dynamic_pointer_cast<T>( force_batches[i] );
+			if( batch != NULL ){ return batch; }
+		}
+		std::shared_ptr<T> batch( new T() );
+		force_batches.push_back( batch );
+		return batch;
+	}
 
 	// Adds nodes to the system.
 	// Returns the current total number of nodes after insert.
@@ -67,8 +102,9 @@ public:
 
 	// You can change the weights at runtime.
 	// To do so, adjust the weight value associated with whatever forces
-	// you want to change. Then, call this function. However, this
-	// means the system has to be recomputed, so do it sparingly.
+	// you want to change. Then, call this function. If only a few weights
+	// changed (see settings.lowrank_rows) the factorization is corrected
+	// with a low-rank update, otherwise it's recomputed.
 	void recompute_weights();
 
 	// Adds a callback function that is executed at the beginning of a step.
@@ -79,6 +115,7 @@ protected:
 
 	// Settings
 	bool initialized;
+	bool use_matrix_free; // settings.matrix_free_D and all forces support it
 
 	// Global matrices
 	Eigen::SparseMatrix<double> m_D; // "reduction" matrix
@@ -86,7 +123,74 @@ protected:
 
 	// Solver variables computed in initialize
 	Eigen::SparseMatrix<double> solver_dt2_Dt_Wt_W;
-	Eigen::SimplicialLDLT< Eigen::SparseMatrix<double> > solver;
+	Eigen::SparseMatrix<double> solver_termA; // empty for matrix-free solvers
+	std::vector<int> solver_Dt_map; // index into m_D values for each dt2_Dt_Wt_W value
+	std::shared_ptr<LinearSolver> solver;
+
+	// Selector rows and weights of the forces and batches, without the active-set forces
+	void get_selector( std::vector<Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
+
+	// Computes dt2_Dt_Wt_W and its map into m_D
+	void init_selector_terms();
+
+	// Builds the global matrix terms from m_D and m_W_diag and runs the
+	// symbolic and numeric steps of the solver. Called in initialize.
+	bool init_solver();
+
+	// Updates the values of the global matrix terms in place for new
+	// weights and refactorizes. Called in recompute_weights and update_active_set.
+	bool update_solver();
+
+	GlobalTerms global_terms();
+
+	// Matrix-free selector (settings.matrix_free_D). The forces apply their own
+	// Di blocks, so m_D and dt2_Dt_Wt_W are only built while (re)factoring the
+	// global matrix. Iterative solvers still keep m_D for their products.
+	void apply_D( const Eigen::VectorXd &x, Eigen::VectorXd &Dx_ ) const; // Dx_ = D*x
+	void apply_Dt( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const; // Dtv = Dt*v
+	void release_selector_terms();
+
+	// Forces called in the parallel loop, and ones that parallelize
+	// themselves (see Force::threaded) and are called after it.
+	std::vector<int> loop_forces, threaded_forces; // index into forces
+	std::vector<int> timed_forces; // see Force::time_dependent
+	void project_forces( double dt, const Eigen::VectorXd &Dx_, Eigen::VectorXd &u, Eigen::VectorXd &z, StepStats::Step *rec ) const;
+
+	// Index into stats.force_types of each force and batch. The loop_forces are
+	// sorted by type, with type group g from loop_groups[g] to loop_groups[g+1].
+	// When recording stats (rec in project_forces) the groups are run and timed one at a time.
+	std::vector<int> force_type, batch_type;
+	std::vector<int> loop_groups;
+	int n_factorizations, n_lowrank_updates; // since initialize, for the stats
+
+	// Low-rank (Woodbury) correction for weight changes since the last factorization:
+	// ( A + U C Ut )^-1 b = y - A^-1 U C ( I + Ut A^-1 U C )^-1 Ut y, with y = A^-1 b.
+	// U holds the rows of D whose weight changed, C = dt^2 ( W_new^2 - W_factored^2 ).
+	Eigen::VectorXd solver_W_factored; // weights the solver was last factored with
+	Eigen::SparseMatrix<double> lowrank_U;
+	Eigen::VectorXd lowrank_C;
+	int lowrank_dofs; // columns of U from active-set dofs, after the rows of D
+	Eigen::MatrixXd lowrank_AinvU;
+	Eigen::PartialPivLU<Eigen::MatrixXd> lowrank_S; // I + Ut A^-1 U C
+	bool update_lowrank(); // returns false if there are too many changed rows
+	void lowrank_correct( Eigen::VectorXd &x ) const;
+
+	// Active-set forces (see Force::active_set). Their rows are placed after the
+	// n_static_rows rows of D and are rebuilt at the start of each step, so the admm
+	// vectors grow with the number of constrained dofs. They add active_diag to the
+	// diagonal of the global matrix, and changes to it are handled like weight changes
+	// (low-rank update if only a few dofs changed, otherwise a refactor).
+	std::vector<int> active_forces; // index into forces
+	int n_static_rows;
+	std::vector<int> active_dofs; // dof of each active row
+	std::vector<int> active_row; // first active row of each dof, or -1
+	Eigen::VectorXd active_diag; // dt^2 w^2 of the active rows, per dof
+	Eigen::VectorXd active_diag_factored; // active_diag the solver was last factored with
+	std::vector<int> factored_dofs; // dofs with a nonzero active_diag_factored
+	void update_active_set( const Eigen::VectorXd &x0, const Eigen::VectorXd &x ); // collects rows and updates the solver
+	void apply_active_D( const Eigen::VectorXd &x, Eigen::VectorXd &Dx_ ) const; // active rows of D*x
+	void apply_active_Dt( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const; // adds Dt*v for active rows
+	void set_active_factored(); // called after the solver is factored
 
 	// These variables don't need to be class members, but
 	// are stored as such to avoid reallocation. Otherwise it
@@ -95,6 +199,11 @@ protected:
 	Eigen::VectorXd Dx;
 	Eigen::VectorXd curr_u; // admm dual
 	Eigen::VectorXd curr_z; // admm primal
+	Eigen::VectorXd last_z; // primal at the previous iteration, for the dual residual
+	Eigen::VectorXd W2_zu; // W^2 (z-u), matrix-free and active rows only
+	Eigen::VectorXd Dt_W2_zu; // Dt W^2 (z-u), matrix-free only
+	Eigen::VectorXd W2_dz, Dt_W2_dz; // W^2 (z-z_last) and Dt of it, for the dual residual
+	mutable std::vector<Eigen::VectorXd> Dt_thread; // per-thread sums of apply_Dt, except thread 0
 
 }; // end class system
 
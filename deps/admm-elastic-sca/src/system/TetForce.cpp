@@ -18,6 +18,7 @@
 // OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "TetForce.hpp"
+#include "SVD3.hpp"
 
 using namespace admm;
 using namespace Eigen;
@@ -25,7 +26,7 @@ using namespace Eigen;
 namespace admm {
 namespace helper {
 
-	static inline void init_tet_force( int *idx, const Eigen::VectorXd &x, double &volume, Eigen::Matrix<double,4,3> &B, Eigen::Matrix<double,3,3> &edges_inv ){
+	static inline void init_tet_force( const int *idx, const Eigen::VectorXd &x, double &volume, Eigen::Matrix<double,4,3> &B, Eigen::Matrix<double,3,3> &edges_inv ){
 		using namespace Eigen;
 
 		// Edge matrix
@@ -56,9 +57,8 @@ namespace helper {
 		volume = fabs( (v0-v3).dot( (v1-v3).cross(v2-v3) ) ) / 6.0;
 	}
 
-	static inline void init_tet_Di( int *idx, const Eigen::Matrix<double,4,3> &B, const int dof, std::vector<Eigen::Triplet<double> > &triplets ){
+	static inline void init_tet_Di( const int *idx, const Eigen::Matrix<double,4,3> &B, const int constraint_idx, std::vector<Eigen::Triplet<double> > &triplets ){
 		using namespace Eigen;
-		int constraint_idx = triplets.size();
 		Matrix<double,3,4> Bt = B.transpose();
 		const int col0 = 3 * idx[0];
 		const int col1 = 3 * idx[1];
@@ -76,30 +76,172 @@ namespace helper {
 		}
 	}
 
-	// Projection, Singular Values, SVD's U, SVD's V transpose
-	static inline void oriented_svd( const Eigen::Matrix3d &F, Eigen::Vector3d &S, Eigen::Matrix3d &U, Eigen::Matrix3d &Vt ){
+	// Linear tet strain update for the element at row r, with k = stiffness*volume,
+	// and R the rotation closest to F = Dix+ui (column major).
+	static inline void update_linear_tet( int r, double k, double weight, const double *R, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ){
+		using namespace Eigen;
+		typedef Matrix<double,9,1> Vector9d;
+		Vector9d Dix = Dx.segment<9>( r );
+		Vector9d ui = u.segment<9>( r );
+		Vector9d DixPlusUi = Dix+ui;
+		Map<const Vector9d> p( R );
+
+		// Update zi and ui
+		Vector9d zi = ( k*p + weight*weight*(DixPlusUi) ) / (weight*weight + k);
+
+		ui.noalias() += ( Dix - zi );
+		u.segment<9>( r ) = ui;
+		z.segment<9>( r ) = zi;
+	}
+
+	// Same as above, but computes the rotation from Dx and u
+	static inline void project_linear_tet( int r, double k, double weight, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ){
 		using namespace Eigen;
 
-		JacobiSVD< Matrix3d > svd( F, ComputeFullU | ComputeFullV );
-		S = svd.singularValues();
-		U = svd.matrixU();
-		Vt = svd.matrixV().transpose();
+		// Computing F (rearranging terms from 9x1 vector DixPlusUi to make a 3x3)
+		Matrix3d F = Map<const Matrix3d>( Dx.data()+r ) + Map<const Matrix3d>( u.data()+r );
 
-		Matrix3d J = Matrix3d::Identity(); J(2,2)=-1.0;
+		// The projection is the closest rotation, U*Vt with U and V rotations
+		Matrix3d R;
+		svd3::polar( F, R );
+		update_linear_tet( r, k, weight, R.data(), Dx, u, z );
+	}
 
-		// Check for inversion: U
-		if( U.determinant() < 0.0 ){
-			U = U * J;
-			S[2] *= -1.0;
+	// Volume limit update for the element at row r, with k = stiffness*volume
+	static inline void project_tet_volume( int r, double k, double weight, double limit_min, double limit_max,
+		const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ){
+		using namespace Eigen;
+		typedef Matrix<double,9,1> Vector9d;
+		Vector9d Dix = Dx.segment<9>( r );
+		Vector9d ui = u.segment<9>( r );
+		Vector9d DixPlusUi = Dix+ui;
+
+		// Computing F (rearranging terms from 9x1 vector DixPlusUi to make a 3x3)
+		Matrix<double,3,3> F = Map<Matrix<double,3,3> >(DixPlusUi.data());
+
+		// Get some singular values. The svd kernel puts the sign of the inversion
+		// in S0[2], so move it to U to keep the singular values positive.
+		Matrix3d U, V;
+		Vector3d S0;
+		svd3::svd( F, U, S0, V );
+		if( S0[2] < 0.0 ){ S0[2] *= -1.0; U.col(2) *= -1.0; }
+		Vector3d S = S0;
+		Eigen::Vector3d d(0,0,0);
+
+		for(int i = 0; i < 4; i++){
+			double detS = S[0] * S[1] * S[2];
+			double f = detS - std::min( std::max(detS,limit_min) , limit_max );
+			Eigen::Vector3d g( S[1]*S[2] , S[0]*S[2] , S[0]*S[1] );
+			d = -((f - g.dot(d)) / g.dot(g)) * g;
+			S = S0 + d;
 		}
 
-		// Check for inversion: V
-		if( Vt.determinant() < 0.0 ){
-			Vt = J * Vt;
-			S[2] *= -1.0;
+		if( F.determinant() < 0.0 ){ S[2] = -1.0; }
+
+		// Reconstruct with new singular values
+		Matrix<double,3,3> proj = U * S.asDiagonal() * V.transpose();
+		Vector9d p = Map<Vector9d>(proj.data());
+
+		// Update zi and ui
+		Vector9d zi = ( k*p + weight*weight*(DixPlusUi) ) / (weight*weight + k);
+
+		ui.noalias() += ( Dix - zi );
+		u.segment<9>( r ) = ui;
+		z.segment<9>( r ) = zi;
+	}
+
+	//	Newton's method for the 3 variable (singular value) proximal problems,
+	//	projected onto nonnegative singular values. Variables at zero with the gradient
+	//	pointing outward are held fixed, and the Hessian is shifted toward the identity
+	//	when it isn't positive definite. Returns the number of iterations.
+	template<typename P> static inline int newton_prox( const P &prox, Eigen::Vector3d &x, int max_iters, double grad_tol=1e-8 ){
+		using namespace Eigen;
+		Vector3d g, g_free, p, x_new;
+		Matrix3d H;
+		double f = prox.prox_value( x );
+		int iter = 0;
+		for( ; iter<max_iters; ++iter ){
+
+			prox.prox_gradient( x, g );
+			prox.prox_hessian( x, H );
+			g_free = g;
+			for( int i=0; i<3; ++i ){
+				if( x[i] <= 0.0 && g[i] > 0.0 ){
+					g_free[i] = 0.0;
+					H.row(i).setZero(); H.col(i).setZero(); H(i,i) = 1.0;
+				}
+			}
+			if( g_free.lpNorm<Infinity>() < grad_tol ){ break; }
+
+			// Newton direction, shifted until it's a descent direction
+			const double h_max = H.diagonal().cwiseAbs().maxCoeff();
+			double shift = 0.0;
+			p = -g_free / ( h_max + 1e-12 ); // fallback to gradient descent
+			for( int s=0; s<8; ++s ){
+				LLT<Matrix3d> llt( H + shift*Matrix3d::Identity() );
+				if( llt.info() == Success ){
+					Vector3d p_newton = -llt.solve( g_free );
+					if( p_newton.dot( g_free ) < 0.0 ){ p = p_newton; break; }
+				}
+				shift = ( shift == 0.0 ? 1e-3*h_max + 1e-12 : shift*10.0 );
+			}
+
+			// Backtracking (Armijo) line search along the projected path
+			double alpha = 1.0;
+			double f_new = f;
+			bool accepted = false;
+			for( int ls=0; ls<30; ++ls ){
+				x_new = ( x + alpha*p ).cwiseMax( 0.0 );
+				f_new = prox.prox_value( x_new );
+				if( f_new <= f + 1e-4*g.dot( x_new - x ) ){ accepted = true; break; }
+				alpha *= 0.5;
+			}
+			if( !accepted ){ break; }
+
+			const double step = (x_new-x).squaredNorm();
+			x = x_new;
+			f = f_new;
+			if( step < 1e-24 ){ ++iter; break; }
 		}
+		return iter;
+	}
+
+	// Hyper elastic update for the element at row r, given the oriented svd of F = Dix+ui
+	// (U and V rotations, column major, with the sign of the inversion in S0[2]).
+	// The singular values are minimized with the prox operator, warm started from
+	// sigma which is overwritten with the result.
+	template<typename P> static inline void update_hyperelastic_tet( int r, P &prox, int max_iters,
+		const double *U, const double *S0, const double *V, double *sigma, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ){
+		using namespace Eigen;
+		typedef Matrix<double,9,1> Vector9d;
+
+		// Initialize the problem
+		Vector3d s0( S0[0], S0[1], S0[2] );
+		prox.setSigma0( s0 );
 
-	} // end oriented svd
+		// Initial guess
+		Vector3d x2( sigma[0], sigma[1], sigma[2] );
+
+		// Initial guess needs positive entries
+		if( x2[2] < 0.0 ){ x2[2] *= -1.0; }
+
+		// If everything is very low, this is our collapsed-node test case
+		else if( fabs( x2[0] ) < 1.e-3 && fabs( x2[1] ) < 1.e-3 && fabs( x2[2] ) < 1.e-3 ){
+			x2[0] = 1.e-3; x2[1] = 1.e-3; x2[2] = 1.e-3;
+		}
+
+		// Local minimize with Newton
+		newton_prox( prox, x2, max_iters );
+
+		// Reconstruct with new singular values
+		sigma[0] = x2[0]; sigma[1] = x2[1]; sigma[2] = x2[2];
+		Matrix3d proj = Map<const Matrix3d>( U ) * x2.asDiagonal() * Map<const Matrix3d>( V ).transpose();
+		Map<const Vector9d> zi( proj.data() );
+
+		// Update global vars
+		u.segment<9>( r ) += ( Dx.segment<9>( r ) - zi );
+		z.segment<9>( r ) = zi;
+	}
 
 }
 }
@@ -118,38 +260,93 @@ void LinearTetStrain::initialize( const VectorXd &x, const VectorXd &v, const Ve
 
 void LinearTetStrain::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
 	global_idx = weights.size();
-	helper::init_tet_Di( idx, B, x.size(), triplets );
-	for( int i=global_idx; i<triplets.size(); ++i ){
-		weights.push_back( weight );
-	}
+	helper::init_tet_Di( idx, B, global_idx, triplets );
+	for( int i=0; i<9; ++i ){ weights.push_back( weight ); }
+}
+
+void LinearTetStrain::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	helper::apply_Di_B<4,3>( idx, B.data(), global_idx, x, Dx );
+}
+
+void LinearTetStrain::apply_DiT( const VectorXd &v, VectorXd &Dtv ) const {
+	helper::apply_DiT_B<4,3>( idx, B.data(), global_idx, v, Dtv );
 }
 
 void LinearTetStrain::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
-	typedef Matrix<double,9,1> Vector9d;
-	Vector9d Dix = Dx.segment<9>( global_idx );
-	Vector9d ui = u.segment<9>( global_idx );
-	Vector9d DixPlusUi = Dix+ui;
+	helper::project_linear_tet( global_idx, stiffness*volume, weight, Dx, u, z );
+}
 
-	// Computing F (rearranging terms from 9x1 vector DixPlusUi to make a 3x3)
-	Matrix<double,3,3> F = Map<Matrix<double,3,3> >(DixPlusUi.data());
 
-	// Get some singular values
-	JacobiSVD< Matrix<double,3,3> > svd(F, ComputeFullU | ComputeFullV);
-	Vector3d S = svd.singularValues();
-	S[0]=1.0;S[1]=1.0;S[2]=1.0;
-	if( F.determinant() < 0.0 ){ S[2] = -1.0; }
+//
+//	LinearTetStrainBatch
+//
 
-	// Reconstruct with new singular values
-	Matrix<double,3,3> proj = svd.matrixU() * S.asDiagonal() * svd.matrixV().transpose();
-	Vector9d p = Map<Vector9d>(proj.data());
+int LinearTetStrainBatch::add( int idx0, int idx1, int idx2, int idx3, double stiffness_ ){
+	int p[4] = { idx0, idx1, idx2, idx3 };
+	idx.insert( idx.end(), p, p+4 );
+	stiffness.push_back( stiffness_ );
+	return stiffness.size()-1;
+}
 
-	// Update zi and ui
-	double k = stiffness*volume;
-	Vector9d zi = ( k*p + weight*weight*(DixPlusUi) ) / (weight*weight + k);
+void LinearTetStrainBatch::initialize( const VectorXd &x, const VectorXd &v, const VectorXd &masses, const double timestep ){
+	const int n = size();
+	B.resize( 12*n );
+	volume.resize( n );
+	weight.resize( n );
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){
+		Matrix<double,4,3> Be;
+		Matrix3d edges_inv;
+		helper::init_tet_force( &idx[4*e], x, volume[e], Be, edges_inv );
+		Map< Matrix<double,4,3> >( B.data()+12*e ) = Be;
+		weight[e] = sqrtf(stiffness[e])*sqrtf(volume[e]);
+	}
+}
 
-	ui.noalias() += ( Dix - zi );
-	u.segment<9>( global_idx ) = ui;
-	z.segment<9>( global_idx ) = zi;
+void LinearTetStrainBatch::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
+	const int n = size();
+	global_idx = weights.size();
+	triplets.reserve( triplets.size() + 36*n );
+	weights.reserve( weights.size() + 9*n );
+	for( int e=0; e<n; ++e ){
+		Matrix<double,4,3> Be = Map< const Matrix<double,4,3> >( &B[12*e] );
+		helper::init_tet_Di( &idx[4*e], Be, global_idx+9*e, triplets );
+		for( int i=0; i<9; ++i ){ weights.push_back( weight[e] ); }
+	}
+}
+
+void LinearTetStrainBatch::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
+
+	// Tets are projected in chunks so that the rotations can
+	// be computed with the batched (simd) svd kernel.
+	const int n = size();
+	const int chunk = 64;
+	const int n_chunks = ( n + chunk - 1 ) / chunk;
+#pragma omp parallel for
+	for( int c=0; c<n_chunks; ++c ){
+		const int e0 = c*chunk;
+		const int n_e = std::min( chunk, n-e0 );
+		double F[9*chunk], R[9*chunk];
+		for( int e=0; e<n_e; ++e ){
+			const int r = global_idx+9*(e0+e);
+			for( int i=0; i<9; ++i ){ F[9*e+i] = Dx[r+i] + u[r+i]; }
+		}
+		svd3::polar( n_e, F, R );
+		for( int e=0; e<n_e; ++e ){
+			const int e_i = e0+e;
+			helper::update_linear_tet( global_idx+9*e_i, stiffness[e_i]*volume[e_i], weight[e_i], &R[9*e], Dx, u, z );
+		}
+	}
+}
+
+void LinearTetStrainBatch::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	const int n = size();
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){ helper::apply_Di_B<4,3>( &idx[4*e], &B[12*e], global_idx+9*e, x, Dx ); }
+}
+
+void LinearTetStrainBatch::apply_DiT_range( int begin, int end, const VectorXd &v, VectorXd &Dtv ) const {
+	for( int e=begin; e<end; ++e ){ helper::apply_DiT_B<4,3>( &idx[4*e], &B[12*e], global_idx+9*e, v, Dtv ); }
 }
 
 //
@@ -164,56 +361,85 @@ void TetVolume::initialize( const VectorXd &x, const VectorXd &v, const VectorXd
 
 void TetVolume::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
 	global_idx = weights.size();
-	helper::init_tet_Di( idx, B, x.size(), triplets );
-	for( int i=global_idx; i<triplets.size(); ++i ){
-		weights.push_back( weight );
-	}
+	helper::init_tet_Di( idx, B, global_idx, triplets );
+	for( int i=0; i<9; ++i ){ weights.push_back( weight ); }
+}
+
+void TetVolume::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	helper::apply_Di_B<4,3>( idx, B.data(), global_idx, x, Dx );
+}
+
+void TetVolume::apply_DiT( const VectorXd &v, VectorXd &Dtv ) const {
+	helper::apply_DiT_B<4,3>( idx, B.data(), global_idx, v, Dtv );
 }
 
 void TetVolume::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
+	helper::project_tet_volume( global_idx, stiffness*rest_volume, weight, limit_min, limit_max, Dx, u, z );
+}
 
-	typedef Matrix<double,9,1> Vector9d;
-	Vector9d Dix = Dx.segment<9>( global_idx );
-	Vector9d ui = u.segment<9>( global_idx );
-	Vector9d DixPlusUi = Dix+ui;
+//
+//	TetVolumeBatch
+//
 
-	// Computing F (rearranging terms from 9x1 vector DixPlusUi to make a 3x3)
-	Matrix<double,3,3> F = Map<Matrix<double,3,3> >(DixPlusUi.data());
-
-	// Get some singular values
-	JacobiSVD< Matrix<double,3,3> > svd(F, ComputeFullU | ComputeFullV);
-	Vector3d S = svd.singularValues();
-	Eigen::Vector3d d(0,0,0);
-
-	for(int i = 0; i < 4; i++){
-		double detS = S[0] * S[1] * S[2];
-		double f = detS - std::min( std::max(detS,limit_min) , limit_max );
-		Eigen::Vector3d g( S[1]*S[2] , S[0]*S[2] , S[0]*S[1] );
-		d = -((f - g.dot(d)) / g.dot(g)) * g;
-		S = svd.singularValues() + d;
-	}
+int TetVolumeBatch::add( int idx0, int idx1, int idx2, int idx3, double stiffness_, double limit_min_, double limit_max_ ){
+	int p[4] = { idx0, idx1, idx2, idx3 };
+	idx.insert( idx.end(), p, p+4 );
+	stiffness.push_back( stiffness_ );
+	limit_min.push_back( limit_min_ );
+	limit_max.push_back( limit_max_ );
+	return stiffness.size()-1;
+}
 
-	if( F.determinant() < 0.0 ){ S[2] = -1.0; }
+void TetVolumeBatch::initialize( const VectorXd &x, const VectorXd &v, const VectorXd &masses, const double timestep ){
+	const int n = size();
+	B.resize( 12*n );
+	rest_volume.resize( n );
+	weight.resize( n );
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){
+		Matrix<double,4,3> Be;
+		Matrix3d edges_inv;
+		helper::init_tet_force( &idx[4*e], x, rest_volume[e], Be, edges_inv );
+		Map< Matrix<double,4,3> >( B.data()+12*e ) = Be;
+		weight[e] = sqrtf(stiffness[e])*sqrtf(rest_volume[e]);
+	}
+}
 
-	// Reconstruct with new singular values
-	Matrix<double,3,3> proj = svd.matrixU() * S.asDiagonal() * svd.matrixV().transpose();
-	Vector9d p = Map<Vector9d>(proj.data());
+void TetVolumeBatch::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
+	const int n = size();
+	global_idx = weights.size();
+	triplets.reserve( triplets.size() + 36*n );
+	weights.reserve( weights.size() + 9*n );
+	for( int e=0; e<n; ++e ){
+		Matrix<double,4,3> Be = Map< const Matrix<double,4,3> >( &B[12*e] );
+		helper::init_tet_Di( &idx[4*e], Be, global_idx+9*e, triplets );
+		for( int i=0; i<9; ++i ){ weights.push_back( weight[e] ); }
+	}
+}
 
-	// Update zi and ui
-	double k = stiffness*rest_volume;
-	Vector9d zi = ( k*p + weight*weight*(DixPlusUi) ) / (weight*weight + k);
+void TetVolumeBatch::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
+	const int n = size();
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){
+		helper::project_tet_volume( global_idx+9*e, stiffness[e]*rest_volume[e], weight[e], limit_min[e], limit_max[e], Dx, u, z );
+	}
+}
 
-	ui.noalias() += ( Dix - zi );
-	u.segment<9>( global_idx ) = ui;
-	z.segment<9>( global_idx ) = zi;
+void TetVolumeBatch::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	const int n = size();
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){ helper::apply_Di_B<4,3>( &idx[4*e], &B[12*e], global_idx+9*e, x, Dx ); }
+}
 
+void TetVolumeBatch::apply_DiT_range( int begin, int end, const VectorXd &v, VectorXd &Dtv ) const {
+	for( int e=begin; e<end; ++e ){ helper::apply_DiT_B<4,3>( &idx[4*e], &B[12*e], global_idx+9*e, v, Dtv ); }
 }
 
 //
 //	NeoHookeanTet
 //
 
-double NHProx::energyDensity( const cppoptlib::Vector<double> &Sigma ) const {
+double NHProx::energyDensity( const Eigen::Vector3d &Sigma ) const {
 	double Sig_det = (Sigma[0]*Sigma[1]*Sigma[2]);
 	double I_1 = Sigma[0]*Sigma[0]+Sigma[1]*Sigma[1]+Sigma[2]*Sigma[2];
 	double I_3 = Sig_det*Sig_det;
@@ -225,48 +451,51 @@ double NHProx::energyDensity( const cppoptlib::Vector<double> &Sigma ) const {
 }
 
 // Compute objective function (prox operator)
-double NHProx::value(const cppoptlib::Vector<double> &x) {
+double NHProx::prox_value(const Eigen::Vector3d &x) const {
 	if( x[0]<0.0 || x[1]<0.0 || x[2]<0.0 ){ return std::numeric_limits<float>::max(); }
 	double r = energyDensity( x );
 	double r2 = (k*0.5) * (x-Sigma_init).squaredNorm();
 	return ( scaleConst*r + r2 );
 }
 
-void NHProx::gradient(const cppoptlib::Vector<double> &x, cppoptlib::Vector<double> &grad){
+void NHProx::prox_gradient(const Eigen::Vector3d &x, Eigen::Vector3d &grad) const {
 	double detSigma = x[0]*x[1]*x[2];
 	if( detSigma <= 0.0 ){
-		grad = VectorXd::Ones(3) * std::numeric_limits<float>::max();
+		grad = Vector3d::Ones() * std::numeric_limits<float>::max();
 	} else {
 		Eigen::Vector3d invSigma(1.0/x[0],1.0/x[1],1.0/x[2]);
 		grad = scaleConst*(mu * (x - invSigma) + lambda * log(detSigma) * invSigma) + k*(x-Sigma_init);
-	}  
+	}
 }
 
-void NHProx::hessian(const cppoptlib::Vector<double> &x, cppoptlib::Matrix<double> &hessian){
-	Eigen::Vector3d Sigma(x[0],x[1],x[2]);
+void NHProx::prox_hessian(const Eigen::Vector3d &x, Eigen::Matrix3d &hess) const {
 	Eigen::Vector3d invSigma(1.0/x[0],1.0/x[1],1.0/x[2]);
-	double detSigma = Sigma[0] * Sigma[1] * Sigma[2];
-	Eigen::Matrix3d invSigmaSqMat;
-	invSigmaSqMat.setZero();
-	invSigmaSqMat(0,0) = 1.0 / (Sigma[0]*Sigma[0]);
-	invSigmaSqMat(1,1) = 1.0 / (Sigma[1]*Sigma[1]);
-	invSigmaSqMat(2,2) = 1.0 / (Sigma[2]*Sigma[2]);
-	Eigen::Matrix3d I;
-	I.setIdentity();
-	Eigen::Matrix3d hess = mu*(I - 2.0*invSigmaSqMat) + lambda*log(detSigma)*invSigmaSqMat
-	                       + lambda * invSigma * invSigma.transpose() + k*I;
-	for(int i = 0; i < 3; i++){
-		for(int j = 0; j < 3; j++){
-			hessian(i,j) = hess(i,j);
-		}
-	}
+	double detSigma = x[0] * x[1] * x[2];
+	Eigen::Vector3d invSigmaSq = invSigma.cwiseProduct( invSigma );
+	hess = scaleConst * ( lambda * invSigma * invSigma.transpose() );
+	hess.diagonal() += scaleConst * ( mu*(Vector3d::Ones() + invSigmaSq) - lambda*log(detSigma)*invSigmaSq );
+	hess.diagonal().array() += k;
+}
+
+double NHProx::value(const cppoptlib::Vector<double> &x) {
+	return prox_value( Vector3d(x[0],x[1],x[2]) );
+}
+
+void NHProx::gradient(const cppoptlib::Vector<double> &x, cppoptlib::Vector<double> &grad){
+	Vector3d g; prox_gradient( Vector3d(x[0],x[1],x[2]), g );
+	grad = g;
+}
+
+void NHProx::hessian(const cppoptlib::Vector<double> &x, cppoptlib::Matrix<double> &hessian){
+	Matrix3d h; prox_hessian( Vector3d(x[0],x[1],x[2]), h );
+	hessian = h;
 }
 
 //
 //	St. VK tet
 //
 
-double StVKProx::energyDensity( Vector3d &Sigma ) const {
+double StVKProx::energyDensity( const Vector3d &Sigma ) const {
 	Eigen::Vector3d I(1.0,1.0,1.0);
 	Eigen::Vector3d Sigma2( Sigma[0]*Sigma[0], Sigma[1]*Sigma[1], Sigma[2]*Sigma[2] );
 
@@ -278,15 +507,14 @@ double StVKProx::energyDensity( Vector3d &Sigma ) const {
 }
 
 // Compute objective function (prox operator)
-double StVKProx::value(const cppoptlib::Vector<double> &x) {
+double StVKProx::prox_value(const Eigen::Vector3d &x) const {
 	if( x[0]<0.0 || x[1]<0.0 || x[2]<0.0 ){ return std::numeric_limits<float>::max(); }
-	Eigen::Vector3d Sigma(x[0],x[1],x[2]);
-	double r = energyDensity( Sigma );
-	double r2 = (k*0.5) * (Sigma-this->Sigma_init).squaredNorm();
+	double r = energyDensity( x );
+	double r2 = (k*0.5) * (x-this->Sigma_init).squaredNorm();
 	return (r+r2);
 }
 
-void StVKProx::gradient(const cppoptlib::Vector<double> &x, cppoptlib::Vector<double> &grad){
+void StVKProx::prox_gradient(const Eigen::Vector3d &x, Eigen::Vector3d &grad) const {
 	Eigen::Vector3d term1;
 	term1[0] = mu * x[0]*(x[0]*x[0] - 1.0);
 	term1[1] = mu * x[1]*(x[1]*x[1] - 1.0);
@@ -296,6 +524,28 @@ void StVKProx::gradient(const cppoptlib::Vector<double> &x, cppoptlib::Vector<do
 	grad = term1 + term2 + k*(x-Sigma_init);
 }
 
+void StVKProx::prox_hessian(const Eigen::Vector3d &x, Eigen::Matrix3d &hess) const {
+	// d/dx of the gradient terms above
+	hess = lambda * x * x.transpose();
+	for( int i=0; i<3; ++i ){
+		hess(i,i) += mu*(3.0*x[i]*x[i] - 1.0) + 0.5*lambda*( x.dot(x) - 3.0 ) + k;
+	}
+}
+
+double StVKProx::value(const cppoptlib::Vector<double> &x) {
+	return prox_value( Vector3d(x[0],x[1],x[2]) );
+}
+
+void StVKProx::gradient(const cppoptlib::Vector<double> &x, cppoptlib::Vector<double> &grad){
+	Vector3d g; prox_gradient( Vector3d(x[0],x[1],x[2]), g );
+	grad = g;
+}
+
+void StVKProx::hessian(const cppoptlib::Vector<double> &x, cppoptlib::Matrix<double> &hessian){
+	Matrix3d h; prox_hessian( Vector3d(x[0],x[1],x[2]), h );
+	hessian = h;
+}
+
 //
 //	The Hyper Elastic Force class
 //
@@ -303,64 +553,130 @@ void StVKProx::gradient(const cppoptlib::Vector<double> &x, cppoptlib::Vector<do
 void HyperElasticTet::initialize( const VectorXd &x, const VectorXd &v, const VectorXd &masses, const double timestep ){
 	helper::init_tet_force( idx, x, volume, B, edges_inv );
 
-	double stiff = std::min(mu,lambda); // what should k be?
-	weight = sqrtf(stiff)*sqrtf(volume);
-	stvkprox = std::shared_ptr<StVKProx>( new StVKProx(mu,lambda,stiff) );
-	nhprox = std::shared_ptr<NHProx>( new NHProx(mu,lambda,stiff) );
+	k = std::min(mu,lambda); // what should k be?
+	weight = sqrtf(k)*sqrtf(volume);
+	last_prox_result.fill(1.0);
 }
 
 void HyperElasticTet::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
 	global_idx = weights.size();
-	helper::init_tet_Di( idx, B, x.size(), triplets );
-	for( int i=global_idx; i<triplets.size(); ++i ){
-		weights.push_back( weight );
-	}
+	helper::init_tet_Di( idx, B, global_idx, triplets );
+	for( int i=0; i<9; ++i ){ weights.push_back( weight ); }
 }
 
-void HyperElasticTet::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
+void HyperElasticTet::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	helper::apply_Di_B<4,3>( idx, B.data(), global_idx, x, Dx );
+}
 
-	typedef Matrix<double,9,1> Vector9d;
-	Vector9d Dix = Dx.segment<9>( global_idx );
-	Vector9d ui = u.segment<9>( global_idx );
-	Vector9d DixPlusUi = Dix+ui;
+void HyperElasticTet::apply_DiT( const VectorXd &v, VectorXd &Dtv ) const {
+	helper::apply_DiT_B<4,3>( idx, B.data(), global_idx, v, Dtv );
+}
+
+void HyperElasticTet::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
 
 	// Computing F (rearranging terms from 9x1 vector DixPlusUi to make a 3x3)
-	Matrix3d F = Map<Matrix3d>(DixPlusUi.data());
+	Matrix3d F = Map<const Matrix3d>( Dx.data()+global_idx ) + Map<const Matrix3d>( u.data()+global_idx );
 
 	// SVD of deform grad (model reduction, faster solve)
-	Vector3d S0; Matrix3d U, Vt;
-	helper::oriented_svd( F, S0, U, Vt );
+	Vector3d S0; Matrix3d U, V;
+	svd3::svd( F, U, S0, V );
+
+	switch( type ){
+		case 0: {
+			NHProx prox( mu, lambda, k );
+			helper::update_hyperelastic_tet( global_idx, prox, max_iters, U.data(), S0.data(), V.data(), last_prox_result.data(), Dx, u, z );
+		} break;
+		case 1: {
+			StVKProx prox( mu, lambda, k );
+			helper::update_hyperelastic_tet( global_idx, prox, max_iters, U.data(), S0.data(), V.data(), last_prox_result.data(), Dx, u, z );
+		} break;
+	}
+}
 
-	// Initialize the problem
-	nhprox->setSigma0( S0 );
-	stvkprox->setSigma0( S0 );
+//
+//	HyperElasticTetBatch
+//
 
-	// Initial guess
-	Eigen::VectorXd x2 = last_prox_result;
+int HyperElasticTetBatch::add( int idx0, int idx1, int idx2, int idx3, double mu_, double lambda_, int max_iterations, std::string type_ ){
+	int p[4] = { idx0, idx1, idx2, idx3 };
+	idx.insert( idx.end(), p, p+4 );
+	mu.push_back( mu_ );
+	lambda.push_back( lambda_ );
+	max_iters.push_back( max_iterations );
+	type.push_back( ( type_=="stvk" || type_=="1" ) ? 1 : 0 );
+	sigma.insert( sigma.end(), 3, 1.0 );
+	return mu.size()-1;
+}
 
-	// Initial guess needs positive entries
-	if( x2[2] < 0.0 ){ x2[2] *= -1.0; }
+void HyperElasticTetBatch::initialize( const VectorXd &x, const VectorXd &v, const VectorXd &masses, const double timestep ){
+	const int n = size();
+	B.resize( 12*n );
+	k.resize( n );
+	volume.resize( n );
+	weight.resize( n );
+	sigma.assign( 3*n, 1.0 );
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){
+		Matrix<double,4,3> Be;
+		Matrix3d edges_inv;
+		helper::init_tet_force( &idx[4*e], x, volume[e], Be, edges_inv );
+		Map< Matrix<double,4,3> >( B.data()+12*e ) = Be;
+		k[e] = std::min( mu[e], lambda[e] );
+		weight[e] = sqrtf(k[e])*sqrtf(volume[e]);
+	}
+}
 
-	// If everything is very low, this is our collapsed-node test case
-	else if( fabs( x2[0] ) < 1.e-3 && fabs( x2[1] ) < 1.e-3 && fabs( x2[2] ) < 1.e-3 ){
-		x2[0] = 1.e-3; x2[1] = 1.e-3; x2[2] = 1.e-3;
+void HyperElasticTetBatch::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
+	const int n = size();
+	global_idx = weights.size();
+	triplets.reserve( triplets.size() + 36*n );
+	weights.reserve( weights.size() + 9*n );
+	for( int e=0; e<n; ++e ){
+		Matrix<double,4,3> Be = Map< const Matrix<double,4,3> >( &B[12*e] );
+		helper::init_tet_Di( &idx[4*e], Be, global_idx+9*e, triplets );
+		for( int i=0; i<9; ++i ){ weights.push_back( weight[e] ); }
 	}
+}
 
-	// Local minimize with L-BFGS
-	switch( type ){
-		case 0: solver->minimize(*(nhprox.get()), x2); break;
-		case 1: solver->minimize(*(stvkprox.get()), x2); break;
+void HyperElasticTetBatch::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
+
+	// Tets are projected in chunks so that the svds can be computed
+	// with the batched (simd) kernel. All scratch is on the stack.
+	const int n = size();
+	const int chunk = 64;
+	const int n_chunks = ( n + chunk - 1 ) / chunk;
+#pragma omp parallel for
+	for( int c=0; c<n_chunks; ++c ){
+		const int e0 = c*chunk;
+		const int n_e = std::min( chunk, n-e0 );
+		double F[9*chunk], U[9*chunk], S[3*chunk], V[9*chunk];
+		for( int e=0; e<n_e; ++e ){
+			const int r = global_idx+9*(e0+e);
+			for( int i=0; i<9; ++i ){ F[9*e+i] = Dx[r+i] + u[r+i]; }
+		}
+		svd3::svd( n_e, F, U, S, V );
+		for( int e=0; e<n_e; ++e ){
+			const int e_i = e0+e;
+			const int r = global_idx+9*e_i;
+			if( type[e_i] == 0 ){
+				NHProx prox( mu[e_i], lambda[e_i], k[e_i] );
+				helper::update_hyperelastic_tet( r, prox, max_iters[e_i], &U[9*e], &S[3*e], &V[9*e], &sigma[3*e_i], Dx, u, z );
+			} else {
+				StVKProx prox( mu[e_i], lambda[e_i], k[e_i] );
+				helper::update_hyperelastic_tet( r, prox, max_iters[e_i], &U[9*e], &S[3*e], &V[9*e], &sigma[3*e_i], Dx, u, z );
+			}
+		}
 	}
+}
 
-	// Reconstruct with new singular values
-	last_prox_result = x2;
-	Matrix3d proj = U * x2.asDiagonal() * Vt;
-	Vector9d zi = Map<Vector9d>(proj.data());
+void HyperElasticTetBatch::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	const int n = size();
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){ helper::apply_Di_B<4,3>( &idx[4*e], &B[12*e], global_idx+9*e, x, Dx ); }
+}
 
-	// Update global vars
-	ui.noalias() += ( Dix - zi );
-	u.segment<9>( global_idx ) = ui;
-	z.segment<9>( global_idx ) = zi;
+void HyperElasticTetBatch::apply_DiT_range( int begin, int end, const VectorXd &v, VectorXd &Dtv ) const {
+	for( int e=begin; e<end; ++e ){ helper::apply_DiT_B<4,3>( &idx[4*e], &B[12*e], global_idx+9*e, v, Dtv ); }
 }
 
 
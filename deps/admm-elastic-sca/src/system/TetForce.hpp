@@ -37,6 +37,10 @@ public:
 	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
 	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
 	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
+	bool matrix_free() const { return true; }
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	const char *name() const { return "LinearTetStrain"; }
 
 
 	int idx[4];
@@ -46,6 +50,29 @@ public:
 
 }; // end class LinearTetStrain
 
+//
+//	Linear Tet Strain Batch
+//	Same as LinearTetStrain, for all tets in flat arrays.
+//
+class LinearTetStrainBatch : public ForceBatch {
+public:
+	// Adds a tet and returns its index in the batch
+	int add( int idx0, int idx1, int idx2, int idx3, double stiffness_ );
+
+	int size() const { return stiffness.size(); }
+	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
+	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
+	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT_range( int begin, int end, const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	const char *name() const { return "LinearTetStrain"; }
+
+	std::vector<int> idx; // 4 per tet
+	std::vector<double> B; // 4x3 (column major) per tet
+	std::vector<double> stiffness, volume, weight;
+
+}; // end class LinearTetStrainBatch
+
 //
 //	Linear Tet Volume
 //
@@ -57,6 +84,10 @@ public:
 	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
 	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
 	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
+	bool matrix_free() const { return true; }
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	const char *name() const { return "TetVolume"; }
 
 	int idx[4];
 	Eigen::Matrix3d edges_inv; // used for piola stress
@@ -66,6 +97,29 @@ public:
 
 }; // end class TetVolume
 
+//
+//	TetVolumeBatch
+//	Same as TetVolume, for all tets in flat arrays.
+//
+class TetVolumeBatch : public ForceBatch {
+public:
+	// Adds a tet and returns its index in the batch
+	int add( int idx0, int idx1, int idx2, int idx3, double stiffness_, double limit_min_, double limit_max_ );
+
+	int size() const { return stiffness.size(); }
+	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
+	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
+	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT_range( int begin, int end, const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	const char *name() const { return "TetVolume"; }
+
+	std::vector<int> idx; // 4 per tet
+	std::vector<double> B; // 4x3 (column major) per tet
+	std::vector<double> stiffness, limit_min, limit_max, rest_volume, weight;
+
+}; // end class TetVolumeBatch
+
 //
 //	NeoHookean Hyper Elastic
 //
@@ -76,10 +130,16 @@ public:
 	NHProx(double scaleConst_, double mu_, double lambda_, double k_ ) : scaleConst(scaleConst_), mu(mu_), lambda(lambda_), k(k_) {}
 	NHProx(double mu_, double lambda_, double k_) : mu(mu_), lambda(lambda_), k(k_) { scaleConst = 1.0; }
 	void setSigma0( Eigen::Vector3d &Sigma_init_ ){ Sigma_init=Sigma_init_; }
-	double energyDensity( const cppoptlib::Vector<double> &sigma) const;
+	double energyDensity( const Eigen::Vector3d &sigma) const;
 	double value(const cppoptlib::Vector<double> &x);
 	void gradient(const cppoptlib::Vector<double> &x, cppoptlib::Vector<double> &grad);
 	void hessian(const cppoptlib::Vector<double> &x, cppoptlib::Matrix<double> &hess);
+
+	// Fixed size (allocation free) versions used by the Newton solver
+	double prox_value(const Eigen::Vector3d &x) const;
+	void prox_gradient(const Eigen::Vector3d &x, Eigen::Vector3d &grad) const;
+	void prox_hessian(const Eigen::Vector3d &x, Eigen::Matrix3d &hess) const;
+
 	Eigen::Vector3d Sigma_init;
 	double scaleConst, mu, lambda, k;
 
@@ -94,12 +154,19 @@ class StVKProx : public cppoptlib::Problem<double> {
 public:
 	StVKProx(double mu_, double lambda_, double k_) : mu(mu_), lambda(lambda_), k(k_) {}
 	void setSigma0( Eigen::Vector3d &Sigma_init_ ){ Sigma_init=Sigma_init_; }
-	double energyDensity( Eigen::Vector3d &Sigma ) const;
+	double energyDensity( const Eigen::Vector3d &Sigma ) const;
 	double value(const cppoptlib::Vector<double> &x);
 	void gradient(const cppoptlib::Vector<double> &x, cppoptlib::Vector<double> &grad);
+	void hessian(const cppoptlib::Vector<double> &x, cppoptlib::Matrix<double> &hess);
+
+	// Fixed size (allocation free) versions used by the Newton solver
+	double prox_value(const Eigen::Vector3d &x) const;
+	void prox_gradient(const Eigen::Vector3d &x, Eigen::Vector3d &grad) const;
+	void prox_hessian(const Eigen::Vector3d &x, Eigen::Matrix3d &hess) const;
+
 	Eigen::Vector3d Sigma_init;
 	double mu, lambda, k;
-	static inline double ddot( Eigen::Vector3d &a, Eigen::Vector3d &b ) { return (a*b.transpose()).trace(); }
+	static inline double ddot( const Eigen::Vector3d &a, const Eigen::Vector3d &b ) { return a.dot(b); }
 	static inline double v3trace( const Eigen::Vector3d &v ) { return v[0]+v[1]+v[2]; }
 }; // end class StVKProx
 
@@ -116,36 +183,59 @@ public:
 class HyperElasticTet : public Force {
 public:
 	HyperElasticTet( int idx0_, int idx1_, int idx2_, int idx3_, double mu_, double lambda_, int max_iterations, std::string type_ ) :
-		mu(mu_), lambda(lambda_) {
+		mu(mu_), lambda(lambda_), max_iters(max_iterations) {
 		idx[0]=idx0_; idx[1]=idx1_; idx[2]=idx2_; idx[3]=idx3_;
 		type = 0; if( type_=="stvk" || type_=="1" ){ type=1; }
-
-		// Set up the local solver
-		solver = std::unique_ptr< cppoptlib::ISolver<double, 1> >( new cppoptlib::lbfgssolver<double> );
-		solver->settings_.maxIter = max_iterations;
-		solver->settings_.gradTol = 1e-8;
-		last_prox_result.resize(3);
 		last_prox_result.fill(1.0);
 	}
 
 	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
 	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
 	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
-
-	std::shared_ptr<NHProx> nhprox;
-	std::shared_ptr<StVKProx> stvkprox;
-	std::unique_ptr< cppoptlib::ISolver<double, 1> > solver;
-
+	bool matrix_free() const { return true; }
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	const char *name() const { return "HyperElasticTet"; }
 
 	int idx[4];
 	int type;
 	double mu, lambda, volume;
+	double k; // prox stiffness
+	int max_iters; // of the local Newton solve
 	Eigen::Matrix3d edges_inv; // used for piola stress
 	Eigen::Matrix<double,4,3> B;
-	mutable cppoptlib::Vector<double> last_prox_result;
+	mutable Eigen::Vector3d last_prox_result; // warm start, only touched by this element, reset by initialize
 
 }; // end class HyperElastic
 
+//
+//	Batch of hyper elastic tets. The warm start singular values are kept in a
+//	flat array (3 per tet), and each element only writes its own entries so
+//	projection is thread safe. Prox problems live on the stack, so the
+//	project path doesn't allocate.
+//
+class HyperElasticTetBatch : public ForceBatch {
+public:
+	// Adds a tet and returns its index in the batch. Type is "nh" or "stvk".
+	int add( int idx0, int idx1, int idx2, int idx3, double mu_, double lambda_, int max_iterations, std::string type_ );
+
+	int size() const { return mu.size(); }
+	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
+	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
+	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT_range( int begin, int end, const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	const char *name() const { return "HyperElasticTet"; }
+
+	std::vector<int> idx; // 4 per tet
+	std::vector<double> B; // 4x3 (column major) per tet
+	std::vector<double> mu, lambda, k, volume, weight;
+	std::vector<int> max_iters;
+	std::vector<char> type; // 0 = nh, 1 = stvk
+	mutable std::vector<double> sigma; // 3 per tet, warm start for the prox solve, reset by initialize
+
+}; // end class HyperElasticTetBatch
+
 
 } // end namespace admm
 
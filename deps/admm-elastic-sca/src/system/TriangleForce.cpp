@@ -18,98 +18,283 @@
 // OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "TriangleForce.hpp"
+#include "SVD3.hpp"
 
 using namespace admm;
 using namespace Eigen;
 
+namespace admm {
+namespace helper {
+
+	static inline void init_triangle_force( const int *idx, const Eigen::VectorXd &x, double &area, Eigen::Matrix<double,3,2> &B ){
+		using namespace Eigen;
+
+		assert(3*idx[0]+2 < x.size());
+		assert(3*idx[1]+2 < x.size());
+		assert(3*idx[2]+2 < x.size());
+
+		Vector3d x1( x(3*idx[0]+0), x(3*idx[0]+1), x(3*idx[0]+2) );
+		Vector3d x2( x(3*idx[1]+0), x(3*idx[1]+1), x(3*idx[1]+2) );
+		Vector3d x3( x(3*idx[2]+0), x(3*idx[2]+1), x(3*idx[2]+2) );
+
+		Matrix<double,3,2> D;
+		D(0,0) = -1; D(0,1) = -1;
+		D(1,0) =  1; D(1,1) =  0;
+		D(2,0) =  0; D(2,1) =  1;
+
+		Vector3d e12 = x2 - x1;
+		Vector3d e13 = x3 - x1;
+		Vector3d n1 = e12.normalized();
+		Vector3d n2 = (e13 - e13.dot(n1)*n1).normalized();
+
+		Eigen::Matrix<double,3,2> basis;
+		Eigen::Matrix<double,3,2> edges;
+
+		basis.col(0) = n1; basis.col(1) = n2;
+		edges.col(0) = e12; edges.col(1) = e13;
+
+		Matrix<double,2,2> Xg = (basis.transpose() * edges);
+
+		B = D * Xg.inverse();
+
+		area = std::abs((basis.transpose() * edges).determinant() / 2.0f);
+	}
+
+	static inline void init_triangle_Di( const int *idx, const double *B, const int constraint_idx, std::vector<Eigen::Triplet<double> > &triplets ){
+		// B is 3x2 column major
+		for( int i=0; i<3; ++i ){
+			for( int j=0; j<3; ++j ){
+				triplets.push_back( Eigen::Triplet<double>(i+constraint_idx, 3*idx[j]+i, B[j] ) );
+				triplets.push_back( Eigen::Triplet<double>(3+i+constraint_idx, 3*idx[j]+i, B[3+j] ) );
+			}
+		}
+	}
+
+	// Strain limited triangle update for the element at row r, with k = stiffness*area,
+	// given the closest orthonormal 3x2 matrix R (column major) to F = Dix+ui.
+	static inline void update_limited_triangle( int r, double k, double weight, bool strain_limiting, double limit_min, double limit_max,
+		const double *R, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ){
+		using namespace Eigen;
+		typedef Matrix<double,6,1> Vector6d;
+		Vector6d Dix = Dx.segment<6>( r );
+		Vector6d ui = u.segment<6>( r );
+		Vector6d DixPlusUi = Dix+ui;
+		Map<const Vector6d> p( R );
+
+		// Update zi and ui
+		Vector6d zi = ( k*p + weight*weight*(DixPlusUi) ) / ( weight*weight + k );
+
+		if( strain_limiting ){
+			double l_col0 = zi.head<3>().norm();
+			double l_col1 = zi.tail<3>().norm();
+			if( l_col0 < limit_min ){ zi.head<3>() *= ( limit_min / fmaxf( l_col0, 1e-6 ) ); }
+			if( l_col1 < limit_min ){ zi.tail<3>() *= ( limit_min / fmaxf( l_col1, 1e-6 ) ); }
+			if( l_col0 > limit_max ){ zi.head<3>() *= ( limit_max / fmaxf( l_col0, 1e-6 ) ); }
+			if( l_col1 > limit_max ){ zi.tail<3>() *= ( limit_max / fmaxf( l_col1, 1e-6 ) ); }
+		}
+
+		// update u and z
+		ui.noalias() += ( Dix - zi );
+		u.segment<6>( r ) = ui;
+		z.segment<6>( r ) = zi;
+	}
+
+	// Same as above, but computes the projection from Dx and u
+	static inline void project_limited_triangle( int r, double k, double weight, bool strain_limiting, double limit_min, double limit_max,
+		const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ){
+		using namespace Eigen;
+
+		// Computing F (rearranging terms from 6x1 vector DixPlusUi to make a 3x2)
+		Matrix<double,3,2> F = Map<const Matrix<double,3,2> >( Dx.data()+r ) + Map<const Matrix<double,3,2> >( u.data()+r );
+
+		// The matrix T = U*Vt from the closed form 3x2 svd
+		Matrix<double,3,2> T;
+		svd3::polar( F, T );
+		update_limited_triangle( r, k, weight, strain_limiting, limit_min, limit_max, T.data(), Dx, u, z );
+	}
+
+	static inline double aclamp( double v, double min, double max ){
+		v = ( v < max ? v : max );
+		v = ( v > min ? v : min );
+		return v;
+	}
+
+	// Area limited triangle update for the element at row r, with k = stiffness*area
+	static inline void project_tri_area( int r, double k, double weight, int iters, double limit_min, double limit_max,
+		const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ){
+		using namespace Eigen;
+		typedef Matrix<double,6,1> Vector6d;
+		Vector6d Dix = Dx.segment<6>( r );
+		Vector6d ui = u.segment<6>( r );
+		Vector6d DixPlusUi = Dix+ui;
+
+		// Computing F (rearranging terms from 6x1 vector AixPlusUi to make a 3x2)
+		Matrix<double,3,2> F = Map<Matrix<double,3,2> >(DixPlusUi.data());
+
+		// Compute the singular value decomposition
+		Matrix<double,3,2> U; Eigen::Vector2d S0; Matrix2d V;
+		svd3::svd( F, U, S0, V );
+		Eigen::Vector2d S = S0;
+		Eigen::Vector2d d(0.0f, 0.0f);
+		for (int i = 0; i < iters; ++i) {
+			double v = S(0) * S(1);
+			double f = v - aclamp(v, limit_min, limit_max);
+			Eigen::Vector2d g(S(1), S(0));
+			d = -((f - g.dot(d)) / g.dot(g)) * g;
+			S = S0 + d;
+		}
+
+		// Reconstruct F and compute projection
+		F = U * S.asDiagonal() * V.transpose();
+		Vector6d p = Map<Vector6d>(F.data());
+
+		// Update zi and ui
+		Vector6d zi = ( k*p + weight*weight*(DixPlusUi) ) / ( weight*weight + k );
+
+		// update u and z
+		ui.noalias() += ( Dix - zi );
+		u.segment<6>( r ) = ui;
+		z.segment<6>( r ) = zi;
+	}
+
+	// Fung update for the element at row r, minimizing the prox problem over the singular values
+	static inline void project_fung( int r, FungProx &prox, cppoptlib::ISolver<double,1> &solver,
+		const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ){
+		using namespace Eigen;
+		typedef Matrix<double,6,1> Vector6d;
+		Vector6d Dix = Dx.segment<6>( r );
+		Vector6d ui = u.segment<6>( r );
+		Vector6d DixPlusUi = Dix+ui;
+
+		// Computing F (rearranging terms from 6x1 vector AixPlusUi to make a 3x2)
+		Matrix<double,3,2> F = Map<Matrix<double,3,2> >(DixPlusUi.data());
+		Matrix<double,3,2> U; Vector2d S; Matrix2d V;
+		svd3::svd( F, U, S, V );
+		cppoptlib::Vector<double> x2 = S;
+
+		// Minimize
+		prox.setSigma0( Eigen::Vector2d(x2[0],x2[1]) );
+		solver.minimize( prox, x2 );
+
+		// Reform F
+		F = U * x2.asDiagonal() * V.transpose();
+		Vector6d zi = Map<Vector6d>(F.data());
+
+		// update u and z
+		ui.noalias() += ( Dix - zi );
+		u.segment<6>( r ) = ui;
+		z.segment<6>( r ) = zi;
+	}
+
+}
+}
+
 //
 //	TriangleStrain
 //
 
 void LimitedTriangleStrain::initialize( const VectorXd &x, const VectorXd &v, const VectorXd &masses, const double timestep ){
-
-	assert(3*id0+2 < x.size());
-	assert(3*id1+2 < x.size());
-	assert(3*id2+2 < x.size());
-
-	Vector3d x1( x(3*id0+0), x(3*id0+1), x(3*id0+2) );
-	Vector3d x2( x(3*id1+0), x(3*id1+1), x(3*id1+2) );
-	Vector3d x3( x(3*id2+0), x(3*id2+1), x(3*id2+2) );
-
-	Matrix<double,3,2> D;
-	D(0,0) = -1; D(0,1) = -1;
-	D(1,0) =  1; D(1,1) =  0;
-	D(2,0) =  0; D(2,1) =  1;
-
-	Vector3d e12 = x2 - x1;
-	Vector3d e13 = x3 - x1;
-	Vector3d n1 = e12.normalized();
-	Vector3d n2 = (e13 - e13.dot(n1)*n1).normalized();
-
-	Eigen::Matrix<double,3,2> basis;
-	Eigen::Matrix<double,3,2> edges;
-
-	basis.col(0) = n1; basis.col(1) = n2;
-	edges.col(0) = e12; edges.col(1) = e13;
-	
-	Matrix<double,2,2> Xg = (basis.transpose() * edges);
-	Matrix<double,3,3> X123;
-	X123.col(0) = x1; X123.col(1) = x2; X123.col(2) = x3;
-	
-	B = D * Xg.inverse();
-
-	area = std::abs((basis.transpose() * edges).determinant() / 2.0f);
+	const int idx[3] = { id0, id1, id2 };
+	helper::init_triangle_force( idx, x, area, B );
 	weight = sqrtf(stiffness) * sqrtf(area);
 }
 
 
 void LimitedTriangleStrain::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
 	global_idx = weights.size();
-	int cols[3] = { 3*id0, 3*id1, 3*id2 };
-	for( int i=0; i<3; ++i ){
-		for( int j=0; j<3; ++j ){
-			triplets.push_back( Triplet<double>(i+global_idx, cols[j]+i, B(j,0) ) );
-			triplets.push_back( Triplet<double>(3+i+global_idx, cols[j]+i, B(j,1) ) );
-		}
-	}
+	const int idx[3] = { id0, id1, id2 };
+	helper::init_triangle_Di( idx, B.data(), global_idx, triplets );
 	for( int i=0; i<6; ++i ){ weights.push_back( weight ); }
 }
 
+void LimitedTriangleStrain::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	const int idx[3] = { id0, id1, id2 };
+	helper::apply_Di_B<3,2>( idx, B.data(), global_idx, x, Dx );
+}
+
+void LimitedTriangleStrain::apply_DiT( const VectorXd &v, VectorXd &Dtv ) const {
+	const int idx[3] = { id0, id1, id2 };
+	helper::apply_DiT_B<3,2>( idx, B.data(), global_idx, v, Dtv );
+}
+
 
 void LimitedTriangleStrain::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
+	helper::project_limited_triangle( global_idx, stiffness*area, weight, strain_limiting, limit_min, limit_max, Dx, u, z );
+}
+
+
+//
+//	LimitedTriangleStrainBatch
+//
+
+int LimitedTriangleStrainBatch::add( int id0, int id1, int id2, double stiffness_, double limit_min_, double limit_max_, bool strain_limiting_ ){
+	int p[3] = { id0, id1, id2 };
+	idx.insert( idx.end(), p, p+3 );
+	stiffness.push_back( stiffness_ );
+	limit_min.push_back( limit_min_ );
+	limit_max.push_back( limit_max_ );
+	strain_limiting.push_back( strain_limiting_ );
+	return stiffness.size()-1;
+}
 
-	typedef Matrix<double,6,1> Vector6d;
-	Vector6d Dix = Dx.segment<6>( global_idx );
-	Vector6d ui = u.segment<6>( global_idx );
-	Vector6d DixPlusUi = Dix+ui;
-
-	// Computing F (rearranging terms from 6x1 vector AixPlusUi to make a 3x2)
-	Matrix<double,3,2> F = Map<Matrix<double,3,2> >(DixPlusUi.data());
-		
-	// Compute the singular value decomposition
-	JacobiSVD<Matrix<double,3,2> > svd(F, ComputeFullU | ComputeFullV);
-	
-	// Constructing the matrix T
-	Matrix<double,3,2> T = svd.matrixU().leftCols<2>() * svd.matrixV().transpose();
-	Vector6d p = Map<Vector6d>(T.data());
-
-	// Update zi and ui
-	double k = stiffness*area;
-	Vector6d zi = ( k*p + weight*weight*(DixPlusUi) ) / ( weight*weight + k );
-
-	if( strain_limiting ){
-		double l_col0 = zi.head<3>().norm();
-		double l_col1 = zi.tail<3>().norm();
-		if( l_col0 < limit_min ){ zi.head<3>() *= ( limit_min / fmaxf( l_col0, 1e-6 ) ); }
-		if( l_col1 < limit_min ){ zi.tail<3>() *= ( limit_min / fmaxf( l_col1, 1e-6 ) ); }
-		if( l_col0 > limit_max ){ zi.head<3>() *= ( limit_max / fmaxf( l_col0, 1e-6 ) ); }
-		if( l_col1 > limit_max ){ zi.tail<3>() *= ( limit_max / fmaxf( l_col1, 1e-6 ) ); }
+void LimitedTriangleStrainBatch::initialize( const VectorXd &x, const VectorXd &v, const VectorXd &masses, const double timestep ){
+	const int n = size();
+	B.resize( 6*n );
+	area.resize( n );
+	weight.resize( n );
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){
+		Matrix<double,3,2> Be;
+		helper::init_triangle_force( &idx[3*e], x, area[e], Be );
+		Map< Matrix<double,3,2> >( B.data()+6*e ) = Be;
+		weight[e] = sqrtf(stiffness[e]) * sqrtf(area[e]);
 	}
+}
 
-	// update u and z
-	ui.noalias() += ( Dix - zi );
-	u.segment<6>( global_idx ) = ui;
-	z.segment<6>( global_idx ) = zi;
+void LimitedTriangleStrainBatch::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
+	const int n = size();
+	global_idx = weights.size();
+	triplets.reserve( triplets.size() + 18*n );
+	weights.reserve( weights.size() + 6*n );
+	for( int e=0; e<n; ++e ){
+		helper::init_triangle_Di( &idx[3*e], &B[6*e], global_idx+6*e, triplets );
+		for( int i=0; i<6; ++i ){ weights.push_back( weight[e] ); }
+	}
+}
+
+void LimitedTriangleStrainBatch::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
+
+	// Triangles are projected in chunks so that the rotations can
+	// be computed with the batched (simd) 3x2 polar kernel.
+	const int n = size();
+	const int chunk = 64;
+	const int n_chunks = ( n + chunk - 1 ) / chunk;
+#pragma omp parallel for
+	for( int c=0; c<n_chunks; ++c ){
+		const int e0 = c*chunk;
+		const int n_e = std::min( chunk, n-e0 );
+		double F[6*chunk], R[6*chunk];
+		for( int e=0; e<n_e; ++e ){
+			const int r = global_idx+6*(e0+e);
+			for( int i=0; i<6; ++i ){ F[6*e+i] = Dx[r+i] + u[r+i]; }
+		}
+		svd3::polar32( n_e, F, R );
+		for( int e=0; e<n_e; ++e ){
+			const int e_i = e0+e;
+			helper::update_limited_triangle( global_idx+6*e_i, stiffness[e_i]*area[e_i], weight[e_i],
+				strain_limiting[e_i], limit_min[e_i], limit_max[e_i], &R[6*e], Dx, u, z );
+		}
+	}
+}
+
+void LimitedTriangleStrainBatch::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	const int n = size();
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){ helper::apply_Di_B<3,2>( &idx[3*e], &B[6*e], global_idx+6*e, x, Dx ); }
+}
+
+void LimitedTriangleStrainBatch::apply_DiT_range( int begin, int end, const VectorXd &v, VectorXd &Dtv ) const {
+	for( int e=begin; e<end; ++e ){ helper::apply_DiT_B<3,2>( &idx[3*e], &B[6*e], global_idx+6*e, v, Dtv ); }
 }
 
 
@@ -162,136 +347,163 @@ void FungProx::gradient(const cppoptlib::Vector<double> &x, cppoptlib::Vector<do
 }
 
 void FungTriangle::initialize( const VectorXd &x, const VectorXd &v, const VectorXd &masses, const double timestep ){
-
-	Vector3d x1( x(3*id0+0), x(3*id0+1), x(3*id0+2) );
-	Vector3d x2( x(3*id1+0), x(3*id1+1), x(3*id1+2) );
-	Vector3d x3( x(3*id2+0), x(3*id2+1), x(3*id2+2) );
-
-	Matrix<double,3,2> D;
-	D(0,0) = -1; D(0,1) = -1;
-	D(1,0) =  1; D(1,1) =  0;
-	D(2,0) =  0; D(2,1) =  1;
-
-	Vector3d e12 = x2 - x1;
-	Vector3d e13 = x3 - x1;
-	Vector3d n1 = e12.normalized();
-	Vector3d n2 = (e13 - e13.dot(n1)*n1).normalized();
-
-	Eigen::Matrix<double,3,2> basis;
-	Eigen::Matrix<double,3,2> edges;
-	basis.col(0) = n1; basis.col(1) = n2;
-	edges.col(0) = e12; edges.col(1) = e13;
-	
-	Matrix<double,2,2> Xg = (basis.transpose() * edges);
-	Matrix<double,3,3> X123;
-	X123.col(0) = x1; X123.col(1) = x2; X123.col(2) = x3;
-	
-	B = D * Xg.inverse();
-
-//	weight = sqrt( std::min(a,c) );
-
-	area = std::abs((basis.transpose() * edges).determinant() / 2.0f);
+	const int idx[3] = { id0, id1, id2 };
+	helper::init_triangle_force( idx, x, area, B );
 	weight = sqrt(mu) * sqrt(area);
-	double k = mu;//(weight*weight)/area;
-//	weight = sqrt(mu);
-//	double k = mu/area;
+	double k = mu;
 	fungprox = std::unique_ptr<FungProx>( new FungProx(mu,k) );
-
+	solver->settings_.init_hess = 1.0;
 }
 
 
 void FungTriangle::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
 	global_idx = weights.size();
-	int cols[3] = { 3*id0, 3*id1, 3*id2 };
-	for( int i=0; i<3; ++i ){
-		for( int j=0; j<3; ++j ){
-			triplets.push_back( Triplet<double>(i+global_idx, cols[j]+i, B(j,0) ) );
-			triplets.push_back( Triplet<double>(3+i+global_idx, cols[j]+i, B(j,1) ) );
-		}
-	}
+	const int idx[3] = { id0, id1, id2 };
+	helper::init_triangle_Di( idx, B.data(), global_idx, triplets );
 	for( int i=0; i<6; ++i ){ weights.push_back( weight ); }
 }
 
+void FungTriangle::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	const int idx[3] = { id0, id1, id2 };
+	helper::apply_Di_B<3,2>( idx, B.data(), global_idx, x, Dx );
+}
+
+void FungTriangle::apply_DiT( const VectorXd &v, VectorXd &Dtv ) const {
+	const int idx[3] = { id0, id1, id2 };
+	helper::apply_DiT_B<3,2>( idx, B.data(), global_idx, v, Dtv );
+}
+
 
 
 void FungTriangle::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
+	helper::project_fung( global_idx, *fungprox, *solver, Dx, u, z );
+}
 
-	typedef Matrix<double,6,1> Vector6d;
-	Vector6d Dix = Dx.segment<6>( global_idx );
-	Vector6d ui = u.segment<6>( global_idx );
-	Vector6d DixPlusUi = Dix+ui;
 
-	// Computing F (rearranging terms from 6x1 vector AixPlusUi to make a 3x2)
-	Matrix<double,3,2> F = Map<Matrix<double,3,2> >(DixPlusUi.data());
-	JacobiSVD<Matrix<double,3,2> > svd(F, ComputeFullU | ComputeFullV);
-	cppoptlib::Vector<double> x2 = svd.singularValues();
+//
+//	FungTriangleBatch
+//
 
-	// Minimize
-	fungprox->setSigma0( Eigen::Vector2d(x2[0],x2[1]) );
-	solver->minimize(*(fungprox.get()), x2);
+int FungTriangleBatch::add( int id0, int id1, int id2, double mu_ ){
+	int p[3] = { id0, id1, id2 };
+	idx.insert( idx.end(), p, p+3 );
+	mu.push_back( mu_ );
+	return mu.size()-1;
+}
 
-//	printf("\n%f %f", x2(0), x2(1) );
-	// Incompressibility
-//	if( x2(0) < 1 ){ x2(0) = 1; }
-//	if( x2(1) < 1 ){ x2(1) = 1; }
+void FungTriangleBatch::initialize( const VectorXd &x, const VectorXd &v, const VectorXd &masses, const double timestep ){
+	const int n = size();
+	B.resize( 6*n );
+	area.resize( n );
+	weight.resize( n );
+	init_hess.assign( n, 1.0 );
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){
+		Matrix<double,3,2> Be;
+		helper::init_triangle_force( &idx[3*e], x, area[e], Be );
+		Map< Matrix<double,3,2> >( B.data()+6*e ) = Be;
+		weight[e] = sqrt(mu[e]) * sqrt(area[e]);
+	}
+}
 
-	// Reform F
-	Matrix<double,3,2> Diag; Diag.setZero();
-	Diag.block<2,2>(0,0) = x2.asDiagonal();
-	F = svd.matrixU() * Diag * svd.matrixV().transpose();
-	Vector6d zi = Map<Vector6d>(F.data());
+void FungTriangleBatch::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
+	const int n = size();
+	global_idx = weights.size();
+	triplets.reserve( triplets.size() + 18*n );
+	weights.reserve( weights.size() + 6*n );
+	for( int e=0; e<n; ++e ){
+		helper::init_triangle_Di( &idx[3*e], &B[6*e], global_idx+6*e, triplets );
+		for( int i=0; i<6; ++i ){ weights.push_back( weight[e] ); }
+	}
+}
 
-	// update u and z
-	ui.noalias() += ( Dix - zi );
-	u.segment<6>( global_idx ) = ui;
-	z.segment<6>( global_idx ) = zi;
+void FungTriangleBatch::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
+	const int n = size();
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){
+		FungProx prox( mu[e], mu[e] );
+		cppoptlib::lbfgssolver<double> solver;
+		solver.settings_.maxIter = 10;
+		solver.settings_.gradTol = 1e-6;
+		solver.settings_.init_hess = init_hess[e];
+		helper::project_fung( global_idx+6*e, prox, solver, Dx, u, z );
+		init_hess[e] = solver.settings_.init_hess;
+	}
 }
 
+void FungTriangleBatch::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	const int n = size();
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){ helper::apply_Di_B<3,2>( &idx[3*e], &B[6*e], global_idx+6*e, x, Dx ); }
+}
 
-static inline double aclamp( double v, double min, double max ){
-	v = ( v < max ? v : max );
-	v = ( v > min ? v : min );
-	return v;
+void FungTriangleBatch::apply_DiT_range( int begin, int end, const VectorXd &v, VectorXd &Dtv ) const {
+	for( int e=begin; e<end; ++e ){ helper::apply_DiT_B<3,2>( &idx[3*e], &B[6*e], global_idx+6*e, v, Dtv ); }
 }
 
+
+//
+//	TriArea
+//
+
 void TriArea::project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const {
+	helper::project_tri_area( global_idx, stiffness*area, weight, iters, limit_min, limit_max, Dx, u, z );
+}
 
-	typedef Matrix<double,6,1> Vector6d;
-	Vector6d Dix = Dx.segment<6>( global_idx );
-	Vector6d ui = u.segment<6>( global_idx );
-	Vector6d DixPlusUi = Dix+ui;
-
-	// Computing F (rearranging terms from 6x1 vector AixPlusUi to make a 3x2)
-	Matrix<double,3,2> F = Map<Matrix<double,3,2> >(DixPlusUi.data());
-	JacobiSVD<Matrix<double,3,2> > svd(F, ComputeFullU | ComputeFullV);
-
-	// Compute the singular value decomposition
-	Eigen::Vector2d S = svd.singularValues();
-	Eigen::Vector2d d(0.0f, 0.0f);
-	for (int i = 0; i < iters; ++i) {
-		double v = S(0) * S(1);
-		double f = v - aclamp(v, limit_min, limit_max);
-		Eigen::Vector2d g(S(1), S(0));
-		d = -((f - g.dot(d)) / g.dot(g)) * g;
-		S = svd.singularValues() + d;
-	}
 
-	// Reconstruct F and compute projection
-	Matrix<double,3,2> Diag;
-	Diag.setZero();
-	Diag.block<2,2>(0,0) = S.asDiagonal();
-	F = svd.matrixU() * Diag * svd.matrixV().transpose();
-	Vector6d p = Map<Vector6d>(F.data());
-	
-	// Update zi and ui
-	double k = stiffness*area;
-	Vector6d zi = ( k*p + weight*weight*(DixPlusUi) ) / ( weight*weight + k );
+//
+//	TriAreaBatch
+//
+
+int TriAreaBatch::add( int id0, int id1, int id2, double stiffness_, int iters_, double limit_min_, double limit_max_ ){
+	int p[3] = { id0, id1, id2 };
+	idx.insert( idx.end(), p, p+3 );
+	stiffness.push_back( stiffness_ );
+	iters.push_back( iters_ );
+	limit_min.push_back( limit_min_ );
+	limit_max.push_back( limit_max_ );
+	return stiffness.size()-1;
+}
+
+void TriAreaBatch::initialize( const VectorXd &x, const VectorXd &v, const VectorXd &masses, const double timestep ){
+	const int n = size();
+	B.resize( 6*n );
+	area.resize( n );
+	weight.resize( n );
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){
+		Matrix<double,3,2> Be;
+		helper::init_triangle_force( &idx[3*e], x, area[e], Be );
+		Map< Matrix<double,3,2> >( B.data()+6*e ) = Be;
+		weight[e] = sqrtf(stiffness[e]) * sqrtf(area[e]);
+	}
+}
 
-	// update u and z
-	ui.noalias() += ( Dix - zi );
-	u.segment<6>( global_idx ) = ui;
-	z.segment<6>( global_idx ) = zi;
+void TriAreaBatch::get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights ){
+	const int n = size();
+	global_idx = weights.size();
+	triplets.reserve( triplets.size() + 18*n );
+	weights.reserve( weights.size() + 6*n );
+	for( int e=0; e<n; ++e ){
+		helper::init_triangle_Di( &idx[3*e], &B[6*e], global_idx+6*e, triplets );
+		for( int i=0; i<6; ++i ){ weights.push_back( weight[e] ); }
+	}
+}
 
+void TriAreaBatch::project( double dt, const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
+	const int n = size();
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){
+		helper::project_tri_area( global_idx+6*e, stiffness[e]*area[e], weight[e], iters[e], limit_min[e], limit_max[e], Dx, u, z );
+	}
 }
 
+void TriAreaBatch::apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+	const int n = size();
+#pragma omp parallel for
+	for( int e=0; e<n; ++e ){ helper::apply_Di_B<3,2>( &idx[3*e], &B[6*e], global_idx+6*e, x, Dx ); }
+}
 
+void TriAreaBatch::apply_DiT_range( int begin, int end, const VectorXd &v, VectorXd &Dtv ) const {
+	for( int e=begin; e<end; ++e ){ helper::apply_DiT_B<3,2>( &idx[3*e], &B[6*e], global_idx+6*e, v, Dtv ); }
+}
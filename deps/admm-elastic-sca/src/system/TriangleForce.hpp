@@ -34,6 +34,10 @@ public:
 	virtual void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
 	virtual void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
 	virtual void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
+	virtual bool matrix_free() const { return true; }
+	virtual void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	virtual void apply_DiT( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	virtual const char *name() const { return "LimitedTriangleStrain"; }
 
 	int id0, id1, id2;
 	double stiffness, limit_min, limit_max;
@@ -43,6 +47,30 @@ public:
 
 }; // end class limited triangle strain
 
+//
+//	LimitedTriangleStrainBatch
+//	Same as LimitedTriangleStrain, for all triangles in flat arrays.
+//
+class LimitedTriangleStrainBatch : public ForceBatch {
+public:
+	// Adds a triangle and returns its index in the batch
+	int add( int id0, int id1, int id2, double stiffness_, double limit_min_, double limit_max_, bool strain_limiting_=true );
+
+	int size() const { return stiffness.size(); }
+	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
+	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
+	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT_range( int begin, int end, const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	const char *name() const { return "LimitedTriangleStrain"; }
+
+	std::vector<int> idx; // 3 per triangle
+	std::vector<double> B; // 3x2 (column major) per triangle
+	std::vector<double> stiffness, limit_min, limit_max, area, weight;
+	std::vector<char> strain_limiting;
+
+}; // end class LimitedTriangleStrainBatch
+
 // Proximal Operator for Fung
 class FungProx : public cppoptlib::Problem<double> {
 public:
@@ -71,6 +99,10 @@ public:
 	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
 	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
 	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
+	bool matrix_free() const { return true; }
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT( const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	const char *name() const { return "FungTriangle"; }
 
 	std::unique_ptr< cppoptlib::ISolver<double, 1> > solver;
 	std::unique_ptr<FungProx> fungprox;
@@ -81,14 +113,64 @@ public:
 
 }; // end class limited triangle strain
 
+//
+//	FungTriangleBatch
+//	Same as FungTriangle, for all triangles in flat arrays. The prox problem and
+//	solver live on the stack, and the lbfgs warm start is kept per triangle.
+//
+class FungTriangleBatch : public ForceBatch {
+public:
+	// Adds a triangle and returns its index in the batch
+	int add( int id0, int id1, int id2, double mu_ );
+
+	int size() const { return mu.size(); }
+	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
+	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
+	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT_range( int begin, int end, const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	const char *name() const { return "FungTriangle"; }
+
+	std::vector<int> idx; // 3 per triangle
+	std::vector<double> B; // 3x2 (column major) per triangle
+	std::vector<double> mu, area, weight;
+	mutable std::vector<double> init_hess; // lbfgs warm start, reset by initialize
+
+}; // end class FungTriangleBatch
+
 class TriArea : public LimitedTriangleStrain {
 public:
 	TriArea( int id0_, int id1_, int id2_, double stiffness_, int iters_, double limit_min_, double limit_max_ ) :
 		LimitedTriangleStrain( id0_, id1_, id2_, stiffness_, limit_min_, limit_max_ ), iters(iters_) {}
 	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
+	const char *name() const { return "TriArea"; }
 	int iters;
 };
 
+//
+//	TriAreaBatch
+//	Same as TriArea, for all triangles in flat arrays.
+//
+class TriAreaBatch : public ForceBatch {
+public:
+	// Adds a triangle and returns its index in the batch
+	int add( int id0, int id1, int id2, double stiffness_, int iters_, double limit_min_, double limit_max_ );
+
+	int size() const { return stiffness.size(); }
+	void initialize( const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &masses, const double timestep );
+	void get_selector( const Eigen::VectorXd &x, std::vector< Eigen::Triplet<double> > &triplets, std::vector<double> &weights );
+	void project( double dt, const Eigen::VectorXd &Dx, Eigen::VectorXd &u, Eigen::VectorXd &z ) const;
+	void apply_Di( const Eigen::VectorXd &x, Eigen::VectorXd &Dx ) const;
+	void apply_DiT_range( int begin, int end, const Eigen::VectorXd &v, Eigen::VectorXd &Dtv ) const;
+	const char *name() const { return "TriArea"; }
+
+	std::vector<int> idx; // 3 per triangle
+	std::vector<double> B; // 3x2 (column major) per triangle
+	std::vector<int> iters;
+	std::vector<double> stiffness, limit_min, limit_max, area, weight;
+
+}; // end class TriAreaBatch
+
 } // end namespace admm
 
 #endif
@@ -26,11 +26,11 @@
 #include "AABB.hpp"
 #include <memory>
 #include <numeric>
+#include <limits>
 
 namespace mcl {
 
-typedef long morton_type;
-typedef unsigned long long morton_encode_type;
+typedef unsigned long long morton_type;
 
 class BVHNode {
 public:
@@ -48,28 +48,93 @@ public:
 };
 
 
+//
+//	Compact BVH in one contiguous array of 32 byte nodes, in depth first order
+//	(the left child of an inner node is the next node). Leaves refer to a range of
+//	indices, which holds the primitives reordered by leaf. Traversal uses an
+//	explicit stack instead of recursion through refcounted pointers.
+//
+struct FlatBVHNode {
+	float bmin[3];
+	int offset; // leaf: first slot in FlatBVH::indices, inner: index of the right child
+	float bmax[3];
+	int count; // leaf: number of primitives, inner: -1-split_axis
+
+	bool is_leaf() const { return count >= 0; }
+	int split_axis() const { return -1-count; }
+};
+static_assert( sizeof(FlatBVHNode)==32, "FlatBVHNode should be 32 bytes" );
+
+class FlatBVH {
+public:
+	std::vector<FlatBVHNode> nodes; // root is nodes[0], empty if no primitives
+	std::vector<int> indices; // primitive of each leaf slot
+	std::vector< std::shared_ptr<BaseObject> > prims; // as returned by get_primitives
+	std::vector<int> parents; // parent of each node (-1 for the root), made by refit if needed
+
+	// Trees deeper than this are cut off with larger leaves by the builders
+	static const int max_depth = 60;
+
+	void clear(){ nodes.clear(); indices.clear(); prims.clear(); parents.clear(); }
+
+	// Recomputes the boxes bottom-up from the current bounds of the primitives,
+	// e.g. after a mesh deformed. The tree itself is unchanged. Leaves are done in
+	// parallel, and the last child to finish computes its parent.
+	void refit();
+	int depth() const; // for profiling
+	void bounds( trimesh::vec &bmin, trimesh::vec &bmax ) const;
+};
+
+
+//
+//	Result of a proximity query against the primitives of a FlatBVH
+//
+struct ProximityHit {
+	ProximityHit() : prim(-1), dist2(std::numeric_limits<float>::max()) {}
+	int prim; // index into FlatBVH::prims, -1 if nothing was found
+	float dist2; // squared distance from the query point
+	trimesh::vec point; // closest point on the primitive
+	trimesh::vec bary; // barycentric coordinates of point (triangles)
+};
+
+
 class BVHBuilder {
 public:
-	// Parallel sorting construction (Lauterbach et al. 2009)
-	// returns num nodes in tree
+	// Parallel construction from sorted morton codes (Karras 2012). Codes are 30 or 63 bits
+	// and radix sorted, and the hierarchy is emitted from them in parallel. Subtrees with
+	// at most max_leaf primitives become leaves. Returns num nodes in tree
+	static int make_tree_lbvh( FlatBVH &bvh, const std::vector< std::shared_ptr<BaseObject> > &objects, int max_leaf=4, int morton_bits=63 );
+
+	// Same, copied into a pointer tree with one primitive per leaf
+	// and anything deeper than max_depth in one leaf.
 	static int make_tree_lbvh( std::shared_ptr<BVHNode> &root, const std::vector< std::shared_ptr<BaseObject> > &objects, int max_depth=10 );
 
 	// Object Median split, round robin axis
 	// returns num nodes in tree
 	static int make_tree_spatial( std::shared_ptr<BVHNode> &root, const std::vector< std::shared_ptr<BaseObject> > &objects, int max_depth=10 );
 
+	// Binned surface area heuristic (Wald 2007), with at most max_leaf primitives per
+	// leaf unless they can't be split. Returns num nodes in tree
+	static int make_tree_sah( FlatBVH &bvh, const std::vector< std::shared_ptr<BaseObject> > &objects, int max_leaf=4 );
+
+	// Copies a tree made by make_tree_lbvh or make_tree_spatial into a flat one
+	// (same boxes and leaves). Returns num nodes in tree
+	static int flatten( FlatBVH &bvh, const std::shared_ptr<BVHNode> &root );
+
 	// Stats used for profiling:
 	static int n_nodes; // number of nodes in the last-created tree
 	static float avg_balance; // the "balance" of the last-created tree (lousy metric, but whatever)
 	static float runtime_s; // time it took to build the bvh (seconds)
 
 private:
-	static void lbvh_split( std::shared_ptr<BVHNode> &node, const int bit, const std::vector< std::shared_ptr<BaseObject> > &prims,
-		const std::vector< std::pair< morton_type, int > > &morton_codes, const int max_depth );
 	static void spatial_split( std::shared_ptr<BVHNode> &node, const std::vector< std::shared_ptr<BaseObject> > &objects,
 		const std::vector< int > &queue, const int split_axis, const int max_depth );
 
 	static int num_avg_balance;
+	static int sah_split( FlatBVH &bvh, std::vector<trimesh::vec> &prim_min, std::vector<trimesh::vec> &prim_max,
+		std::vector<trimesh::vec> &centers, int first, int count, int max_leaf, int depth );
+	static int flatten_node( FlatBVH &bvh, const BVHNode *node, int depth );
+	static int unflatten_node( const FlatBVH &bvh, int idx, std::shared_ptr<BVHNode> &node, int depth );
 };
 
 
@@ -81,6 +146,27 @@ public:
 
 	// Ray-Scene traversal for any object, early exit (shadow rays)
 	static bool any_hit( const std::shared_ptr<BVHNode> node, const intersect::Ray *ray, intersect::Payload *payload );
+
+	// Same as above for a flat BVH. The index of the primitive hit (into bvh.prims)
+	// is set if the last argument is used. Children are visited near first.
+	static bool closest_hit( const FlatBVH &bvh, const intersect::Ray *ray, intersect::Payload *payload, int *prim=0 );
+	static bool any_hit( const FlatBVH &bvh, const intersect::Ray *ray, intersect::Payload *payload );
+
+	// Batched proximity queries on a flat BVH, done in parallel over the queries.
+	// Distances to primitives come from BaseObject::closest_point.
+
+	// Closest primitive to each point that is within max_dist.
+	static void closest_point( const FlatBVH &bvh, const std::vector<trimesh::vec> &points,
+		std::vector<ProximityHit> &hits, float max_dist=std::numeric_limits<float>::max() );
+
+	// All primitives within a radius of each point (one radius for all if radii.size()==1).
+	// The hits of point i are hits[ offsets[i] ] to hits[ offsets[i+1]-1 ].
+	static void sphere_overlap( const FlatBVH &bvh, const std::vector<trimesh::vec> &centers, const std::vector<float> &radii,
+		std::vector<int> &offsets, std::vector<ProximityHit> &hits );
+
+	// All primitives whose boxes overlap each box, in the same layout as above.
+	static void aabb_overlap( const FlatBVH &bvh, const std::vector<AABB> &boxes,
+		std::vector<int> &offsets, std::vector<int> &prims );
 };
 
 
@@ -54,6 +54,10 @@ public:
 	// Used by BVHTraversal
 	virtual bool ray_intersect( const intersect::Ray *ray, intersect::Payload *payload ) const { return false; }
 
+	// Used by BVHTraversal proximity queries. Sets the closest point on the object and its
+	// barycentric coordinates (if any), returns the squared distance or a negative value if unsupported.
+	virtual float closest_point( const trimesh::vec &p, trimesh::vec &point, trimesh::vec &bary ) const { return -1.f; }
+
 	// Returns a string containing xml code for saving to a scenefile.
 	virtual std::string get_xml( std::string component_name, int mode=0 ){ return ""; }
 
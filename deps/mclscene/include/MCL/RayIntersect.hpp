@@ -60,6 +60,11 @@ namespace intersect {
 	// Returns true/false only and does not set the payload.
 	static inline bool ray_aabb( const Ray *ray, const trimesh::vec &min, const trimesh::vec &max, const Payload *payload );
 
+	// point -> triangle, closest point on the triangle and its barycentric coordinates.
+	// Returns the squared distance.
+	static inline float point_triangle( const trimesh::vec &p, const trimesh::vec &p0, const trimesh::vec &p1, const trimesh::vec &p2,
+		trimesh::vec &point, trimesh::vec &bary );
+
 } // end namespace intersect
 
 } // end namespace mcl
@@ -145,4 +150,47 @@ static inline bool mcl::intersect::ray_aabb( const Ray *ray, const trimesh::vec
 
 } // end ray box intersection
 
+// point -> triangle (Ericson, Real-Time Collision Detection 5.1.5)
+// Done on floats, since trimesh's vec operators are atomic.
+static inline float mcl::intersect::point_triangle( const trimesh::vec &p, const trimesh::vec &p0, const trimesh::vec &p1, const trimesh::vec &p2,
+	trimesh::vec &point, trimesh::vec &bary ){
+
+	float ab[3], ac[3], ap[3], bp[3], cp[3];
+	for( int i=0; i<3; ++i ){
+		ab[i] = p1[i]-p0[i]; ac[i] = p2[i]-p0[i];
+		ap[i] = p[i]-p0[i]; bp[i] = p[i]-p1[i]; cp[i] = p[i]-p2[i];
+	}
+	const float d1 = ab[0]*ap[0] + ab[1]*ap[1] + ab[2]*ap[2];
+	const float d2 = ac[0]*ap[0] + ac[1]*ap[1] + ac[2]*ap[2];
+	const float d3 = ab[0]*bp[0] + ab[1]*bp[1] + ab[2]*bp[2];
+	const float d4 = ac[0]*bp[0] + ac[1]*bp[1] + ac[2]*bp[2];
+	const float d5 = ab[0]*cp[0] + ab[1]*cp[1] + ab[2]*cp[2];
+	const float d6 = ac[0]*cp[0] + ac[1]*cp[1] + ac[2]*cp[2];
+	const float va = d3*d6 - d5*d4, vb = d5*d2 - d1*d6, vc = d1*d4 - d3*d2;
+
+	float v = 0.f, w = 0.f;
+	if( d1 <= 0.f && d2 <= 0.f ){} // vertex 0
+	else if( d3 >= 0.f && d4 <= d3 ){ v = 1.f; } // vertex 1
+	else if( d6 >= 0.f && d5 <= d6 ){ w = 1.f; } // vertex 2
+	else if( vc <= 0.f && d1 >= 0.f && d3 <= 0.f ){ v = d1 / ( d1-d3 ); } // edge 01
+	else if( vb <= 0.f && d2 >= 0.f && d6 <= 0.f ){ w = d2 / ( d2-d6 ); } // edge 02
+	else if( va <= 0.f && ( d4-d3 ) >= 0.f && ( d5-d6 ) >= 0.f ){ // edge 12
+		w = ( d4-d3 ) / ( ( d4-d3 ) + ( d5-d6 ) );
+		v = 1.f-w;
+	}
+	else{ // face
+		const float denom = 1.f / ( va+vb+vc );
+		v = vb*denom; w = vc*denom;
+	}
+
+	float dist2 = 0.f;
+	for( int i=0; i<3; ++i ){
+		point[i] = p0[i] + v*ab[i] + w*ac[i];
+		dist2 += ( p[i]-point[i] )*( p[i]-point[i] );
+	}
+	bary[0] = 1.f-v-w; bary[1] = v; bary[2] = w;
+	return dist2;
+
+} // end point triangle
+
 #endif
@@ -24,6 +24,7 @@
 
 #include "BVH.hpp"
 #include "DefaultBuilders.hpp"
+#include "Trace.hpp"
 
 //
 //	Loading a scene with SceneManager:
@@ -61,7 +62,7 @@ class SceneManager {
 		// Computes bounding volume heirarchy (AABB). Eventually I will add better heuristics.
 		// Type is:
 		// 	spatial = object median (slower, better balanced)
-		//	linear = parallel build w/ morton codes (probably has an error somewhere)
+		//	linear = parallel build w/ morton codes (Karras 2012)
 		//
 		std::shared_ptr<BVHNode> get_bvh( bool recompute=false, std::string type="spatial" );
 
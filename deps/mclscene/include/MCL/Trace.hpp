@@ -0,0 +1,212 @@
+// Copyright 2016 Matthew Overby.
+// 
+// MCLSCENE Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+// By Matt Overby (http://www.mattoverby.net)
+
+#ifndef MCLSCENE_TRACE_H
+#define MCLSCENE_TRACE_H 1
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mcl {
+
+//
+//	Timeline tracing. Scoped spans (MCL_TRACE_SPAN) are recorded per thread into
+//	fixed-size ring buffers and can be saved at any time as a Chrome trace (json),
+//	viewable in chrome://tracing or Perfetto. Each thread only writes to its own
+//	buffer, so recording a span takes no locks: two clock reads and a few stores.
+//	Only the last capacity() spans of each thread are kept, so it can be left on.
+//
+//	It's header only so that every library linked into a program records into
+//	the same buffers.
+//
+namespace trace {
+
+	struct Event {
+		const char *cat; // stored by pointer, so use string literals
+		const char *name;
+		std::int64_t start_ns, dur_ns; // start is since the trace epoch
+	};
+
+	// Ring buffer of one thread. Only that thread pushes, and save() copies it
+	// without stopping the thread. Each slot has a sequence number (a seqlock), so a
+	// copy of a slot the thread is overwriting at the same time is detected and dropped.
+	class ThreadBuffer {
+	public:
+		ThreadBuffer( int tid_, int capacity ) : tid(tid_), mask(capacity-1), slots(capacity), head(0), first(0) {
+			for( int i=0; i<capacity; ++i ){ slots[i].seq.store( 0, std::memory_order_relaxed ); }
+		}
+		inline void push( const Event &e ){
+			const std::uint64_t h = head.load( std::memory_order_relaxed );
+			Slot &s = slots[ h & mask ];
+			s.seq.store( 0, std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_release );
+			s.cat.store( e.cat, std::memory_order_relaxed );
+			s.name.store( e.name, std::memory_order_relaxed );
+			s.start_ns.store( e.start_ns, std::memory_order_relaxed );
+			s.dur_ns.store( e.dur_ns, std::memory_order_relaxed );
+			s.seq.store( h+1, std::memory_order_release );
+			head.store( h+1, std::memory_order_release );
+		}
+		// Copies event k, or returns false if its slot has been (or is being) overwritten
+		inline bool read( std::uint64_t k, Event &e ) const {
+			const Slot &s = slots[ k & mask ];
+			if( s.seq.load( std::memory_order_acquire ) != k+1 ){ return false; }
+			e.cat = s.cat.load( std::memory_order_relaxed );
+			e.name = s.name.load( std::memory_order_relaxed );
+			e.start_ns = s.start_ns.load( std::memory_order_relaxed );
+			e.dur_ns = s.dur_ns.load( std::memory_order_relaxed );
+			std::atomic_thread_fence( std::memory_order_acquire );
+			return s.seq.load( std::memory_order_relaxed ) == k+1;
+		}
+		struct Slot {
+			std::atomic<std::uint64_t> seq; // k+1 once event k is written, 0 while writing
+			std::atomic<const char*> cat, name;
+			std::atomic<std::int64_t> start_ns, dur_ns;
+		};
+		const int tid;
+		const std::uint64_t mask;
+		std::vector<Slot> slots;
+		std::atomic<std::uint64_t> head; // number of events pushed
+		std::atomic<std::uint64_t> first; // events before this one were cleared
+	};
+
+	struct Registry {
+		Registry() : enabled(true), capacity(1<<16), epoch( std::chrono::steady_clock::now() ) {}
+		std::atomic<bool> enabled;
+		int capacity; // events per thread, a power of two
+		std::chrono::steady_clock::time_point epoch;
+		std::mutex mutex; // for adding threads and saving, never held while recording
+		std::vector< std::shared_ptr<ThreadBuffer> > threads; // kept after their thread exits
+	};
+
+	inline Registry &registry(){ static Registry r; return r; }
+
+	// Buffer of the calling thread, added on its first span
+	inline ThreadBuffer *thread_buffer(){
+		thread_local ThreadBuffer *buffer = 0;
+		if( buffer == 0 ){
+			Registry &r = registry();
+			std::lock_guard<std::mutex> lock( r.mutex );
+			r.threads.push_back( std::shared_ptr<ThreadBuffer>( new ThreadBuffer( r.threads.size()+1, r.capacity ) ) );
+			buffer = r.threads.back().get();
+		}
+		return buffer;
+	}
+
+	inline std::int64_t now_ns(){
+		return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - registry().epoch ).count();
+	}
+
+	// Recording is on by default
+	inline void set_enabled( bool on ){ registry().enabled.store( on, std::memory_order_relaxed ); }
+	inline bool enabled(){ return registry().enabled.load( std::memory_order_relaxed ); }
+
+	// Spans kept per thread, rounded up to a power of two.
+	// Only changes the buffers of threads that haven't recorded yet.
+	inline void set_capacity( int n ){
+		Registry &r = registry();
+		std::lock_guard<std::mutex> lock( r.mutex );
+		r.capacity = 1;
+		while( r.capacity < n ){ r.capacity *= 2; }
+	}
+	inline int capacity(){ return registry().capacity; }
+
+	// Drops the spans recorded so far
+	inline void clear(){
+		Registry &r = registry();
+		std::lock_guard<std::mutex> lock( r.mutex );
+		for( size_t i=0; i<r.threads.size(); ++i ){
+			r.threads[i]->first.store( r.threads[i]->head.load( std::memory_order_acquire ), std::memory_order_release );
+		}
+	}
+
+	// Records the time from construction to destruction
+	class Span {
+	public:
+		Span( const char *cat_, const char *name_ ) : cat(cat_), name(name_), start( enabled() ? now_ns() : -1 ) {}
+		~Span(){
+			if( start < 0 ){ return; }
+			Event e = { cat, name, start, now_ns() - start };
+			thread_buffer()->push( e );
+		}
+	private:
+		const char *cat, *name;
+		std::int64_t start; // -1 if not recording
+		Span( const Span& ); // prevent copies
+		void operator=( const Span& );
+	};
+
+	// Writes the recorded spans of all threads as a Chrome trace,
+	// returns false if the file couldn't be opened.
+	inline bool save( const std::string &filename ){
+		std::ofstream out( filename.c_str() );
+		if( !out.is_open() ){ return false; }
+		out << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+		Registry &r = registry();
+		std::lock_guard<std::mutex> lock( r.mutex );
+		std::vector<Event> events;
+		bool first_event = true;
+		for( size_t i=0; i<r.threads.size(); ++i ){
+
+			// Copy the buffer, without the spans the thread overwrites while copying
+			const ThreadBuffer &b = *r.threads[i];
+			const std::uint64_t cap = b.mask+1;
+			const std::uint64_t end = b.head.load( std::memory_order_acquire );
+			const std::uint64_t begin = std::max( b.first.load( std::memory_order_acquire ), end > cap ? end-cap : 0 );
+			events.clear();
+			for( std::uint64_t k=begin; k<end; ++k ){
+				Event e;
+				if( b.read( k, e ) ){ events.push_back( e ); }
+			}
+
+			out << ( first_event ? "\n" : ",\n" ) << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << b.tid <<
+				",\"args\":{\"name\":\"thread " << b.tid << "\"}}";
+			first_event = false;
+			for( size_t k=0; k<events.size(); ++k ){
+				const Event &e = events[k];
+				out << ",\n{\"cat\":\"" << e.cat << "\",\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << b.tid <<
+					",\"ts\":" << e.start_ns*1e-3 << ",\"dur\":" << e.dur_ns*1e-3 << "}";
+			}
+		}
+		out << "\n]}\n";
+		return out.good();
+	}
+
+} // end namespace trace
+
+} // end namespace mcl
+
+// Records a span from here to the end of the scope, e.g. MCL_TRACE_SPAN( "render", "RenderGL::draw_objects" ).
+// The category and name must be string literals.
+#define MCL_TRACE_CAT_( a, b ) a##b
+#define MCL_TRACE_CAT( a, b ) MCL_TRACE_CAT_( a, b )
+#define MCL_TRACE_SPAN( cat, name ) mcl::trace::Span MCL_TRACE_CAT( mcl_trace_span_, __LINE__ )( cat, name )
+
+#endif
@@ -46,8 +46,11 @@ public:
 	std::string material;
 
 	void bounds( trimesh::vec &bmin, trimesh::vec &bmax ){
-		AABB aabb; aabb += *p0; aabb += *p1; aabb += *p2;
-		bmin = aabb.min; bmax = aabb.max;
+		// Per component, since trimesh's vec min/max lock a critical section
+		for( int i=0; i<3; ++i ){
+			bmin[i] = std::min( (*p0)[i], std::min( (*p1)[i], (*p2)[i] ) );
+			bmax[i] = std::max( (*p0)[i], std::max( (*p1)[i], (*p2)[i] ) );
+		}
 	}
 
 	bool ray_intersect( const intersect::Ray *ray, intersect::Payload *payload ) const {
@@ -55,6 +58,10 @@ public:
 		if( hit ){ payload->material = material; }
 		return hit;
 	}
+
+	float closest_point( const trimesh::vec &p, trimesh::vec &point, trimesh::vec &bary ) const {
+		return intersect::point_triangle( p, *p0, *p1, *p2, point, bary );
+	}
 };
 
 
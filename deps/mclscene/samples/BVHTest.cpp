@@ -1,13 +1,23 @@
 
 #include "MCL/SceneManager.hpp"
 #include <chrono>
+#include <random>
 
 using namespace mcl;
 
 void clip_mesh( mcl::SceneManager &scene );
+void test_queries( mcl::SceneManager &scene );
 
 int main(int argc, char *argv[]){
 
+	// Compare the pointer and flat trees on the full mesh
+	{
+		SceneManager scene;
+		std::stringstream ss; ss << MCLSCENE_SRC_DIR << "/conf/Lucy.xml";
+		if( !scene.load( ss.str() ) ){ return 0; }
+		test_queries( scene );
+	}
+
 	std::vector<std::string> types;
 	types.push_back( "spatial" );
 	types.push_back( "linear" );
@@ -73,8 +83,113 @@ void clip_mesh( mcl::SceneManager &scene ){
 }
 
 
+//
+//	Build time and ray throughput of each builder, with the pointer
+//	trees traversed as is and after flattening.
+//
+void test_queries( mcl::SceneManager &scene ){
+
+	using namespace trimesh;
+	typedef std::chrono::time_point<std::chrono::system_clock> time_point;
+	const int n_rays = 200000;
+
+	// Rays from a sphere around the scene towards random points inside it
+	FlatBVH bvh;
+	BVHBuilder::make_tree_sah( bvh, scene.objects );
+	vec bmin, bmax; bvh.bounds( bmin, bmax );
+	vec center = (bmin+bmax)*0.5f;
+	float radius = len(bmax-bmin);
+	std::mt19937 gen(0);
+	std::uniform_real_distribution<float> rand01(0.f,1.f);
+	std::vector<intersect::Ray> rays( n_rays );
+	for( int i=0; i<n_rays; ++i ){
+		vec dir( rand01(gen)-0.5f, rand01(gen)-0.5f, rand01(gen)-0.5f );
+		vec origin = center + radius * unit( dir );
+		vec target( bmin[0]+rand01(gen)*(bmax[0]-bmin[0]), bmin[1]+rand01(gen)*(bmax[1]-bmin[1]), bmin[2]+rand01(gen)*(bmax[2]-bmin[2]) );
+		rays[i] = intersect::Ray( origin, unit( target-origin ) );
+	}
+
+	std::ofstream filestream( "bvh_queries.txt" );
+	filestream << "%% type\tnodes\tbuild_s\trays_per_s\thits";
+	std::cout << "type\t\tnodes\tdepth\tbuild_s\t\trays/s\t\thits\tt_sum" << std::endl;
 
+	std::vector<std::string> types;
+	types.push_back( "spatial" );
+	types.push_back( "linear" );
+	types.push_back( "spatial-flat" );
+	types.push_back( "linear-flat" );
+	types.push_back( "sah-flat" );
+	types.push_back( "lbvh-flat" );
 
+	for( int i=0; i<types.size(); ++i ){
 
-
-
+		// Build
+		std::shared_ptr<BVHNode> root( new BVHNode() );
+		int n_nodes = 0, depth = 0;
+		time_point start = std::chrono::system_clock::now();
+		if( types[i].find("spatial")==0 ){ n_nodes = BVHBuilder::make_tree_spatial( root, scene.objects ); }
+		else if( types[i].find("linear")==0 ){ n_nodes = BVHBuilder::make_tree_lbvh( root, scene.objects ); }
+		bool flat = types[i].find("flat") != std::string::npos;
+		if( types[i]=="sah-flat" ){ n_nodes = BVHBuilder::make_tree_sah( bvh, scene.objects ); }
+		else if( types[i]=="lbvh-flat" ){ n_nodes = BVHBuilder::make_tree_lbvh( bvh, scene.objects ); }
+		else if( flat ){ n_nodes = BVHBuilder::flatten( bvh, root ); }
+		std::chrono::duration<double> build_s = std::chrono::system_clock::now()-start;
+		if( flat ){ depth = bvh.depth(); }
+
+		// Closest hit for every ray
+		int hits = 0;
+		double t_sum = 0.0;
+		start = std::chrono::system_clock::now();
+#pragma omp parallel for reduction(+:hits,t_sum)
+		for( int r=0; r<n_rays; ++r ){
+			intersect::Payload payload( &rays[r] );
+			bool hit = flat ? BVHTraversal::closest_hit( bvh, &rays[r], &payload ) :
+				BVHTraversal::closest_hit( root, &rays[r], &payload );
+			if( hit ){ hits++; t_sum += payload.t_max; }
+		}
+		std::chrono::duration<double> query_s = std::chrono::system_clock::now()-start;
+
+		double rays_per_s = n_rays / query_s.count();
+		std::cout << types[i] << "\t" << ( types[i].size() < 8 ? "\t" : "" ) << n_nodes << "\t" << depth << "\t" <<
+			build_s.count() << "\t" << rays_per_s << "\t" << hits << "\t" << t_sum << std::endl;
+		filestream << "\n" << types[i] << "\t" << n_nodes << "\t" << build_s.count() << "\t" << rays_per_s << "\t" << hits;
+	}
+
+	// Refitting is what deforming meshes pay each frame instead of a rebuild
+	const int n_refits = 10;
+	time_point start = std::chrono::system_clock::now();
+	for( int i=0; i<n_refits; ++i ){ bvh.refit(); }
+	std::chrono::duration<double> refit_s = std::chrono::system_clock::now()-start;
+	std::cout << "refit lbvh-flat: " << refit_s.count()/double(n_refits) << " s" << std::endl;
+
+	// Closest points from random points in the box, checked against brute force on a few
+	const int n_points = 100000, n_checked = 100;
+	std::vector<vec> points( n_points );
+	for( int i=0; i<n_points; ++i ){
+		points[i] = vec( bmin[0]+rand01(gen)*(bmax[0]-bmin[0]), bmin[1]+rand01(gen)*(bmax[1]-bmin[1]), bmin[2]+rand01(gen)*(bmax[2]-bmin[2]) );
+	}
+	std::vector<ProximityHit> hits;
+	start = std::chrono::system_clock::now();
+	BVHTraversal::closest_point( bvh, points, hits );
+	std::chrono::duration<double> closest_s = std::chrono::system_clock::now()-start;
+	int n_wrong = 0;
+	for( int i=0; i<n_checked; ++i ){
+		float best = std::numeric_limits<float>::max();
+		for( int j=0; j<bvh.prims.size(); ++j ){
+			vec point, bary;
+			best = std::min( best, bvh.prims[j]->closest_point( points[i], point, bary ) );
+		}
+		if( hits[i].prim < 0 || hits[i].dist2 > best ){ n_wrong++; }
+	}
+	std::cout << "closest points/s: " << n_points/closest_s.count() << ", wrong: " << n_wrong << "/" << n_checked << std::endl;
+
+	// Everything near the surface
+	std::vector<int> offsets;
+	std::vector<float> radii( 1, 0.01f*len(bmax-bmin) );
+	start = std::chrono::system_clock::now();
+	BVHTraversal::sphere_overlap( bvh, points, radii, offsets, hits );
+	std::chrono::duration<double> sphere_s = std::chrono::system_clock::now()-start;
+	std::cout << "sphere queries/s: " << n_points/sphere_s.count() << ", hits: " << hits.size() << std::endl;
+
+	filestream.close();
+}
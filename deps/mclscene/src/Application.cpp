@@ -115,6 +115,7 @@ int Application::display(){
 	screen_dt = 0.f;
 	while( !glfwWindowShouldClose(window) ){
 
+		MCL_TRACE_SPAN( "render", "Application::frame" );
 		//
 		//	Update
 		//
@@ -130,6 +131,7 @@ int Application::display(){
 
 			// Recalculate normals for trimeshes and tetmeshes
 			// Maybe make the simulator do this?
+			MCL_TRACE_SPAN( "render", "Application::normals" );
 			for( int o=0; o<scene->objects.size(); ++o ){
 				trimesh::TriMesh *themesh = scene->objects[o]->get_TriMesh().get();
 				if( themesh==NULL ){ continue; }
@@ -160,6 +162,7 @@ int Application::display(){
 		}
 
 		{ // Finalize:
+			MCL_TRACE_SPAN( "render", "Application::swap" );
 			glfwSwapBuffers(window);
 			glfwPollEvents();
 			if(settings.save_frames){ save_screenshot(window); }
@@ -208,6 +211,10 @@ void Application::key_callback(GLFWwindow* window, int key, int scancode, int ac
 		settings.save_frames=!settings.save_frames;
 		std::cout << "save screenshots: " << (int)settings.save_frames << std::endl;
 		break;
+	case GLFW_KEY_T:
+		if( trace::save( MCLSCENE_BUILD_DIR "/trace.json" ) ){ std::cout << "saved " << MCLSCENE_BUILD_DIR << "/trace.json" << std::endl; }
+		else{ std::cerr << "\n**Application Error: Could not write " << MCLSCENE_BUILD_DIR << "/trace.json" << std::endl; }
+		break;
 	default:
 	    break;
 	}
@@ -21,31 +21,176 @@
 
 #include "MCL/BVH.hpp"
 #include <chrono>
-#include <bitset>
+#include <limits>
+#include <cmath>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace mcl;
 
 namespace helper {
-	// use: bool is_one = helper::check_bit( myInt, bit_position );
-	static inline bool check_bit( morton_type variable, int bit ){
-		std::bitset<sizeof(morton_type)*8> bs(variable);
-		return ( bs[bit]==1 );
+	// Box for the builders' inner loops. Unlike AABB it doesn't
+	// use trimesh's min/max, which lock an omp critical section.
+	struct Box {
+		float bmin[3], bmax[3];
+		Box(){ for( int i=0; i<3; ++i ){ bmin[i]=std::numeric_limits<float>::max(); bmax[i]=-bmin[i]; } }
+		inline void grow( const trimesh::vec &p ){
+			for( int i=0; i<3; ++i ){ bmin[i] = std::min( bmin[i], p[i] ); bmax[i] = std::max( bmax[i], p[i] ); }
+		}
+		inline void grow( const Box &b ){
+			for( int i=0; i<3; ++i ){ bmin[i] = std::min( bmin[i], b.bmin[i] ); bmax[i] = std::max( bmax[i], b.bmax[i] ); }
+		}
+		inline float surface_area() const {
+			float d[3]; for( int i=0; i<3; ++i ){ d[i] = std::max( bmax[i]-bmin[i], 0.f ); }
+			return 2.f * ( d[0]*d[1] + d[1]*d[2] + d[2]*d[0] );
+		}
+	};
+
+	// Slab test of a flat node against the part of the ray in [t_min,t_max]
+	static inline bool ray_node( const FlatBVHNode &node, const trimesh::vec &origin, const trimesh::vec &inv_dir,
+		double t_min, double t_max ){
+		float t0 = t_min, t1 = t_max;
+		for( int i=0; i<3; ++i ){
+			float tn = ( node.bmin[i] - origin[i] ) * inv_dir[i];
+			float tf = ( node.bmax[i] - origin[i] ) * inv_dir[i];
+			if( tn > tf ){ std::swap( tn, tf ); }
+			t0 = tn > t0 ? tn : t0;
+			t1 = tf < t1 ? tf : t1;
+			if( t0 > t1 ){ return false; }
+		}
+		return true;
 	}
-}
 
-static inline morton_type morton_encode(const morton_encode_type x, const morton_encode_type y, const morton_encode_type z){
-	int n_iters = sizeof(morton_type)*8;
-	// Step through the bits and assign them. The x2 for i is required to round-robinish interleaving
-	// and differs from typical morton encoding. Without them, I got thin slices along the x and z axes.
-	morton_type result = 0;
-	for( morton_type i = 0; i<n_iters; ++i ){
-		result |= (x & (morton_type(1) << i)) << i*2
-			| (y & (morton_type(1) << i)) << (i*2 + 1)
-			| (z & (morton_type(1) << i)) << (i*2 + 2);
-	}
-	return result;
-}
+	// Spreads the low 10 (or 21) bits out so there are two zeros between each
+	static inline morton_type expand_bits_10( morton_type v ){
+		v &= 0x3ff;
+		v = ( v | (v << 16) ) & 0x30000ff;
+		v = ( v | (v << 8) ) & 0x300f00f;
+		v = ( v | (v << 4) ) & 0x30c30c3;
+		v = ( v | (v << 2) ) & 0x9249249;
+		return v;
+	}
+	static inline morton_type expand_bits_21( morton_type v ){
+		v &= 0x1fffff;
+		v = ( v | (v << 32) ) & 0x1f00000000ffffull;
+		v = ( v | (v << 16) ) & 0x1f0000ff0000ffull;
+		v = ( v | (v << 8) ) & 0x100f00f00f00f00full;
+		v = ( v | (v << 4) ) & 0x10c30c30c30c30c3ull;
+		v = ( v | (v << 2) ) & 0x1249249249249249ull;
+		return v;
+	}
+
+	// Morton code of a point in the unit cube, with x in the highest bit of each triple
+	static inline morton_type morton_encode( const float p[3], int morton_bits ){
+		const bool wide = morton_bits > 30;
+		const float scale = wide ? float(1<<21) : float(1<<10);
+		const float cell_max = scale - 1.f;
+		morton_type c[3];
+		for( int i=0; i<3; ++i ){ c[i] = morton_type( std::min( std::max( p[i]*scale, 0.f ), cell_max ) ); }
+		if( wide ){ return ( expand_bits_21(c[0]) << 2 ) | ( expand_bits_21(c[1]) << 1 ) | expand_bits_21(c[2]); }
+		return ( expand_bits_10(c[0]) << 2 ) | ( expand_bits_10(c[1]) << 1 ) | expand_bits_10(c[2]);
+	}
+
+	// Squared distance from a point to a flat node's box
+	static inline float node_dist2( const FlatBVHNode &node, const trimesh::vec &p ){
+		float d2 = 0.f;
+		for( int i=0; i<3; ++i ){
+			float d = std::max( std::max( node.bmin[i]-p[i], p[i]-node.bmax[i] ), 0.f );
+			d2 += d*d;
+		}
+		return d2;
+	}
+
+	// Runs query(i,results) for every query in parallel, appending to a per-thread
+	// buffer, then packs the results by query so those of i start at offsets[i].
+	template<typename T, typename F>
+	static inline void gather( int n_queries, std::vector<int> &offsets, std::vector<T> &results, const F &query ){
+		int n_threads = 1;
+#ifdef _OPENMP
+		n_threads = omp_get_max_threads();
+#endif
+		std::vector< std::vector<T> > buffers( n_threads );
+		std::vector<int> thread( n_queries ), begin( n_queries );
+		offsets.assign( n_queries+1, 0 );
+
+#pragma omp parallel for schedule(dynamic,64) num_threads(n_threads)
+		for( int i=0; i<n_queries; ++i ){
+			int tid = 0;
+#ifdef _OPENMP
+			tid = omp_get_thread_num();
+#endif
+			thread[i] = tid;
+			begin[i] = buffers[tid].size();
+			query( i, buffers[tid] );
+			offsets[i+1] = buffers[tid].size() - begin[i];
+		}
+
+		for( int i=0; i<n_queries; ++i ){ offsets[i+1] += offsets[i]; }
+		results.resize( offsets[n_queries] );
+#pragma omp parallel for schedule(static)
+		for( int i=0; i<n_queries; ++i ){
+			std::copy( buffers[thread[i]].begin()+begin[i], buffers[thread[i]].begin()+begin[i]+( offsets[i+1]-offsets[i] ),
+				results.begin()+offsets[i] );
+		}
+	}
+
+	// Parallel least significant digit radix sort of (code,index) pairs, 8 bits per pass.
+	// Each thread counts its own block of the input, so the scatter is stable.
+	static inline void radix_sort( std::vector<morton_type> &codes, std::vector<int> &idx, int morton_bits ){
+		const int n = codes.size();
+		const int radix = 256;
+		std::vector<morton_type> tmp_codes( n );
+		std::vector<int> tmp_idx( n );
+		int n_threads = 1;
+#ifdef _OPENMP
+		n_threads = omp_get_max_threads();
+#endif
+		std::vector<int> hist( n_threads*radix );
+
+		for( int shift=0; shift<morton_bits; shift += 8 ){
+			std::fill( hist.begin(), hist.end(), 0 );
+
+#pragma omp parallel num_threads(n_threads)
+			{
+				int tid = 0, nt = 1;
+#ifdef _OPENMP
+				tid = omp_get_thread_num(); nt = omp_get_num_threads();
+#endif
+				const int begin = int( (long long)n*tid/nt ), end = int( (long long)n*(tid+1)/nt );
+				int *h = &hist[tid*radix];
+				for( int i=begin; i<end; ++i ){ h[ (codes[i] >> shift) & 0xff ]++; }
+#pragma omp barrier
+#pragma omp single
+				{
+					// Exclusive scan in digit-major, thread-minor order
+					int sum = 0;
+					for( int d=0; d<radix; ++d ){
+						for( int t=0; t<nt; ++t ){ int c = hist[t*radix+d]; hist[t*radix+d] = sum; sum += c; }
+					}
+				}
+				for( int i=begin; i<end; ++i ){
+					int dst = h[ (codes[i] >> shift) & 0xff ]++;
+					tmp_codes[dst] = codes[i]; tmp_idx[dst] = idx[i];
+				}
+			}
+			codes.swap( tmp_codes ); idx.swap( tmp_idx );
+		}
+	}
+
+	// Length of the common prefix of two sorted codes. Duplicates are
+	// made unique by falling back to the prefix of their positions.
+	static inline int common_prefix( const std::vector<morton_type> &codes, int i, int j ){
+		if( j < 0 || j >= int(codes.size()) ){ return -1; }
+		const morton_type a = codes[i], b = codes[j];
+		if( a==b ){ return 64 + __builtin_clzll( (unsigned long long)(i^j) ); }
+		return __builtin_clzll( a^b );
+	}
 
+	// Inner node of the binary radix tree. Children are inner nodes, or leaves (sorted primitives) if flagged.
+	struct RadixNode { int first, last, left, right; bool left_leaf, right_leaf; };
+}
 
 // Used for stats:
 int BVHBuilder::n_nodes = 0;
@@ -54,71 +199,143 @@ int BVHBuilder::num_avg_balance = 0;
 float BVHBuilder::runtime_s = 0.f;
 
 
-int BVHBuilder::make_tree_lbvh( std::shared_ptr<BVHNode> &root, const std::vector< std::shared_ptr<BaseObject> > &objects, int max_depth ){
+int BVHBuilder::make_tree_lbvh( FlatBVH &bvh, const std::vector< std::shared_ptr<BaseObject> > &objects, int max_leaf, int morton_bits ){
 
 	std::chrono::time_point<std::chrono::system_clock> start, end;
 	start = std::chrono::system_clock::now();
 
-	root.reset( new BVHNode );
-
-	n_nodes = 1;
+	n_nodes = 0;
 	avg_balance = 0.f;
 	num_avg_balance = 0;
-
-	using namespace trimesh;
+	max_leaf = std::max( max_leaf, 1 );
+	morton_bits = morton_bits > 30 ? 63 : 30;
 
 	// Get all the primitives in the domain
-	std::vector< std::shared_ptr<BaseObject> > prims;
-	for( int i=0; i<objects.size(); ++i ){ objects[i]->get_primitives( prims ); }
+	bvh.clear();
+	for( int i=0; i<objects.size(); ++i ){ objects[i]->get_primitives( bvh.prims ); }
+	const int n_prims = bvh.prims.size();
+	if( n_prims==0 ){ return 0; }
 
-	if( prims.size()==0 ){ return 1; }
-
-	// Compute centroids
-	std::vector< vec > centroids( prims.size() );
-	AABB world_aabb;
-	for( int i=0; i<prims.size(); ++i ){
-		vec bmin, bmax; prims[i]->bounds( bmin, bmax );
-		world_aabb += bmin; world_aabb += bmax;
-		centroids[i]=( (bmin+bmax)*0.5f );
+	// Centroids, and the box around them that the codes are quantized in
+	std::vector<float> centers( 3*n_prims );
+#pragma omp parallel for
+	for( int i=0; i<n_prims; ++i ){
+		trimesh::vec bmin, bmax; bvh.prims[i]->bounds( bmin, bmax );
+		for( int j=0; j<3; ++j ){ centers[3*i+j] = ( bmin[j] + bmax[j] ) * 0.5f; }
+	}
+	helper::Box cbox;
+	for( int i=0; i<n_prims; ++i ){
+		for( int j=0; j<3; ++j ){
+			cbox.bmin[j] = std::min( cbox.bmin[j], centers[3*i+j] );
+			cbox.bmax[j] = std::max( cbox.bmax[j], centers[3*i+j] );
+		}
+	}
+	float inv_ext[3];
+	for( int j=0; j<3; ++j ){
+		float ext = cbox.bmax[j] - cbox.bmin[j];
+		inv_ext[j] = ext > 0.f ? 1.f/ext : 0.f;
 	}
 
-	float max_scaled = 1024.f;
-	vec world_min( world_aabb.min );
-	vec world_max( world_aabb.max );
-	vec world_len = max_scaled / (world_max-world_min);
-
-	// Assign morton codes
-	std::vector< std::pair< morton_type, int > > morton_codes( prims.size() );
+	// Assign morton codes and sort them
+	std::vector<morton_type> codes( n_prims );
+	std::vector<int> sorted( n_prims );
 #pragma omp parallel for
-	for( int i=0; i<prims.size(); ++i ){
-
-		// Scale the centroid to a value between 0 and max_scaled and convert to integer.
-		vec cent = centroids[i];
-		cent = ( cent - world_min ) * world_len;
-		morton_encode_type ix = morton_encode_type( cent[0] );
-		morton_encode_type iy = morton_encode_type( cent[1] );
-		morton_encode_type iz = morton_encode_type( cent[2] );
+	for( int i=0; i<n_prims; ++i ){
+		float p[3];
+		for( int j=0; j<3; ++j ){ p[j] = ( centers[3*i+j] - cbox.bmin[j] ) * inv_ext[j]; }
+		codes[i] = helper::morton_encode( p, morton_bits );
+		sorted[i] = i;
+	}
+	helper::radix_sort( codes, sorted, morton_bits );
+	bvh.indices = sorted;
 
-		morton_codes[i] = std::make_pair( morton_encode( ix, iy, iz ), i );
+	// Emit the radix tree. Every inner node finds its range and split
+	// from the sorted codes alone, so they're all done in parallel.
+	const int n_inner = n_prims-1;
+	std::vector<helper::RadixNode> tree( n_inner );
+#pragma omp parallel for
+	for( int i=0; i<n_inner; ++i ){
+
+		// Direction of the range, and the prefix it must exceed
+		const int d = helper::common_prefix( codes, i, i+1 ) > helper::common_prefix( codes, i, i-1 ) ? 1 : -1;
+		const int delta_min = helper::common_prefix( codes, i, i-d );
+
+		// Find the other end of the range
+		int l_max = 2;
+		while( helper::common_prefix( codes, i, i+l_max*d ) > delta_min ){ l_max *= 2; }
+		int l = 0;
+		for( int t=l_max/2; t>=1; t/=2 ){
+			if( helper::common_prefix( codes, i, i+(l+t)*d ) > delta_min ){ l += t; }
+		}
+		const int j = i + l*d;
+
+		// Find the split, where the prefix of the range changes
+		const int delta_node = helper::common_prefix( codes, i, j );
+		int s = 0;
+		for( int div=2; ; div*=2 ){
+			const int t = ( l + div - 1 ) / div;
+			if( helper::common_prefix( codes, i, i+(s+t)*d ) > delta_node ){ s += t; }
+			if( t<=1 ){ break; }
+		}
+		const int gamma = i + s*d + std::min( d, 0 );
+
+		helper::RadixNode &node = tree[i];
+		node.first = std::min( i, j );
+		node.last = std::max( i, j );
+		node.left = gamma;
+		node.right = gamma+1;
+		node.left_leaf = ( node.first == gamma );
+		node.right_leaf = ( node.last == gamma+1 );
 	}
 
-	// Find first non-zero most signficant bit
-	int start_bit = sizeof(morton_type)*8-1;
-	bool found=false;
-	for( ; start_bit > 1 && !found; --start_bit ){
+	// Lay the tree out depth first. Small ranges become one leaf, which
+	// is fine since their primitives are already contiguous in indices.
+	struct StackNode { int id; bool leaf; int depth; int parent; };
+	bvh.nodes.reserve( 2*n_prims );
+	bvh.parents.reserve( 2*n_prims );
+	std::vector<StackNode> stack;
+	StackNode root = { 0, n_prims==1, 0, -1 };
+	stack.push_back( root );
+	while( stack.size() > 0 ){
+		StackNode curr = stack.back(); stack.pop_back();
+
+		const int idx = bvh.nodes.size();
+		bvh.nodes.push_back( FlatBVHNode() );
+		bvh.parents.push_back( curr.parent );
+		if( curr.parent >= 0 && curr.parent != idx-1 ){ bvh.nodes[curr.parent].offset = idx; }
+
+		const int first = curr.leaf ? curr.id : tree[curr.id].first;
+		const int last = curr.leaf ? curr.id : tree[curr.id].last;
+		if( curr.leaf || last-first+1 <= max_leaf || curr.depth >= FlatBVH::max_depth ){
+			bvh.nodes[idx].offset = first;
+			bvh.nodes[idx].count = last-first+1;
+			continue;
+		}
 
-#pragma omp parallel for
-		for( int i=0; i<morton_codes.size(); ++i ){
-			if( helper::check_bit( morton_codes[i].first, start_bit ) ){
-#pragma omp critical
-				{ found=true; }
-			}
+		// The highest differing bit of the range is the split plane.
+		// Codes are interleaved as xyz, so its axis is the bit position mod 3.
+		const helper::RadixNode &node = tree[curr.id];
+		int axis = 0;
+		if( codes[first] != codes[last] ){
+			const int bit = 63 - __builtin_clzll( codes[first]^codes[last] );
+			axis = 2 - bit%3;
 		}
+		bvh.nodes[idx].count = -1-axis;
 
-	} // end find starting bit
+		const int n_left = node.left_leaf ? 1 : tree[node.left].last-tree[node.left].first+1;
+		const int n_right = node.right_leaf ? 1 : tree[node.right].last-tree[node.right].first+1;
+		avg_balance += float(n_left)/float(n_right);
+		num_avg_balance++;
+
+		StackNode right = { node.right, node.right_leaf, curr.depth+1, idx };
+		StackNode left = { node.left, node.left_leaf, curr.depth+1, idx };
+		stack.push_back( right );
+		stack.push_back( left );
+	}
 
-	// Now that we have the morton codes, we can recursively build the BVH in a top down manner
-	lbvh_split( root, start_bit, prims, morton_codes, max_depth );
+	// Boxes are computed bottom up
+	bvh.refit();
+	n_nodes = bvh.nodes.size();
 
 	end = std::chrono::system_clock::now();
 	std::chrono::duration<double> elapsed_seconds = end-start;
@@ -126,64 +343,65 @@ int BVHBuilder::make_tree_lbvh( std::shared_ptr<BVHNode> &root, const std::vecto
 
 	return n_nodes;
 
-}
+} // end build lbvh
 
 
-void BVHBuilder::lbvh_split( std::shared_ptr<BVHNode> &node,
-	const int bit, const std::vector< std::shared_ptr<BaseObject> > &prims,
-	const std::vector< std::pair< morton_type, int > > &morton_codes, const int max_depth ){
+int BVHBuilder::make_tree_lbvh( std::shared_ptr<BVHNode> &root, const std::vector< std::shared_ptr<BaseObject> > &objects, int max_depth ){
 
-	// First, see what bit we're at. If it's the last bit of the morton code,
-	// this is a child and we should add the objects to the scene.
-	if( bit == 0 || max_depth <= 0 || morton_codes.size() == 1 ){
-		node->m_objects.reserve( morton_codes.size() );
-		for( int i=0; i<morton_codes.size(); ++i ){ node->m_objects.push_back( prims[ morton_codes[i].second ] ); }
-	} // end add objects
+	std::chrono::time_point<std::chrono::system_clock> start, end;
+	start = std::chrono::system_clock::now();
 
-	// Check the morton codes at the bit.
-	// 0 = left child, 1 = right child.
-	else{
-		std::vector< std::pair< morton_type, int > > left_codes, right_codes;
-		for( int i=0; i<morton_codes.size(); ++i ){
+	FlatBVH bvh;
+	make_tree_lbvh( bvh, objects, 1 );
+	const float balance = avg_balance;
+	const int n_balance = num_avg_balance;
 
-			if( helper::check_bit( morton_codes[i].first, bit ) ){
-				right_codes.push_back( morton_codes[i] );
-			} else {
-				left_codes.push_back( morton_codes[i] );
-			}
+	root.reset( new BVHNode );
+	n_nodes = 1;
+	if( bvh.nodes.size() > 0 ){ n_nodes = unflatten_node( bvh, 0, root, max_depth ); }
+	avg_balance = balance;
+	num_avg_balance = n_balance;
 
-		} // end sort morton codes
+	end = std::chrono::system_clock::now();
+	std::chrono::duration<double> elapsed_seconds = end-start;
+	runtime_s = float(elapsed_seconds.count());
 
-		// Check to make sure things got sorted. Sometimes small meshes fail.
-		if( left_codes.size()==0 ){ left_codes.push_back( right_codes.back() ); right_codes.pop_back(); }
-		if( right_codes.size()==0 ){ right_codes.push_back( left_codes.back() ); left_codes.pop_back(); }
+	return n_nodes;
+}
 
-		avg_balance += float(left_codes.size())/float(right_codes.size());
-		num_avg_balance++;
-//		num_objects = left_codes.size()+right_codes.size();
 
-		// Create the children
-		node->left_child = std::shared_ptr<BVHNode>( new BVHNode() );
-		node->right_child = std::shared_ptr<BVHNode>( new BVHNode() );
-		lbvh_split( node->left_child, bit-1, prims, left_codes, max_depth-1 );
-		lbvh_split( node->right_child, bit-1, prims, right_codes, max_depth-1 );
-		n_nodes += 2;
+int BVHBuilder::unflatten_node( const FlatBVH &bvh, int idx, std::shared_ptr<BVHNode> &node, int depth ){
 
-	} // end create childrend
+	const FlatBVHNode &fnode = bvh.nodes[idx];
+	node->aabb->min = trimesh::vec( fnode.bmin[0], fnode.bmin[1], fnode.bmin[2] );
+	node->aabb->max = trimesh::vec( fnode.bmax[0], fnode.bmax[1], fnode.bmax[2] );
+	node->aabb->valid = true;
 
-	// Now that the tree is constructed, create the aabb
-	for( int i=0; i<node->m_objects.size(); ++i ){
-		trimesh::vec bmin, bmax;
-		node->m_objects[i]->bounds( bmin, bmax );
-		*(node->aabb) += bmin; *(node->aabb) += bmax;
+	// Below the max depth, everything goes in one leaf
+	if( fnode.is_leaf() || depth <= 0 ){
+		std::vector<int> stack( 1, idx );
+		while( stack.size() > 0 ){
+			const FlatBVHNode &curr = bvh.nodes[ stack.back() ];
+			const int curr_idx = stack.back(); stack.pop_back();
+			if( curr.is_leaf() ){
+				for( int i=curr.offset; i<curr.offset+curr.count; ++i ){ node->m_objects.push_back( bvh.prims[ bvh.indices[i] ] ); }
+				continue;
+			}
+			stack.push_back( curr.offset );
+			stack.push_back( curr_idx+1 );
+		}
+		return 1;
 	}
-	if( node->left_child != NULL ){ *(node->aabb) += *(node->left_child->aabb); }
-	if( node->right_child != NULL ){ *(node->aabb) += *(node->right_child->aabb); }
 
+	node->left_child = std::shared_ptr<BVHNode>( new BVHNode() );
+	node->right_child = std::shared_ptr<BVHNode>( new BVHNode() );
+	int n = 1;
+	n += unflatten_node( bvh, idx+1, node->left_child, depth-1 );
+	n += unflatten_node( bvh, fnode.offset, node->right_child, depth-1 );
+	return n;
 }
 
 
-
 int BVHBuilder::make_tree_spatial( std::shared_ptr<BVHNode> &root, const std::vector< std::shared_ptr<BaseObject> > &objects, int max_depth ){
 
 	std::chrono::time_point<std::chrono::system_clock> start, end;
@@ -256,6 +474,254 @@ void BVHBuilder::spatial_split( std::shared_ptr<BVHNode> &node, const std::vecto
 } // end build spatial split tree
 
 
+int BVHBuilder::make_tree_sah( FlatBVH &bvh, const std::vector< std::shared_ptr<BaseObject> > &objects, int max_leaf ){
+
+	std::chrono::time_point<std::chrono::system_clock> start, end;
+	start = std::chrono::system_clock::now();
+
+	n_nodes = 0;
+	avg_balance = 0.f;
+	num_avg_balance = 0;
+
+	// Get all the primitives in the domain
+	bvh.clear();
+	for( int i=0; i<objects.size(); ++i ){ objects[i]->get_primitives( bvh.prims ); }
+	const int n_prims = bvh.prims.size();
+	if( n_prims==0 ){ return 0; }
+
+	// Boxes and centroids are computed once and looked up by primitive
+	std::vector< trimesh::vec > prim_min( n_prims ), prim_max( n_prims ), centers( n_prims );
+	for( int i=0; i<n_prims; ++i ){
+		bvh.prims[i]->bounds( prim_min[i], prim_max[i] );
+		centers[i] = ( prim_min[i] + prim_max[i] ) * 0.5f;
+	}
+
+	bvh.indices.resize( n_prims );
+	std::iota( std::begin(bvh.indices), std::end(bvh.indices), 0 );
+	bvh.nodes.reserve( 2*n_prims );
+	sah_split( bvh, prim_min, prim_max, centers, 0, n_prims, std::max( max_leaf, 1 ), 0 );
+	n_nodes = bvh.nodes.size();
+
+	end = std::chrono::system_clock::now();
+	std::chrono::duration<double> elapsed_seconds = end-start;
+	runtime_s = float(elapsed_seconds.count());
+
+	return n_nodes;
+}
+
+
+int BVHBuilder::sah_split( FlatBVH &bvh, std::vector<trimesh::vec> &prim_min, std::vector<trimesh::vec> &prim_max,
+	std::vector<trimesh::vec> &centers, int first, int count, int max_leaf, int depth ){
+	using namespace trimesh;
+
+	const int idx = bvh.nodes.size();
+	bvh.nodes.push_back( FlatBVHNode() );
+
+	// Box of the primitives and of their centers
+	helper::Box box, cbox;
+	for( int i=first; i<first+count; ++i ){
+		const int p = bvh.indices[i];
+		box.grow( prim_min[p] ); box.grow( prim_max[p] );
+		cbox.grow( centers[p] );
+	}
+	for( int j=0; j<3; ++j ){ bvh.nodes[idx].bmin[j] = box.bmin[j]; bvh.nodes[idx].bmax[j] = box.bmax[j]; }
+
+	if( count <= max_leaf || depth >= FlatBVH::max_depth ){
+		bvh.nodes[idx].offset = first;
+		bvh.nodes[idx].count = count;
+		return idx;
+	}
+
+	// Bin the centers along each axis and find the cheapest split between bins,
+	// cost = left_count*left_area + right_count*right_area.
+	const int n_bins = 16;
+	float best_cost = std::numeric_limits<float>::max();
+	int best_axis = -1, best_bin = -1;
+	const vec cext( cbox.bmax[0]-cbox.bmin[0], cbox.bmax[1]-cbox.bmin[1], cbox.bmax[2]-cbox.bmin[2] );
+	for( int axis=0; axis<3; ++axis ){
+		if( cext[axis] <= 0.f ){ continue; }
+
+		helper::Box bin_box[n_bins];
+		int bin_count[n_bins] = {0};
+		const float scale = float(n_bins) * ( 1.f - 1e-5f ) / cext[axis];
+		for( int i=first; i<first+count; ++i ){
+			const int p = bvh.indices[i];
+			int b = int( ( centers[p][axis] - cbox.bmin[axis] ) * scale );
+			b = std::min( std::max( b, 0 ), n_bins-1 );
+			bin_count[b]++;
+			bin_box[b].grow( prim_min[p] ); bin_box[b].grow( prim_max[p] );
+		}
+
+		// Right side areas by sweeping from the end
+		float right_area[n_bins];
+		int right_count[n_bins];
+		helper::Box acc; int n_acc = 0;
+		for( int b=n_bins-1; b>0; --b ){
+			acc.grow( bin_box[b] ); n_acc += bin_count[b];
+			right_area[b] = acc.surface_area();
+			right_count[b] = n_acc;
+		}
+
+		helper::Box left; int n_left = 0;
+		for( int b=0; b<n_bins-1; ++b ){
+			left.grow( bin_box[b] ); n_left += bin_count[b];
+			if( n_left==0 || right_count[b+1]==0 ){ continue; }
+			float cost = n_left*left.surface_area() + right_count[b+1]*right_area[b+1];
+			if( cost < best_cost ){ best_cost = cost; best_axis = axis; best_bin = b; }
+		}
+	}
+
+	// Partition the indices. If the centers all coincide, split the range in half.
+	int mid = first + count/2;
+	int axis = 0;
+	if( best_axis >= 0 ){
+		axis = best_axis;
+		const float scale = float(n_bins) * ( 1.f - 1e-5f ) / cext[axis];
+		const float cmin = cbox.bmin[axis];
+		int *split = std::partition( &bvh.indices[first], &bvh.indices[first]+count, [&]( int p ){
+			int b = int( ( centers[p][axis] - cmin ) * scale );
+			return std::min( std::max( b, 0 ), n_bins-1 ) <= best_bin;
+		});
+		mid = split - &bvh.indices[0];
+	}
+	else{
+		for( int j=1; j<3; ++j ){ if( cext[j] > cext[axis] ){ axis = j; } }
+	}
+
+	avg_balance += float(mid-first)/float(first+count-mid);
+	num_avg_balance++;
+
+	// Left child is the next node
+	sah_split( bvh, prim_min, prim_max, centers, first, mid-first, max_leaf, depth+1 );
+	int right = sah_split( bvh, prim_min, prim_max, centers, mid, first+count-mid, max_leaf, depth+1 );
+	bvh.nodes[idx].offset = right;
+	bvh.nodes[idx].count = -1-axis;
+	return idx;
+
+} // end build sah tree
+
+
+int BVHBuilder::flatten( FlatBVH &bvh, const std::shared_ptr<BVHNode> &root ){
+	bvh.clear();
+	if( root==NULL ){ return 0; }
+	flatten_node( bvh, root.get(), 0 );
+	return bvh.nodes.size();
+}
+
+
+int BVHBuilder::flatten_node( FlatBVH &bvh, const BVHNode *node, int depth ){
+
+	const int idx = bvh.nodes.size();
+	bvh.nodes.push_back( FlatBVHNode() );
+	for( int j=0; j<3; ++j ){ bvh.nodes[idx].bmin[j] = node->aabb->min[j]; bvh.nodes[idx].bmax[j] = node->aabb->max[j]; }
+
+	// Subtrees below the max depth (or with a missing child) become one leaf
+	if( node->left_child==NULL || node->right_child==NULL || depth >= FlatBVH::max_depth ){
+		const int first = bvh.indices.size();
+		std::vector< const BVHNode* > stack( 1, node );
+		while( stack.size() > 0 ){
+			const BVHNode *curr = stack.back(); stack.pop_back();
+			for( int i=0; i<curr->m_objects.size(); ++i ){
+				bvh.indices.push_back( bvh.prims.size() );
+				bvh.prims.push_back( curr->m_objects[i] );
+			}
+			if( curr->right_child != NULL ){ stack.push_back( curr->right_child.get() ); }
+			if( curr->left_child != NULL ){ stack.push_back( curr->left_child.get() ); }
+		}
+		bvh.nodes[idx].offset = first;
+		bvh.nodes[idx].count = bvh.indices.size() - first;
+		return idx;
+	}
+
+	// The pointer trees don't store the split axis, so use
+	// the one that best separates the children.
+	trimesh::vec d = node->right_child->aabb->center() - node->left_child->aabb->center();
+	int axis = 0;
+	for( int j=1; j<3; ++j ){ if( std::abs(d[j]) > std::abs(d[axis]) ){ axis = j; } }
+
+	flatten_node( bvh, node->left_child.get(), depth+1 );
+	int right = flatten_node( bvh, node->right_child.get(), depth+1 );
+	bvh.nodes[idx].offset = right;
+	bvh.nodes[idx].count = -1-axis;
+	return idx;
+}
+
+
+int FlatBVH::depth() const {
+	if( nodes.size()==0 ){ return 0; }
+	int max_d = 0;
+	std::vector< std::pair<int,int> > stack( 1, std::make_pair(0,1) );
+	while( stack.size() > 0 ){
+		std::pair<int,int> curr = stack.back(); stack.pop_back();
+		max_d = std::max( max_d, curr.second );
+		const FlatBVHNode &node = nodes[ curr.first ];
+		if( node.is_leaf() ){ continue; }
+		stack.push_back( std::make_pair( curr.first+1, curr.second+1 ) );
+		stack.push_back( std::make_pair( node.offset, curr.second+1 ) );
+	}
+	return max_d;
+}
+
+
+void FlatBVH::bounds( trimesh::vec &bmin, trimesh::vec &bmax ) const {
+	if( nodes.size()==0 ){ bmin = trimesh::vec(0,0,0); bmax = bmin; return; }
+	bmin = trimesh::vec( nodes[0].bmin[0], nodes[0].bmin[1], nodes[0].bmin[2] );
+	bmax = trimesh::vec( nodes[0].bmax[0], nodes[0].bmax[1], nodes[0].bmax[2] );
+}
+
+
+void FlatBVH::refit(){
+	const int n_nodes = nodes.size();
+	if( n_nodes==0 ){ return; }
+
+	// Trees from the other builders don't keep parents
+	if( parents.size() != n_nodes ){
+		parents.assign( n_nodes, -1 );
+		for( int i=0; i<n_nodes; ++i ){
+			if( nodes[i].is_leaf() ){ continue; }
+			parents[i+1] = i;
+			parents[ nodes[i].offset ] = i;
+		}
+	}
+
+	// Each leaf grows its box, then walks up. Only the second
+	// child to reach an inner node continues, so both are done.
+	std::vector<int> visits( n_nodes, 0 );
+#pragma omp parallel for schedule(dynamic,64)
+	for( int i=0; i<n_nodes; ++i ){
+		FlatBVHNode &leaf = nodes[i];
+		if( !leaf.is_leaf() ){ continue; }
+
+		helper::Box box;
+		for( int j=leaf.offset; j<leaf.offset+leaf.count; ++j ){
+			trimesh::vec bmin, bmax;
+			prims[ indices[j] ]->bounds( bmin, bmax );
+			box.grow( bmin ); box.grow( bmax );
+		}
+		for( int j=0; j<3; ++j ){ leaf.bmin[j] = box.bmin[j]; leaf.bmax[j] = box.bmax[j]; }
+
+		int curr = parents[i];
+		while( curr >= 0 ){
+			int visited;
+#pragma omp flush
+#pragma omp atomic capture
+			visited = visits[curr]++;
+			if( visited==0 ){ break; }
+#pragma omp flush
+
+			FlatBVHNode &node = nodes[curr];
+			const FlatBVHNode &left = nodes[curr+1];
+			const FlatBVHNode &right = nodes[node.offset];
+			for( int j=0; j<3; ++j ){
+				node.bmin[j] = std::min( left.bmin[j], right.bmin[j] );
+				node.bmax[j] = std::max( left.bmax[j], right.bmax[j] );
+			}
+			curr = parents[curr];
+		}
+	}
+}
+
+
 //
 //	BVH Traversal
 //
@@ -317,6 +783,204 @@ bool BVHTraversal::any_hit( const std::shared_ptr<BVHNode> node, const intersect
 } // end ray intersect
 
 
+bool BVHTraversal::closest_hit( const FlatBVH &bvh, const intersect::Ray *ray, intersect::Payload *payload, int *prim ){
+
+	if( bvh.nodes.size()==0 ){ return false; }
+	const trimesh::vec inv_dir( 1.f/ray->direction[0], 1.f/ray->direction[1], 1.f/ray->direction[2] );
+
+	int stack[ FlatBVH::max_depth+1 ];
+	int n_stack = 0;
+	int curr = 0;
+	bool hit = false;
+	while( true ){
+
+		const FlatBVHNode &node = bvh.nodes[curr];
+		if( helper::ray_node( node, ray->origin, inv_dir, payload->t_min, payload->t_max ) ){
+
+			if( !node.is_leaf() ){
+				// Visit the near child first, so t_max shrinks sooner
+				if( inv_dir[ node.split_axis() ] < 0.f ){ stack[n_stack++] = curr+1; curr = node.offset; }
+				else{ stack[n_stack++] = node.offset; curr = curr+1; }
+				continue;
+			}
+
+			for( int i=0; i<node.count; ++i ){
+				const int p = bvh.indices[ node.offset+i ];
+				if( bvh.prims[p]->ray_intersect( ray, payload ) ){ hit = true; if( prim ){ *prim = p; } }
+			}
+		}
+
+		if( n_stack==0 ){ break; }
+		curr = stack[--n_stack];
+	}
+
+	return hit;
+
+} // end ray intersect
+
+
+bool BVHTraversal::any_hit( const FlatBVH &bvh, const intersect::Ray *ray, intersect::Payload *payload ){
+
+	if( bvh.nodes.size()==0 ){ return false; }
+	const trimesh::vec inv_dir( 1.f/ray->direction[0], 1.f/ray->direction[1], 1.f/ray->direction[2] );
+
+	int stack[ FlatBVH::max_depth+1 ];
+	int n_stack = 0;
+	int curr = 0;
+	while( true ){
+
+		const FlatBVHNode &node = bvh.nodes[curr];
+		if( helper::ray_node( node, ray->origin, inv_dir, payload->t_min, payload->t_max ) ){
+
+			if( !node.is_leaf() ){
+				stack[n_stack++] = node.offset;
+				curr = curr+1;
+				continue;
+			}
+
+			for( int i=0; i<node.count; ++i ){
+				if( bvh.prims[ bvh.indices[ node.offset+i ] ]->ray_intersect( ray, payload ) ){ return true; }
+			}
+		}
+
+		if( n_stack==0 ){ break; }
+		curr = stack[--n_stack];
+	}
+
+	return false;
+
+} // end ray intersect
+
+
+void BVHTraversal::closest_point( const FlatBVH &bvh, const std::vector<trimesh::vec> &points,
+	std::vector<ProximityHit> &hits, float max_dist ){
+
+	const int n_points = points.size();
+	hits.assign( n_points, ProximityHit() );
+	if( bvh.nodes.size()==0 ){ return; }
+	const float max_dist2 = max_dist < std::sqrt( std::numeric_limits<float>::max() ) ?
+		max_dist*max_dist : std::numeric_limits<float>::max();
+
+#pragma omp parallel for schedule(dynamic,64)
+	for( int q=0; q<n_points; ++q ){
+
+		const trimesh::vec &p = points[q];
+		ProximityHit &hit = hits[q];
+		float best = max_dist2;
+
+		// Nodes are pushed with their box distance, so the ones that
+		// are farther than the closest point found since can be skipped.
+		std::pair<int,float> stack[ FlatBVH::max_depth+1 ];
+		int n_stack = 0;
+		float root_d2 = helper::node_dist2( bvh.nodes[0], p );
+		if( root_d2 <= best ){ stack[n_stack++] = std::make_pair( 0, root_d2 ); }
+
+		while( n_stack > 0 ){
+			const std::pair<int,float> curr = stack[--n_stack];
+			if( curr.second > best ){ continue; }
+			const FlatBVHNode &node = bvh.nodes[curr.first];
+
+			if( node.is_leaf() ){
+				for( int i=node.offset; i<node.offset+node.count; ++i ){
+					const int prim = bvh.indices[i];
+					trimesh::vec point, bary;
+					float d2 = bvh.prims[prim]->closest_point( p, point, bary );
+					if( d2 < 0.f || d2 > best ){ continue; }
+					best = d2;
+					hit.prim = prim; hit.dist2 = d2; hit.point = point; hit.bary = bary;
+				}
+				continue;
+			}
+
+			// Near child on top of the stack
+			int near = curr.first+1, far = node.offset;
+			float near_d2 = helper::node_dist2( bvh.nodes[near], p ), far_d2 = helper::node_dist2( bvh.nodes[far], p );
+			if( far_d2 < near_d2 ){ std::swap( near, far ); std::swap( near_d2, far_d2 ); }
+			if( far_d2 <= best ){ stack[n_stack++] = std::make_pair( far, far_d2 ); }
+			if( near_d2 <= best ){ stack[n_stack++] = std::make_pair( near, near_d2 ); }
+		}
+	}
+
+} // end closest point
+
+
+void BVHTraversal::sphere_overlap( const FlatBVH &bvh, const std::vector<trimesh::vec> &centers, const std::vector<float> &radii,
+	std::vector<int> &offsets, std::vector<ProximityHit> &hits ){
+
+	const int n_spheres = radii.size()==0 ? 0 : centers.size();
+	if( bvh.nodes.size()==0 ){ offsets.assign( n_spheres+1, 0 ); hits.clear(); return; }
+
+	helper::gather( n_spheres, offsets, hits, [&]( int q, std::vector<ProximityHit> &results ){
+
+		const trimesh::vec &p = centers[q];
+		const float r = radii.size()==1 ? radii[0] : radii[q];
+		const float r2 = r*r;
+
+		int stack[ FlatBVH::max_depth+1 ];
+		int n_stack = 0;
+		stack[n_stack++] = 0;
+		while( n_stack > 0 ){
+			const int curr = stack[--n_stack];
+			const FlatBVHNode &node = bvh.nodes[curr];
+			if( helper::node_dist2( node, p ) > r2 ){ continue; }
+
+			if( node.is_leaf() ){
+				for( int i=node.offset; i<node.offset+node.count; ++i ){
+					ProximityHit hit;
+					hit.prim = bvh.indices[i];
+					hit.dist2 = bvh.prims[hit.prim]->closest_point( p, hit.point, hit.bary );
+					if( hit.dist2 >= 0.f && hit.dist2 <= r2 ){ results.push_back( hit ); }
+				}
+				continue;
+			}
+			stack[n_stack++] = node.offset;
+			stack[n_stack++] = curr+1;
+		}
+	});
+
+} // end sphere overlap
+
+
+void BVHTraversal::aabb_overlap( const FlatBVH &bvh, const std::vector<AABB> &boxes,
+	std::vector<int> &offsets, std::vector<int> &prims ){
+
+	const int n_boxes = boxes.size();
+	if( bvh.nodes.size()==0 ){ offsets.assign( n_boxes+1, 0 ); prims.clear(); return; }
+
+	helper::gather( n_boxes, offsets, prims, [&]( int q, std::vector<int> &results ){
+
+		float qmin[3], qmax[3];
+		for( int j=0; j<3; ++j ){ qmin[j] = boxes[q].min[j]; qmax[j] = boxes[q].max[j]; }
+
+		int stack[ FlatBVH::max_depth+1 ];
+		int n_stack = 0;
+		stack[n_stack++] = 0;
+		while( n_stack > 0 ){
+			const int curr = stack[--n_stack];
+			const FlatBVHNode &node = bvh.nodes[curr];
+			bool overlap = true;
+			for( int j=0; j<3 && overlap; ++j ){ overlap = node.bmin[j] <= qmax[j] && node.bmax[j] >= qmin[j]; }
+			if( !overlap ){ continue; }
+
+			if( node.is_leaf() ){
+				for( int i=node.offset; i<node.offset+node.count; ++i ){
+					const int prim = bvh.indices[i];
+					trimesh::vec bmin, bmax;
+					bvh.prims[prim]->bounds( bmin, bmax );
+					bool prim_overlap = true;
+					for( int j=0; j<3 && prim_overlap; ++j ){ prim_overlap = bmin[j] <= qmax[j] && bmax[j] >= qmin[j]; }
+					if( prim_overlap ){ results.push_back( prim ); }
+				}
+				continue;
+			}
+			stack[n_stack++] = node.offset;
+			stack[n_stack++] = curr+1;
+		}
+	});
+
+} // end aabb overlap
+
+
 void BVHNode::get_edges( std::vector<trimesh::vec> &edges ){
 
 	using namespace trimesh;
@@ -26,6 +26,7 @@ using namespace mcl;
 
 bool RenderGL::init( mcl::SceneManager *scene_, AppCamera *cam_ ){
 
+	MCL_TRACE_SPAN( "render", "RenderGL::init" );
 	scene = scene_;
 	camera = cam_;
 
@@ -71,6 +72,7 @@ bool RenderGL::init( mcl::SceneManager *scene_, AppCamera *cam_ ){
 
 void RenderGL::draw_objects(){
 
+	MCL_TRACE_SPAN( "render", "RenderGL::draw_objects" );
 	for( int i=0; i<scene->objects.size(); ++i ){
 		std::string mat = scene->objects[i]->get_material();
 		trimesh::TriMesh *themesh = scene->objects[i]->get_TriMesh().get();
@@ -91,6 +93,7 @@ void RenderGL::draw_objects(){
 
 void RenderGL::draw_objects_subdivided(){
 
+	MCL_TRACE_SPAN( "render", "RenderGL::draw_objects_subdivided" );
 	for( int i=0; i<scene->objects.size(); ++i ){
 		std::string mat = scene->objects[i]->get_material();
 		trimesh::TriMesh *themesh = scene->objects[i]->get_TriMesh().get();
@@ -118,6 +121,7 @@ void RenderGL::draw_objects_subdivided(){
 
 void RenderGL::draw_mesh( trimesh::TriMesh *themesh, std::shared_ptr<BaseMaterial> mat, bool solid ){
 
+	MCL_TRACE_SPAN( "render", "RenderGL::draw_mesh" );
 	if( themesh==NULL ){ return; }
 
 	// Vertices
@@ -229,6 +233,7 @@ void RenderGL::draw_mesh( trimesh::TriMesh *themesh, std::shared_ptr<BaseMateria
 
 void RenderGL::draw_lights(){
 
+	MCL_TRACE_SPAN( "render", "RenderGL::draw_lights" );
 	for( int i=0; i<point_lights.size(); ++i ){
 		//TODO
 	}
@@ -36,6 +36,7 @@ SceneManager::SceneManager() {
 
 bool SceneManager::load( std::string filename ){
 
+	MCL_TRACE_SPAN( "scene", "SceneManager::load" );
 	//
 	//	Load the XML file into mcl::Component
 	//
@@ -211,6 +212,7 @@ void SceneManager::save( std::string xmlfile, int mode ){
 
 void SceneManager::build_bvh( std::string split_mode ){
 
+	MCL_TRACE_SPAN( "scene", "SceneManager::build_bvh" );
 	if( root_bvh==NULL ){ root_bvh = std::shared_ptr<BVHNode>( new BVHNode() ); }
 	else{ root_bvh.reset( new BVHNode() ); }
 
@@ -0,0 +1,233 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//
+//	Headless benchmark of a scene file: loads and initializes it through SimContext
+//	(no window or GL context), runs the solver for some steps and reports the
+//	initialize time, percentiles of the step time, steps/sec and the time spent in
+//	each part of the step and force type (System::stats). Results are also written
+//	as json, and the stats of each step as csv with -csv. With -trace, the timeline
+//	spans of the run (MCL/Trace.hpp) are saved as a Chrome trace.
+//
+//	admm-bench <scene.xml> [-steps <int>] [-warmup <int>] [-threads <int>] [-out <file.json>] [-csv <file.csv>] [-trace <file.json>]
+//	plus any of the solver args (see System::Settings::help), which override the scene.
+//
+
+#include "SimContext.hpp"
+#include <chrono>
+#include <fstream>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+struct Stats {
+	double mean, min, p50, p90, p99, max;
+};
+
+// Nearest rank percentiles
+static Stats get_stats( std::vector<double> vals ){
+	Stats s = { 0, 0, 0, 0, 0, 0 };
+	if( vals.size()==0 ){ return s; }
+	std::sort( vals.begin(), vals.end() );
+	for( int i=0; i<vals.size(); ++i ){ s.mean += vals[i]; }
+	s.mean /= double( vals.size() );
+	auto rank = [&]( double p ){
+		int r = int( std::ceil( p*vals.size() ) ) - 1;
+		return vals[ std::max( 0, std::min( r, int(vals.size())-1 ) ) ];
+	};
+	s.min = vals.front(); s.p50 = rank(0.5); s.p90 = rank(0.9); s.p99 = rank(0.99); s.max = vals.back();
+	return s;
+}
+
+static std::string json_string( const std::string &str ){
+	std::stringstream ss; ss << '"';
+	for( int i=0; i<str.size(); ++i ){
+		if( str[i]=='"' || str[i]=='\\' ){ ss << '\\'; }
+		ss << str[i];
+	}
+	ss << '"';
+	return ss.str();
+}
+
+static std::string json_stats( const Stats &s ){
+	std::stringstream ss;
+	ss << "{ \"mean\": " << s.mean << ", \"min\": " << s.min << ", \"p50\": " << s.p50 <<
+		", \"p90\": " << s.p90 << ", \"p99\": " << s.p99 << ", \"max\": " << s.max << " }";
+	return ss.str();
+}
+
+static void help(){
+	std::cout << "\nUsage: admm-bench <scene.xml> [-steps <int>] [-warmup <int>] [-threads <int>] [-out <file.json>] [-csv <file.csv>] [-trace <file.json>]" <<
+		"\n\tplus solver args, see below" << std::endl;
+	admm::System::Settings().help();
+}
+
+
+int main(int argc, char *argv[]){
+
+	if( argc < 2 || std::string(argv[1])=="-help" ){ help(); return 0; }
+	std::string scene_file = argv[1];
+	int n_steps = 100, n_warmup = 5, n_threads = 0;
+	std::string out_file = std::string(OUTPUT_DIR) + "/admm_bench.json", csv_file, trace_file;
+	for( int i=2; i<argc-1; ++i ){
+		std::string arg( argv[i] );
+		std::stringstream val( argv[i+1] );
+		if( arg == "-steps" ){ val >> n_steps; }
+		else if( arg == "-warmup" ){ val >> n_warmup; }
+		else if( arg == "-threads" ){ val >> n_threads; }
+		else if( arg == "-out" ){ val >> out_file; }
+		else if( arg == "-csv" ){ val >> csv_file; }
+		else if( arg == "-trace" ){ val >> trace_file; }
+	}
+#ifdef _OPENMP
+	if( n_threads > 0 ){ omp_set_num_threads( n_threads ); }
+	n_threads = omp_get_max_threads();
+#else
+	n_threads = 1;
+#endif
+
+	//
+	//	Load and initialize, solver args override the scene
+	//
+	std::unique_ptr<SimContext> context( new SimContext );
+	Clock::time_point t0 = Clock::now();
+	try { context->load( scene_file ); }
+	catch( const std::exception &e ){ std::cerr << e.what() << std::endl; return 1; }
+	double load_s = std::chrono::duration<double>( Clock::now() - t0 ).count();
+
+	context->system->settings.verbose = 0;
+	context->system->settings.parse_args( argc, argv );
+	context->system->settings.stats = true;
+	context->system->settings.stats_steps = std::max( n_steps, 1 );
+
+	t0 = Clock::now();
+	try { context->initialize(); }
+	catch( const std::exception &e ){ std::cerr << e.what() << std::endl; return 1; }
+	double init_s = std::chrono::duration<double>( Clock::now() - t0 ).count();
+
+	const admm::System &system = *context->system;
+	int n_forces = system.forces.size();
+	for( int i=0; i<system.force_batches.size(); ++i ){ n_forces += system.force_batches[i]->size(); }
+	std::cout << "Scene " << scene_file << ": " << system.m_x.size()/3 << " nodes, " << n_forces <<
+		" forces, " << n_threads << " threads" << std::endl;
+
+	//
+	//	Run the steps
+	//
+	for( int i=0; i<n_warmup; ++i ){
+		if( !context->system->step() ){ std::cerr << "\n**admm-bench Error: step failed" << std::endl; return 1; }
+	}
+	context->system->stats.clear();
+	std::vector<double> step_s;
+	t0 = Clock::now();
+	for( int i=0; i<n_steps; ++i ){
+		Clock::time_point ts = Clock::now();
+		if( !context->system->step() ){ std::cerr << "\n**admm-bench Error: step failed" << std::endl; return 1; }
+		step_s.push_back( std::chrono::duration<double>( Clock::now() - ts ).count() );
+	}
+	double run_s = std::chrono::duration<double>( Clock::now() - t0 ).count();
+	double steps_per_s = run_s > 0.0 ? n_steps / run_s : 0.0;
+
+	// Phases of the step, then the local step by force type
+	const admm::StepStats &stats = system.stats;
+	const int n_phases = 6, n_types = stats.force_types.size();
+	const char *phase_names[n_phases] = { "explicit", "active_set", "Dx", "local", "rhs", "solve" };
+	std::vector< std::vector<double> > phase_s( n_phases + n_types );
+	std::vector<double> iters, primal, dual;
+	for( int i=0; i<stats.size(); ++i ){
+		const admm::StepStats::Step &st = stats[i];
+		double vals[n_phases] = { st.explicit_s, st.active_set_s, st.Dx_s, st.local_s, st.rhs_s, st.solve_s };
+		for( int j=0; j<n_phases; ++j ){ phase_s[j].push_back( vals[j] ); }
+		for( int j=0; j<n_types; ++j ){ phase_s[n_phases+j].push_back( st.local_type_s[j] ); }
+		iters.push_back( st.iters );
+		primal.push_back( st.primal_residual );
+		dual.push_back( st.dual_residual );
+	}
+
+	Stats step = get_stats( step_s );
+	std::vector<Stats> phases;
+	for( int j=0; j<phase_s.size(); ++j ){ phases.push_back( get_stats( phase_s[j] ) ); }
+	double other_s = step.mean;
+	for( int j=0; j<n_phases; ++j ){ other_s -= phases[j].mean; }
+
+	//
+	//	Report
+	//
+	std::cout << "load: " << load_s << "s, initialize: " << init_s << "s" << std::endl;
+	std::cout << "step (s): mean " << step.mean << ", p50 " << step.p50 << ", p90 " << step.p90 <<
+		", p99 " << step.p99 << ", max " << step.max << std::endl;
+	std::cout << "steps/sec: " << steps_per_s << ", admm iters/step: " << get_stats( iters ).mean <<
+		", residuals: primal " << get_stats( primal ).mean << ", dual " << get_stats( dual ).mean << std::endl;
+	for( int j=0; j<n_phases; ++j ){
+		std::cout << "\t" << phase_names[j] << ": " << phases[j].mean << "s (" <<
+			( step.mean > 0.0 ? 100.0*phases[j].mean/step.mean : 0.0 ) << "%)" << std::endl;
+		if( std::string( phase_names[j] ) != "local" ){ continue; }
+		for( int k=0; k<n_types; ++k ){
+			std::cout << "\t\t" << stats.force_types[k] << ": " << phases[n_phases+k].mean << "s" << std::endl;
+		}
+	}
+	std::cout << "\tother: " << other_s << "s" << std::endl;
+
+	std::ofstream out( out_file.c_str() );
+	if( !out.is_open() ){ std::cerr << "\n**admm-bench Error: Unable to write " << out_file << std::endl; return 1; }
+	out << "{\n" <<
+		"\t\"scene\": " << json_string( scene_file ) << ",\n" <<
+		"\t\"nodes\": " << system.m_x.size()/3 << ",\n" <<
+		"\t\"forces\": " << n_forces << ",\n" <<
+		"\t\"threads\": " << n_threads << ",\n" <<
+		"\t\"timestep_s\": " << system.settings.timestep_s << ",\n" <<
+		"\t\"admm_iters\": " << system.settings.admm_iters << ",\n" <<
+		"\t\"linear_solver\": " << json_string( system.settings.linear_solver ) << ",\n" <<
+		"\t\"warmup_steps\": " << n_warmup << ",\n" <<
+		"\t\"steps\": " << n_steps << ",\n" <<
+		"\t\"load_s\": " << load_s << ",\n" <<
+		"\t\"initialize_s\": " << init_s << ",\n" <<
+		"\t\"steps_per_s\": " << steps_per_s << ",\n" <<
+		"\t\"iters_per_step\": " << get_stats( iters ).mean << ",\n" <<
+		"\t\"primal_residual\": " << json_stats( get_stats( primal ) ) << ",\n" <<
+		"\t\"dual_residual\": " << json_stats( get_stats( dual ) ) << ",\n" <<
+		"\t\"step_s\": " << json_stats( step ) << ",\n" <<
+		"\t\"phases_s\": {\n";
+	for( int j=0; j<n_phases; ++j ){ out << "\t\t" << json_string( phase_names[j] ) << ": " << json_stats( phases[j] ) << ",\n"; }
+	out << "\t\t\"other\": { \"mean\": " << other_s << " }\n\t},\n" <<
+		"\t\"local_s\": {\n";
+	for( int k=0; k<n_types; ++k ){
+		out << "\t\t" << json_string( stats.force_types[k] ) << ": " << json_stats( phases[n_phases+k] ) <<
+			( k+1 < n_types ? ",\n" : "\n" );
+	}
+	out << "\t}\n}\n";
+	out.close();
+	std::cout << "Wrote " << out_file << std::endl;
+
+	if( csv_file.size() > 0 ){
+		std::ofstream csv( csv_file.c_str() );
+		if( !csv.is_open() ){ std::cerr << "\n**admm-bench Error: Unable to write " << csv_file << std::endl; return 1; }
+		stats.dump( csv );
+		std::cout << "Wrote " << csv_file << std::endl;
+	}
+
+	if( trace_file.size() > 0 ){
+		if( !mcl::trace::save( trace_file ) ){ std::cerr << "\n**admm-bench Error: Unable to write " << trace_file << std::endl; return 1; }
+		std::cout << "Wrote " << trace_file << std::endl;
+	}
+
+	return 0;
+}
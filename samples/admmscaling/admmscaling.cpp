@@ -0,0 +1,316 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//
+//	Scaling of the solver with problem size and thread count, on generated meshes:
+//	cloth grids (trimesh's symmetric plane) with springs, triangle strain or bending,
+//	and tetrahedralized boxes with linear strain, volume, neo-Hookean or StVK tets.
+//	For each mesh size (1k to 2M nodes), force type and thread count it reports the
+//	initialize and factorization times and the per-step D*x, local and global step
+//	times (see System::stats), as csv to stdout and a file.
+//
+//	admm-scaling [-min <nodes>] [-max <nodes>] [-threads <int,int,...>] [-forces <name,name,...>]
+//		[-steps <int>] [-out <file.csv>], plus any of the solver args (see System::Settings::help)
+//
+
+#include "TetForce.hpp"
+#include "TriangleForce.hpp"
+#include "BendForce.hpp"
+#include "System.hpp"
+#include "MCL/TetMesh.hpp"
+#include "TriMeshBuilder.h"
+#include <chrono>
+#include <fstream>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace admm;
+
+typedef std::chrono::steady_clock Clock;
+
+struct Case {
+	std::string force; // name used on the command line and in the output
+	bool tets; // box if true, otherwise cloth
+};
+
+static const Case cases[] = {
+	{ "spring", false }, { "trianglestrain", false }, { "bend", false },
+	{ "lineartetstrain", true }, { "tetvolume", true }, { "nh", true }, { "stvk", true }
+};
+
+static std::vector<std::string> split( const std::string &str ){
+	std::vector<std::string> items;
+	std::stringstream ss( str );
+	std::string item;
+	while( std::getline( ss, item, ',' ) ){ if( item.size() ){ items.push_back( item ); } }
+	return items;
+}
+
+
+//
+//	Meshes
+//
+
+// Cloth grid in the xy plane, [-1,1]^2 with about n_nodes nodes
+static std::shared_ptr<trimesh::TriMesh> make_cloth( int n_nodes ){
+	std::shared_ptr<trimesh::TriMesh> mesh( new trimesh::TriMesh() );
+	mesh->set_verbose(0);
+	int tess = std::max( 1, int( std::sqrt( n_nodes / 2.0 ) + 0.5 ) ); // (t+1)^2 + t^2 nodes
+	trimesh::make_sym_plane( mesh.get(), tess, tess );
+	return mesh;
+}
+
+// Box [-1,1]^3 with about n_nodes nodes, six tets per grid cell.
+// The cells are split along their main diagonal so the tets of neighboring cells match.
+static std::shared_ptr<mcl::TetMesh> make_box( int n_nodes ){
+	std::shared_ptr<mcl::TetMesh> mesh( new mcl::TetMesh() );
+	const int cells = std::max( 1, int( std::cbrt( double(n_nodes) ) + 0.5 ) - 1 );
+	const int n = cells+1;
+	mesh->vertices.reserve( n*n*n );
+	for( int i=0; i<n; ++i ){
+		for( int j=0; j<n; ++j ){
+			for( int k=0; k<n; ++k ){
+				mesh->vertices.push_back( trimesh::point( -1.f + 2.f*i/cells, -1.f + 2.f*j/cells, -1.f + 2.f*k/cells ) );
+			}
+		}
+	}
+	const int axes[6][3] = { {0,1,2}, {0,2,1}, {1,0,2}, {1,2,0}, {2,0,1}, {2,1,0} };
+	const int stride[3] = { n*n, n, 1 };
+	mesh->tets.reserve( 6*cells*cells*cells );
+	for( int i=0; i<cells; ++i ){
+		for( int j=0; j<cells; ++j ){
+			for( int k=0; k<cells; ++k ){
+				const int v0 = i*stride[0] + j*stride[1] + k*stride[2];
+				for( int p=0; p<6; ++p ){
+					int v1 = v0 + stride[ axes[p][0] ];
+					int v2 = v1 + stride[ axes[p][1] ];
+					int v3 = v2 + stride[ axes[p][2] ];
+					if( p==1 || p==2 || p==5 ){ std::swap( v2, v3 ); } // odd permutations are inverted
+					mesh->tets.push_back( mcl::TetMesh::tet( v0, v1, v2, v3 ) );
+				}
+			}
+		}
+	}
+	return mesh;
+}
+
+
+//
+//	Forces
+//
+
+// Adds the nodes with uniform masses (1kg total)
+static void add_nodes( System &system, const std::vector<trimesh::point> &verts ){
+	const int n = verts.size();
+	Eigen::VectorXd x( 3*n ), m = Eigen::VectorXd::Constant( 3*n, 1.0/n );
+	for( int i=0; i<n; ++i ){ for( int j=0; j<3; ++j ){ x[3*i+j] = verts[i][j]; } }
+	system.add_nodes( x, m );
+}
+
+// Returns the number of elements
+static int add_cloth_forces( System &system, const std::string &force, std::shared_ptr<trimesh::TriMesh> mesh ){
+	const std::vector<trimesh::TriMesh::Face> &faces = mesh->faces;
+	int n_elements = 0;
+
+	if( force == "spring" ){
+		mesh->need_across_edge();
+		for( int f=0; f<faces.size(); ++f ){
+			for( int e=0; e<3; ++e ){
+				// Each interior edge once, from the face with the lower index
+				const int f_other = mesh->across_edge[f][e];
+				if( f_other >= 0 && f_other < f ){ continue; }
+				int a = faces[f][(e+1)%3], b = faces[f][(e+2)%3];
+				system.get_batch<SpringBatch>()->add( a, b, 100.0 );
+				++n_elements;
+			}
+		}
+	}
+	else if( force == "trianglestrain" ){
+		std::shared_ptr<LimitedTriangleStrainBatch> batch = system.get_batch<LimitedTriangleStrainBatch>();
+		for( int f=0; f<faces.size(); ++f ){ batch->add( faces[f][0], faces[f][1], faces[f][2], 100.0, 0.95, 1.05 ); }
+		n_elements = faces.size();
+	}
+	else if( force == "bend" ){
+		// Hinges in the same (Volino) order as the ForceBuilder
+		mesh->need_across_edge();
+		for( int f=0; f<faces.size(); ++f ){
+			for( int e=0; e<3; ++e ){
+				const int f_other = mesh->across_edge[f][e];
+				if( f_other < 0 || f_other < f ){ continue; }
+				const int p0 = faces[f][e], p1 = faces[f][(e+1)%3], p2 = faces[f][(e+2)%3];
+				int q = -1;
+				for( int j=0; j<3; ++j ){
+					if( faces[f_other][j] != p1 && faces[f_other][j] != p2 ){ q = faces[f_other][j]; }
+				}
+				system.get_batch<BendForceBatch>()->add( p0, q, p2, p1, 20.0 );
+				++n_elements;
+			}
+		}
+	}
+	return n_elements;
+}
+
+static int add_tet_forces( System &system, const std::string &force, std::shared_ptr<mcl::TetMesh> mesh ){
+	const std::vector<mcl::TetMesh::tet> &tets = mesh->tets;
+	for( int t=0; t<tets.size(); ++t ){
+		const int *v = tets[t].v;
+		if( force == "lineartetstrain" ){ system.get_batch<LinearTetStrainBatch>()->add( v[0], v[1], v[2], v[3], 100000.0 ); }
+		else if( force == "tetvolume" ){ system.get_batch<TetVolumeBatch>()->add( v[0], v[1], v[2], v[3], 100000.0, 0.95, 1.05 ); }
+		else{ system.get_batch<HyperElasticTetBatch>()->add( v[0], v[1], v[2], v[3], 100000.0, 100000.0, 10, force ); }
+	}
+	return tets.size();
+}
+
+
+//
+//	Runs one case, returning false on failure
+//
+struct Result {
+	Result() : nodes(0), elements(0), init_s(0), factor_s(0), step_s(0), Dx_s(0), local_s(0), global_s(0) {}
+	int nodes, elements;
+	double init_s, factor_s, step_s, Dx_s, local_s, global_s;
+};
+
+static bool run( const Case &c, int target_nodes, int argc, char *argv[], int n_steps, Result &r ){
+
+	std::shared_ptr<System> system( new System() );
+	system->settings.verbose = 0;
+	system->settings.parse_args( argc, argv );
+	system->settings.stats = true;
+
+	if( c.tets ){
+		std::shared_ptr<mcl::TetMesh> mesh = make_box( target_nodes );
+		add_nodes( *system, mesh->vertices );
+		r.elements = add_tet_forces( *system, c.force, mesh );
+	}
+	else{
+		std::shared_ptr<trimesh::TriMesh> mesh = make_cloth( target_nodes );
+		add_nodes( *system, mesh->vertices );
+		r.elements = add_cloth_forces( *system, c.force, mesh );
+	}
+	r.nodes = system->m_x.size()/3;
+
+	if( !system->initialize() ){ return false; }
+	r.init_s = system->stats.init.total_s;
+	r.factor_s = system->stats.init.solver_s;
+
+	// Start from a stretched and bent pose so every force has work to do
+	for( int i=0; i<r.nodes; ++i ){
+		double *p = &system->m_x[3*i];
+		p[2] += 0.1 * std::sin( 3.0*p[0] ) * std::cos( 2.0*p[1] );
+		p[0] *= 1.2;
+	}
+
+	// One warmup step, which isn't timed
+	if( !system->step() ){ return false; }
+	system->stats.clear();
+	for( int i=0; i<n_steps; ++i ){ if( !system->step() ){ return false; } }
+
+	r.step_s = 0.0; r.Dx_s = 0.0; r.local_s = 0.0; r.global_s = 0.0;
+	const StepStats &stats = system->stats;
+	for( int i=0; i<stats.size(); ++i ){
+		r.step_s += stats[i].total_s;
+		r.Dx_s += stats[i].Dx_s;
+		r.local_s += stats[i].local_s;
+		r.global_s += stats[i].rhs_s + stats[i].solve_s;
+	}
+	const double scale = 1.0 / std::max( stats.size(), 1 );
+	r.step_s *= scale; r.Dx_s *= scale; r.local_s *= scale; r.global_s *= scale;
+	return true;
+}
+
+
+int main(int argc, char *argv[]){
+
+	int min_nodes = 1000, max_nodes = 2000000, n_steps = 5;
+	std::vector<int> threads;
+	std::vector<std::string> forces;
+	std::string out_file = std::string(OUTPUT_DIR) + "/admm_scaling.csv";
+	for( int i=1; i<argc; ++i ){
+		std::string arg( argv[i] );
+		if( arg == "-help" ){
+			std::cout << "\nUsage: admm-scaling [-min <nodes>] [-max <nodes>] [-threads <int,int,...>]" <<
+				" [-forces <name,name,...>] [-steps <int>] [-out <file.csv>]\n\tforces:";
+			for( const Case &c : cases ){ std::cout << " " << c.force; }
+			std::cout << "\n\tplus solver args, see below" << std::endl;
+			System::Settings().help();
+			return 0;
+		}
+		if( i+1 >= argc ){ break; }
+		std::stringstream val( argv[i+1] );
+		if( arg == "-min" ){ val >> min_nodes; }
+		else if( arg == "-max" ){ val >> max_nodes; }
+		else if( arg == "-steps" ){ val >> n_steps; }
+		else if( arg == "-out" ){ val >> out_file; }
+		else if( arg == "-forces" ){ forces = split( argv[i+1] ); }
+		else if( arg == "-threads" ){
+			std::vector<std::string> t = split( argv[i+1] );
+			for( int j=0; j<t.size(); ++j ){ threads.push_back( std::max( 1, std::atoi( t[j].c_str() ) ) ); }
+		}
+	}
+
+	// Powers of two up to the max threads by default
+	int max_threads = 1;
+#ifdef _OPENMP
+	max_threads = omp_get_max_threads();
+#endif
+	if( threads.size() == 0 ){
+		for( int t=1; t<max_threads; t*=2 ){ threads.push_back( t ); }
+		threads.push_back( max_threads );
+	}
+
+	const int sizes[] = { 1000, 4000, 16000, 64000, 256000, 1000000, 2000000 };
+
+	std::ofstream out( out_file.c_str() );
+	if( !out.is_open() ){ std::cerr << "\n**admm-scaling Error: Unable to write " << out_file << std::endl; return 1; }
+	const std::string header = "mesh,force,nodes,elements,threads,init_s,factor_s,step_s,Dx_s,local_s,global_s,local_speedup,global_speedup";
+	out << header << std::endl;
+	std::cout << header << std::endl;
+
+	for( const Case &c : cases ){
+		if( forces.size() > 0 && std::find( forces.begin(), forces.end(), c.force ) == forces.end() ){ continue; }
+		for( int size : sizes ){
+			if( size < min_nodes || size > max_nodes ){ continue; }
+
+			Result first; // with threads[0], for the speedups
+			for( int t=0; t<threads.size(); ++t ){
+#ifdef _OPENMP
+				omp_set_num_threads( threads[t] );
+#endif
+				Result r;
+				if( !run( c, size, argc, argv, n_steps, r ) ){
+					std::cerr << "\n**admm-scaling Error: " << c.force << " with " << size << " nodes failed" << std::endl;
+					return 1;
+				}
+				if( t==0 ){ first = r; }
+
+				std::stringstream row;
+				row << ( c.tets ? "box" : "cloth" ) << ',' << c.force << ',' << r.nodes << ',' << r.elements << ',' <<
+					threads[t] << ',' << r.init_s << ',' << r.factor_s << ',' << r.step_s << ',' << r.Dx_s << ',' <<
+					r.local_s << ',' << r.global_s << ',' << first.local_s / r.local_s << ',' << first.global_s / r.global_s;
+				out << row.str() << std::endl;
+				std::cout << row.str() << std::endl;
+			}
+		}
+	}
+
+	std::cout << "Wrote " << out_file << std::endl;
+	return 0;
+}
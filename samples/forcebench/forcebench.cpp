@@ -0,0 +1,427 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//
+//	Throughput of the local step kernel (project) of each force type, on large batches
+//	of synthetic elements: every element gets its own randomly jittered rest shape and a
+//	random deformation. Reports elements/sec and ns/element for the best of a few repeats,
+//	and where perf_event_open is available (Linux, with kernel.perf_event_paranoid <= 2),
+//	cycles, instructions, cache misses and branch mispredicts per element in that repeat. Results go to
+//	stdout and a csv file, tagged with the compiler and cpu so runs can be compared.
+//
+//	force-bench [-n <elements>] [-reps <int>] [-threads <int>] [-forces <name,name,...>] [-out <file.csv>]
+//
+
+#include "TetForce.hpp"
+#include "TriangleForce.hpp"
+#include "BendForce.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace admm;
+using namespace Eigen;
+
+typedef std::chrono::steady_clock Clock;
+
+static std::vector<std::string> split( const std::string &str ){
+	std::vector<std::string> items;
+	std::stringstream ss( str );
+	std::string item;
+	while( std::getline( ss, item, ',' ) ){ if( item.size() ){ items.push_back( item ); } }
+	return items;
+}
+
+
+//
+//	Hardware counters of the process from perf_event_open. They're opened with inherit
+//	before any OpenMP threads start, so the pool threads are counted too. Counters that
+//	can't be opened (other platforms, most VMs and containers, perf_event_paranoid > 2)
+//	are reported as missing.
+//
+class PerfCounters {
+public:
+	enum { CYCLES, INSTRUCTIONS, CACHE_MISSES, BRANCH_MISSES, N_COUNTERS };
+
+	// Raw value, time enabled and time running of each counter
+	struct Sample { unsigned long long v[N_COUNTERS][3]; };
+
+	PerfCounters(){
+		for( int c=0; c<N_COUNTERS; ++c ){ fd[c] = -1; }
+#ifdef __linux__
+		const unsigned long long config[N_COUNTERS] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+		for( int c=0; c<N_COUNTERS; ++c ){
+			perf_event_attr attr;
+			std::memset( &attr, 0, sizeof(attr) );
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = config[c];
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			attr.inherit = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			fd[c] = syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 );
+		}
+#endif
+	}
+
+	~PerfCounters(){
+#ifdef __linux__
+		for( int c=0; c<N_COUNTERS; ++c ){ if( fd[c] >= 0 ){ close( fd[c] ); } }
+#endif
+	}
+
+	bool available( int c ) const { return fd[c] >= 0; }
+
+	Sample read() const {
+		Sample s;
+		std::memset( &s, 0, sizeof(s) );
+#ifdef __linux__
+		for( int c=0; c<N_COUNTERS; ++c ){
+			if( fd[c] >= 0 && ::read( fd[c], s.v[c], sizeof(s.v[c]) ) != sizeof(s.v[c]) ){ std::memset( s.v[c], 0, sizeof(s.v[c]) ); }
+		}
+#endif
+		return s;
+	}
+
+	// Count of counter c between two samples, scaled up if the counter was multiplexed.
+	// Negative if the counter isn't available.
+	double delta( const Sample &a, const Sample &b, int c ) const {
+		if( fd[c] < 0 || b.v[c][2] <= a.v[c][2] ){ return -1.0; }
+		return double( b.v[c][0] - a.v[c][0] ) * double( b.v[c][1] - a.v[c][1] ) / double( b.v[c][2] - a.v[c][2] );
+	}
+
+private:
+	int fd[N_COUNTERS];
+	PerfCounters( const PerfCounters& ); // prevent copies
+	void operator=( const PerfCounters& );
+};
+
+
+//
+//	Kernels
+//
+
+struct Case {
+	std::string force; // name used on the command line
+	std::string kernel; // class name in the output
+	int nodes; // per element
+};
+
+static const Case cases[] = {
+	{ "spring", "Spring", 2 },
+	{ "springbatch", "SpringBatch", 2 },
+	{ "bend", "BendForce", 4 },
+	{ "bendbatch", "BendForceBatch", 4 },
+	{ "trianglestrain", "LimitedTriangleStrain", 3 },
+	{ "trianglestrainbatch", "LimitedTriangleStrainBatch", 3 },
+	{ "fung", "FungTriangle", 3 },
+	{ "fungbatch", "FungTriangleBatch", 3 },
+	{ "triarea", "TriArea", 3 },
+	{ "triareabatch", "TriAreaBatch", 3 },
+	{ "lineartetstrain", "LinearTetStrain", 4 },
+	{ "lineartetstrainbatch", "LinearTetStrainBatch", 4 },
+	{ "tetvolume", "TetVolume", 4 },
+	{ "tetvolumebatch", "TetVolumeBatch", 4 },
+	{ "nh", "HyperElasticTet (nh)", 4 },
+	{ "nhbatch", "HyperElasticTetBatch (nh)", 4 },
+	{ "stvk", "HyperElasticTet (stvk)", 4 },
+	{ "stvkbatch", "HyperElasticTetBatch (stvk)", 4 }
+};
+
+// The elements of one case, either as Force objects (projected
+// in a parallel loop like System::project_forces) or a batch.
+struct Kernel {
+	std::vector< std::shared_ptr<Force> > forces;
+	std::shared_ptr<ForceBatch> batch;
+
+	int size() const { return batch ? batch->size() : forces.size(); }
+
+	// Initializes the elements and returns the number of rows of D
+	int initialize( const VectorXd &x ){
+		VectorXd v = VectorXd::Zero( x.size() ), m = VectorXd::Ones( x.size() );
+		std::vector< Triplet<double> > triplets;
+		std::vector<double> weights;
+		for( int i=0; i<forces.size(); ++i ){
+			forces[i]->initialize( x, v, m, 0.04 );
+			forces[i]->get_selector( x, triplets, weights );
+		}
+		if( batch ){
+			batch->initialize( x, v, m, 0.04 );
+			batch->get_selector( x, triplets, weights );
+		}
+		return weights.size();
+	}
+
+	void apply_Di( const VectorXd &x, VectorXd &Dx ) const {
+		for( int i=0; i<forces.size(); ++i ){ forces[i]->apply_Di( x, Dx ); }
+		if( batch ){ batch->apply_Di( x, Dx ); }
+	}
+
+	void project( const VectorXd &Dx, VectorXd &u, VectorXd &z ) const {
+		const int n = forces.size();
+#pragma omp parallel for
+		for( int i=0; i<n; ++i ){ forces[i]->project( 0.04, Dx, u, z ); }
+		if( batch ){ batch->project( 0.04, Dx, u, z ); }
+	}
+};
+
+// Adds an element on nodes p[0..c.nodes-1]
+static void add_element( const Case &c, const int *p, Kernel &k ){
+	const std::string &f = c.force;
+	if( f == "spring" ){ k.forces.push_back( std::shared_ptr<Force>( new Spring( p[0], p[1], 100.0 ) ) ); }
+	else if( f == "bend" ){ k.forces.push_back( std::shared_ptr<Force>( new BendForce( p[0], p[1], p[2], p[3], 20.0 ) ) ); }
+	else if( f == "trianglestrain" ){ k.forces.push_back( std::shared_ptr<Force>( new LimitedTriangleStrain( p[0], p[1], p[2], 100.0, 0.95, 1.05 ) ) ); }
+	else if( f == "fung" ){ k.forces.push_back( std::shared_ptr<Force>( new FungTriangle( p[0], p[1], p[2], 100.0, 0.95, 1.05 ) ) ); }
+	else if( f == "triarea" ){ k.forces.push_back( std::shared_ptr<Force>( new TriArea( p[0], p[1], p[2], 100.0, 10, 0.95, 1.05 ) ) ); }
+	else if( f == "lineartetstrain" ){ k.forces.push_back( std::shared_ptr<Force>( new LinearTetStrain( p[0], p[1], p[2], p[3], 100000.0 ) ) ); }
+	else if( f == "tetvolume" ){ k.forces.push_back( std::shared_ptr<Force>( new TetVolume( p[0], p[1], p[2], p[3], 100000.0, 0.95, 1.05 ) ) ); }
+	else if( f == "nh" || f == "stvk" ){
+		k.forces.push_back( std::shared_ptr<Force>( new HyperElasticTet( p[0], p[1], p[2], p[3], 100000.0, 100000.0, 10, f ) ) );
+	}
+	else if( f == "springbatch" ){
+		if( !k.batch ){ k.batch = std::shared_ptr<ForceBatch>( new SpringBatch() ); }
+		static_cast<SpringBatch*>( k.batch.get() )->add( p[0], p[1], 100.0 );
+	}
+	else if( f == "bendbatch" ){
+		if( !k.batch ){ k.batch = std::shared_ptr<ForceBatch>( new BendForceBatch() ); }
+		static_cast<BendForceBatch*>( k.batch.get() )->add( p[0], p[1], p[2], p[3], 20.0 );
+	}
+	else if( f == "fungbatch" ){
+		if( !k.batch ){ k.batch = std::shared_ptr<ForceBatch>( new FungTriangleBatch() ); }
+		static_cast<FungTriangleBatch*>( k.batch.get() )->add( p[0], p[1], p[2], 100.0 );
+	}
+	else if( f == "triareabatch" ){
+		if( !k.batch ){ k.batch = std::shared_ptr<ForceBatch>( new TriAreaBatch() ); }
+		static_cast<TriAreaBatch*>( k.batch.get() )->add( p[0], p[1], p[2], 100.0, 10, 0.95, 1.05 );
+	}
+	else if( f == "tetvolumebatch" ){
+		if( !k.batch ){ k.batch = std::shared_ptr<ForceBatch>( new TetVolumeBatch() ); }
+		static_cast<TetVolumeBatch*>( k.batch.get() )->add( p[0], p[1], p[2], p[3], 100000.0, 0.95, 1.05 );
+	}
+	else if( f == "trianglestrainbatch" ){
+		if( !k.batch ){ k.batch = std::shared_ptr<ForceBatch>( new LimitedTriangleStrainBatch() ); }
+		static_cast<LimitedTriangleStrainBatch*>( k.batch.get() )->add( p[0], p[1], p[2], 100.0, 0.95, 1.05 );
+	}
+	else if( f == "lineartetstrainbatch" ){
+		if( !k.batch ){ k.batch = std::shared_ptr<ForceBatch>( new LinearTetStrainBatch() ); }
+		static_cast<LinearTetStrainBatch*>( k.batch.get() )->add( p[0], p[1], p[2], p[3], 100000.0 );
+	}
+	else if( f == "nhbatch" || f == "stvkbatch" ){
+		if( !k.batch ){ k.batch = std::shared_ptr<ForceBatch>( new HyperElasticTetBatch() ); }
+		static_cast<HyperElasticTetBatch*>( k.batch.get() )->add( p[0], p[1], p[2], p[3], 100000.0, 100000.0, 10, f.substr( 0, f.size()-5 ) );
+	}
+}
+
+// Rest shape of an element: a spring, a triangle, a hinge (wing nodes first, like
+// ForceBuilder's bend forces) or a tet. Each element is jittered and deformed by a
+// random F near identity plus some node noise, which bends the hinges out of plane.
+static void element_nodes( const Case &c, std::mt19937 &gen, Matrix<double,3,4> &rest, Matrix<double,3,4> &deformed ){
+	std::uniform_real_distribution<double> rand( -1.0, 1.0 );
+	rest.setZero();
+	if( c.force == "bend" ){ rest << 0.5, 0.5, 0.0, 1.0,  -0.8, 0.8, 0.0, 0.0,  0.0, 0.0, 0.0, 0.0; }
+	else{ rest << 0.0, 1.0, 0.0, 0.0,  0.0, 0.0, 1.0, 0.0,  0.0, 0.0, 0.0, 1.0; }
+	Matrix3d F;
+	for( int i=0; i<3; ++i ){
+		for( int j=0; j<3; ++j ){ F(i,j) = ( i==j ? 1.0 : 0.0 ) + 0.2*rand(gen); }
+	}
+	for( int j=0; j<c.nodes; ++j ){
+		for( int i=0; i<3; ++i ){ rest(i,j) += 0.1*rand(gen); }
+		deformed.col(j) = F * rest.col(j);
+		for( int i=0; i<3; ++i ){ deformed(i,j) += 0.05*rand(gen); }
+	}
+}
+
+
+struct Result {
+	Result() : n(0), rows(0), reps(0), best_s(0.0) { for( int c=0; c<PerfCounters::N_COUNTERS; ++c ){ counts[c] = -1.0; } }
+	int n, rows, reps;
+	double best_s; // fastest project over all elements
+	double counts[PerfCounters::N_COUNTERS]; // per element in the fastest rep, negative if missing
+};
+
+static void run( const Case &c, int n, int reps, const PerfCounters &perf, Result &r ){
+
+	std::mt19937 gen(0);
+	Kernel k;
+	VectorXd x( 3*c.nodes*n ), x_def( 3*c.nodes*n );
+	for( int e=0; e<n; ++e ){
+		Matrix<double,3,4> rest, deformed;
+		element_nodes( c, gen, rest, deformed );
+		int p[4];
+		for( int j=0; j<c.nodes; ++j ){
+			p[j] = c.nodes*e + j;
+			x.segment<3>( 3*p[j] ) = rest.col(j);
+			x_def.segment<3>( 3*p[j] ) = deformed.col(j);
+		}
+		add_element( c, p, k );
+	}
+
+	r.n = k.size();
+	r.rows = k.initialize( x );
+	r.reps = reps;
+	VectorXd Dx = VectorXd::Zero( r.rows ), u = VectorXd::Zero( r.rows ), z = VectorXd::Zero( r.rows );
+	k.apply_Di( x_def, Dx );
+
+	// Untimed first pass to fault in z and the warm starts
+	k.project( Dx, u, z );
+
+	// Each rep starts from u = 0 and reset warm starts (nh, stvk and fung keep theirs
+	// between projects), so they all do the same work as the first step of a sim.
+	// Counters are from the same rep as best_s, so ipc matches the time.
+	r.best_s = 1e10;
+	for( int rep=0; rep<reps; ++rep ){
+		u.setZero();
+		k.initialize( x );
+		PerfCounters::Sample s0 = perf.read();
+		Clock::time_point t0 = Clock::now();
+		k.project( Dx, u, z );
+		double s = std::chrono::duration<double>( Clock::now() - t0 ).count();
+		PerfCounters::Sample s1 = perf.read();
+		if( s >= r.best_s ){ continue; }
+		r.best_s = s;
+		for( int ci=0; ci<PerfCounters::N_COUNTERS; ++ci ){
+			const double d = perf.delta( s0, s1, ci );
+			r.counts[ci] = d < 0.0 ? -1.0 : d / double(r.n);
+		}
+	}
+}
+
+
+// Compiler and cpu, to tag the results
+static std::string compiler(){
+#if defined(__clang__)
+	return "clang " __clang_version__;
+#elif defined(__GNUC__)
+	return "gcc " __VERSION__;
+#else
+	return "unknown";
+#endif
+}
+
+static std::string cpu(){
+	std::ifstream info( "/proc/cpuinfo" );
+	std::string line;
+	while( std::getline( info, line ) ){
+		if( line.compare( 0, 10, "model name" ) != 0 ){ continue; }
+		size_t p = line.find( ':' );
+		if( p != std::string::npos && p+2 < line.size() ){ return line.substr( p+2 ); }
+	}
+	return "unknown";
+}
+
+// Empty if the count is missing
+static std::string count_str( double v, int precision ){
+	if( v < 0.0 ){ return ""; }
+	std::stringstream ss; ss << std::fixed << std::setprecision( precision ) << v;
+	return ss.str();
+}
+
+
+int main(int argc, char *argv[]){
+
+	// Open the counters first, before the OpenMP threads start
+	PerfCounters perf;
+
+	int n = 100000, reps = 5, n_threads = 1;
+	std::vector<std::string> forces;
+	std::string out_file = std::string(OUTPUT_DIR) + "/force_bench.csv";
+	for( int i=1; i<argc; ++i ){
+		std::string arg( argv[i] );
+		if( arg == "-help" ){
+			std::cout << "\nUsage: force-bench [-n <elements>] [-reps <int>] [-threads <int>]" <<
+				" [-forces <name,name,...>] [-out <file.csv>]\n\tforces:";
+			for( const Case &c : cases ){ std::cout << " " << c.force; }
+			std::cout << std::endl;
+			return 0;
+		}
+		if( i+1 >= argc ){ break; }
+		std::stringstream val( argv[i+1] );
+		if( arg == "-n" ){ val >> n; }
+		else if( arg == "-reps" ){ val >> reps; }
+		else if( arg == "-threads" ){ val >> n_threads; }
+		else if( arg == "-out" ){ val >> out_file; }
+		else if( arg == "-forces" ){ forces = split( argv[i+1] ); }
+	}
+	n = std::max( n, 1 );
+	reps = std::max( reps, 1 );
+#ifdef _OPENMP
+	omp_set_num_threads( std::max( n_threads, 1 ) );
+	n_threads = omp_get_max_threads();
+#else
+	n_threads = 1;
+#endif
+
+	const std::string comp = compiler(), proc = cpu();
+	bool have_perf = false;
+	for( int c=0; c<PerfCounters::N_COUNTERS; ++c ){ have_perf = have_perf || perf.available(c); }
+	std::cout << "compiler: " << comp << "\ncpu: " << proc << "\nthreads: " << n_threads <<
+		"\nperf counters: " << ( have_perf ? "yes" : "unavailable" ) << std::endl;
+
+	std::ofstream out( out_file.c_str() );
+	if( !out.is_open() ){ std::cerr << "\n**force-bench Error: Unable to write " << out_file << std::endl; return 1; }
+	out << "kernel,compiler,cpu,threads,elements,rows,reps,best_s,elements_per_s,ns_per_element," <<
+		"cycles_per_element,instructions_per_element,ipc,cache_misses_per_element,branch_misses_per_element" << std::endl;
+
+	std::cout << "\n" << std::left << std::setw(30) << "kernel" << std::right << std::setw(10) << "elements" <<
+		std::setw(12) << "Melem/s" << std::setw(12) << "ns/elem" << std::setw(12) << "cyc/elem" <<
+		std::setw(12) << "instr/elem" << std::setw(8) << "ipc" << std::setw(12) << "cmiss/elem" <<
+		std::setw(12) << "bmiss/elem" << std::endl;
+
+	for( const Case &c : cases ){
+		if( forces.size() > 0 && std::find( forces.begin(), forces.end(), c.force ) == forces.end() ){ continue; }
+
+		Result r;
+		run( c, n, reps, perf, r );
+		const double per_s = r.n / r.best_s, ns = r.best_s * 1e9 / r.n;
+		const double *cnt = r.counts;
+		const double ipc = ( cnt[PerfCounters::CYCLES] > 0.0 && cnt[PerfCounters::INSTRUCTIONS] >= 0.0 ) ?
+			cnt[PerfCounters::INSTRUCTIONS] / cnt[PerfCounters::CYCLES] : -1.0;
+
+		std::cout << std::left << std::setw(30) << c.kernel << std::right << std::setw(10) << r.n <<
+			std::fixed << std::setprecision(3) << std::setw(12) << per_s*1e-6 << std::setprecision(1) << std::setw(12) << ns <<
+			std::setw(12) << count_str( cnt[PerfCounters::CYCLES], 1 ) <<
+			std::setw(12) << count_str( cnt[PerfCounters::INSTRUCTIONS], 1 ) <<
+			std::setw(8) << count_str( ipc, 2 ) <<
+			std::setw(12) << count_str( cnt[PerfCounters::CACHE_MISSES], 3 ) <<
+			std::setw(12) << count_str( cnt[PerfCounters::BRANCH_MISSES], 3 ) << std::endl;
+		std::cout.unsetf( std::ios::floatfield );
+
+		out << c.kernel << ",\"" << comp << "\",\"" << proc << "\"," << n_threads << "," << r.n << "," << r.rows << "," <<
+			r.reps << "," << r.best_s << "," << per_s << "," << ns << "," <<
+			count_str( cnt[PerfCounters::CYCLES], 3 ) << "," << count_str( cnt[PerfCounters::INSTRUCTIONS], 3 ) << "," <<
+			count_str( ipc, 3 ) << "," << count_str( cnt[PerfCounters::CACHE_MISSES], 4 ) << "," <<
+			count_str( cnt[PerfCounters::BRANCH_MISSES], 4 ) << std::endl;
+	}
+
+	std::cout << "\nWrote " << out_file << std::endl;
+	return 0;
+}
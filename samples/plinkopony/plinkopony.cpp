@@ -91,7 +91,9 @@ void setup(){
 	}
 	
 	
-	std::shared_ptr<Force> force( new CollisionForce( shapes ) );
+	// Only nodes near a peg get collision rows, and the pegs are thin
+	// so collisions are swept to keep fast nodes from passing through.
+	std::shared_ptr<Force> force( new CollisionForce( shapes, 32.0, true, 0.1, true ) );
 	context->system->forces.push_back( force );	
 }
 
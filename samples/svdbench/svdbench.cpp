@@ -0,0 +1,148 @@
+// Copyright (c) 2017, University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//
+//	Accuracy and throughput of the svd kernel (SVD3.hpp) compared to Eigen's JacobiSVD,
+//	on the deformation gradients of the bunny and armadillo tet meshes. The meshes are
+//	deformed with random node noise, a stretch, and a squash that inverts every tet.
+//	The batched kernel uses the widest simd lanes the cpu supports.
+//
+
+#include "TetForce.hpp"
+#include "SVD3.hpp"
+#include "MCL/TetMesh.hpp"
+#include <chrono>
+#include <random>
+
+using namespace admm;
+using namespace Eigen;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+struct Errors {
+	Errors() : recon(0.0), orth(0.0), sigma(0.0), det(0.0), sign(0) {}
+	double recon; // max ||U S Vt - F|| / ||F||
+	double orth; // max ||Ut U - I||, ||Vt V - I||
+	double sigma; // max || |S| - S_jacobi || / S_jacobi[0]
+	double det; // max |det(U)-1|, |det(V)-1|
+	int sign; // number of tets where sign(S[2]) != sign(det(F))
+};
+
+// Seconds per matrix for the best of a few repeats
+template<typename F> double time_it( int n, F func ){
+	double best = 1e10;
+	for( int rep=0; rep<5; ++rep ){
+		Clock::time_point t0 = Clock::now();
+		func();
+		double s = std::chrono::duration<double>( Clock::now() - t0 ).count();
+		best = std::min( best, s );
+	}
+	return best / double(n);
+}
+
+void run( const std::string &name, const std::vector<double> &F ){
+
+	const int n = F.size()/9;
+	std::vector<double> U( 9*n ), S( 3*n ), V( 9*n ), R( 9*n ), S_jacobi( 3*n );
+
+	// Throughput
+	double t_jacobi = time_it( n, [&](){
+		for( int i=0; i<n; ++i ){
+			JacobiSVD< Matrix3d > svd( Map<const Matrix3d>( &F[9*i] ), ComputeFullU | ComputeFullV );
+			Map<Matrix3d>( U.data()+9*i ) = svd.matrixU();
+			Map<Vector3d>( S_jacobi.data()+3*i ) = svd.singularValues();
+			Map<Matrix3d>( V.data()+9*i ) = svd.matrixV();
+		}
+	});
+	double t_scalar = time_it( n, [&](){
+		for( int i=0; i<n; ++i ){ svd3::svd<double>( &F[9*i], &U[9*i], &S[3*i], &V[9*i] ); }
+	});
+	double t_batch = time_it( n, [&](){ svd3::svd( n, F.data(), U.data(), S.data(), V.data() ); });
+	double t_polar = time_it( n, [&](){ svd3::polar( n, F.data(), R.data() ); });
+
+	// Accuracy of the batched version
+	Errors err;
+	for( int i=0; i<n; ++i ){
+		Map<const Matrix3d> Fi( &F[9*i] ), Ui( &U[9*i] ), Vi( &V[9*i] );
+		Map<const Vector3d> Si( &S[3*i] ), Si_jacobi( &S_jacobi[3*i] );
+		Matrix3d I = Matrix3d::Identity();
+		err.recon = std::max( err.recon, ( Ui*Si.asDiagonal()*Vi.transpose() - Fi ).norm() / std::max( Fi.norm(), 1e-300 ) );
+		err.orth = std::max( err.orth, std::max( (Ui.transpose()*Ui-I).norm(), (Vi.transpose()*Vi-I).norm() ) );
+		err.sigma = std::max( err.sigma, ( Si.cwiseAbs() - Si_jacobi ).norm() / std::max( Si_jacobi[0], 1e-300 ) );
+		err.det = std::max( err.det, std::max( std::abs(Ui.determinant()-1.0), std::abs(Vi.determinant()-1.0) ) );
+		if( ( Fi.determinant() < 0.0 ) != ( Si[2] < 0.0 ) ){ err.sign++; }
+	}
+
+	std::cout << name << ": " << n << " tets\n" <<
+		"\tJacobiSVD:\t" << t_jacobi*1e9 << " ns\n" <<
+		"\tsvd3 scalar:\t" << t_scalar*1e9 << " ns (" << t_jacobi/t_scalar << "x)\n" <<
+		"\tsvd3 batch:\t" << t_batch*1e9 << " ns (" << t_jacobi/t_batch << "x, " << svd3::simd_width() << " lanes)\n" <<
+		"\tsvd3 polar:\t" << t_polar*1e9 << " ns\n" <<
+		"\terrors: recon " << err.recon << ", orth " << err.orth << ", sigma " << err.sigma <<
+		", det " << err.det << ", sign " << err.sign << std::endl;
+}
+
+int main(int argc, char *argv[]){
+
+	std::string meshes[2] = { "/samples/bunnyexpand/bunny_1124", "/samples/poordillo/dillo919" };
+	std::mt19937 gen(0);
+
+	for( int m=0; m<2; ++m ){
+
+		mcl::TetMesh mesh;
+		if( !mesh.load( std::string(SRC_ROOT_DIR) + meshes[m] ) ){ return EXIT_FAILURE; }
+
+		// Rest state and tets
+		const int n_nodes = mesh.vertices.size();
+		VectorXd x( 3*n_nodes );
+		for( int i=0; i<n_nodes; ++i ){ for( int j=0; j<3; ++j ){ x[3*i+j] = mesh.vertices[i][j]; } }
+		LinearTetStrainBatch tets;
+		for( int t=0; t<mesh.tets.size(); ++t ){
+			tets.add( mesh.tets[t].v[0], mesh.tets[t].v[1], mesh.tets[t].v[2], mesh.tets[t].v[3], 1.0 );
+		}
+		tets.initialize( x, VectorXd::Zero( x.size() ), VectorXd::Ones( x.size() ), 0.04 );
+
+		// Random node noise relative to the mesh size
+		double scale = ( x.maxCoeff() - x.minCoeff() ) * 0.01;
+		std::normal_distribution<double> noise( 0.0, scale );
+		VectorXd x_noise = x;
+		for( int i=0; i<x.size(); ++i ){ x_noise[i] += noise(gen); }
+
+		// Stretch, and squash (inverts every tet) along a random axis. Scaling along
+		// the mesh axes would give diagonal F, which are easy for JacobiSVD.
+		Matrix3d Q = Quaterniond( Vector4d::Random() ).normalized().toRotationMatrix();
+		Matrix3d stretch = Q * Vector3d(3.0,1.0,1.0).asDiagonal() * Q.transpose();
+		Matrix3d squash = Q * Vector3d(1.0,-0.1,1.0).asDiagonal() * Q.transpose();
+		VectorXd x_stretch = x, x_squash = x;
+		for( int i=0; i<n_nodes; ++i ){
+			x_stretch.segment<3>(3*i) = stretch * x.segment<3>(3*i);
+			x_squash.segment<3>(3*i) = squash * x.segment<3>(3*i);
+		}
+
+		std::string cases[3] = { "noise", "stretch", "squash" };
+		VectorXd *deformed[3] = { &x_noise, &x_stretch, &x_squash };
+		for( int c=0; c<3; ++c ){
+			VectorXd F( 9*tets.size() );
+			tets.apply_Di( *deformed[c], F );
+			run( meshes[m].substr( meshes[m].rfind('/')+1 ) + " (" + cases[c] + ")", std::vector<double>( F.data(), F.data()+F.size() ) );
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -77,6 +77,7 @@ bool ForceBuilder::build_trimesh( std::shared_ptr<trimesh::TriMesh> mesh,
 	mcl::Component &force, std::vector< std::shared_ptr<Force> > *sys_forces,
 	int idx_offset ){
 
+	MCL_TRACE_SPAN( "sim", "ForceBuilder::build_trimesh" );
 	using namespace trimesh;
 
 	std::string force_type = mcl::parse::to_lower( force.type );
@@ -91,6 +92,28 @@ bool ForceBuilder::build_trimesh( std::shared_ptr<trimesh::TriMesh> mesh,
 	// See mclscene's VertexSort.hpp for info.
 	std::unordered_map< mcl::int2, int > edges_added;
 
+	//
+	//	Self collision, one force over the whole mesh
+	//
+	if( force_type == "selfcollision" ){
+
+		double thickness = 0.005;
+		if( force.exists("thickness") ){ thickness = force["thickness"].as_double(); }
+		double weight = 32.0;
+		if( force.exists("weight") ){ weight = force["weight"].as_double(); }
+
+		std::vector<int> faces;
+		faces.reserve( mesh.get()->faces.size()*3 );
+		for( int f=0; f<mesh.get()->faces.size(); ++f ){
+			for( int j=0; j<3; ++j ){ faces.push_back( mesh.get()->faces[f].v[j]+idx_offset ); }
+		}
+
+		std::shared_ptr<Force> new_force( new SelfCollisionForce( faces, thickness, weight ) );
+		sys_forces->push_back( new_force );
+		return true;
+
+	} // end self collision
+
 	// Loop over the faces
 	for( int f=0; f<mesh.get()->faces.size(); ++f ){
 
@@ -124,11 +147,8 @@ bool ForceBuilder::build_trimesh( std::shared_ptr<trimesh::TriMesh> mesh,
 //				);
 //				sys_forces->push_back( new_force );
 //			} else {
-				// Strain limited triangle
-				std::shared_ptr<Force> new_force( new
-					LimitedTriangleStrain( p0, p1, p2, stiffness, limit[0], limit[1] )
-				);
-				sys_forces->push_back( new_force );
+				// Strain limited triangle, stored in the system's batch
+				system->get_batch<LimitedTriangleStrainBatch>()->add( p0, p1, p2, stiffness, limit[0], limit[1] );
 //			}
 
 		} // end triangle strain
@@ -168,8 +188,7 @@ bool ForceBuilder::build_trimesh( std::shared_ptr<trimesh::TriMesh> mesh,
 				
 				// If hinge is not already in system, make a bending force out of it
 				if( isUniqueHinge(hv , hingeSignatures) ){
-					std::shared_ptr<Force> new_force( new BendForce( hv[0], hv[1], hv[2], hv[3], stiffness ) );
-					sys_forces->push_back( new_force );
+					system->get_batch<BendForceBatch>()->add( hv[0], hv[1], hv[2], hv[3], stiffness );
 					hingeSignatures.push_back( hv );
 					bend_index += 1;
 				}
@@ -188,8 +207,7 @@ bool ForceBuilder::build_trimesh( std::shared_ptr<trimesh::TriMesh> mesh,
 				
 				// If hinge is not already in system, make a bending force out of it
 				if( isUniqueHinge(hv , hingeSignatures) ){
-					std::shared_ptr<Force> new_force( new BendForce( hv[0], hv[1], hv[2], hv[3], stiffness ) );
-					sys_forces->push_back( new_force );
+					system->get_batch<BendForceBatch>()->add( hv[0], hv[1], hv[2], hv[3], stiffness );
 					hingeSignatures.push_back( hv );
 					bend_index += 1;
 				}
@@ -207,8 +225,7 @@ bool ForceBuilder::build_trimesh( std::shared_ptr<trimesh::TriMesh> mesh,
 				
 				// If hinge is not already in system, make a bending force out of it
 				if( isUniqueHinge(hv , hingeSignatures) ){
-					std::shared_ptr<Force> new_force( new BendForce( hv[0], hv[1], hv[2], hv[3], stiffness ) );
-					sys_forces->push_back( new_force );
+					system->get_batch<BendForceBatch>()->add( hv[0], hv[1], hv[2], hv[3], stiffness );
 					hingeSignatures.push_back( hv );
 					bend_index += 1;
 				}
@@ -249,11 +266,7 @@ bool ForceBuilder::build_trimesh( std::shared_ptr<trimesh::TriMesh> mesh,
 
 				else{
 
-					std::shared_ptr<Force> new_force( new
-						Spring( edges[e][0], edges[e][1], stiffness )
-					);
-
-					sys_forces->push_back( new_force );
+					system->get_batch<SpringBatch>()->add( edges[e][0], edges[e][1], stiffness );
 
 				}
 
@@ -277,6 +290,7 @@ bool ForceBuilder::build_tetmesh( std::shared_ptr<mcl::TetMesh> mesh,
 	mcl::Component &force, std::vector< std::shared_ptr<Force> > *sys_forces,
 	int idx_offset ){
 
+	MCL_TRACE_SPAN( "sim", "ForceBuilder::build_tetmesh" );
 	using namespace trimesh;
 
 	std::string force_type = mcl::parse::to_lower( force.type );
@@ -304,13 +318,9 @@ bool ForceBuilder::build_tetmesh( std::shared_ptr<mcl::TetMesh> mesh,
 				return false;
 			}
 			double stiffness = force["stiffness"].as_double();
-			double weight_scale = 1.0;
-			if( force.exists("weight_scale") ){ weight_scale = force["weight_scale"].as_double(); }
 
-				std::shared_ptr<Force> new_force( new
-					LinearTetStrain( p[0], p[1], p[2], p[3], stiffness, weight_scale )
-				);
-				sys_forces->push_back( new_force );
+				// Linear tet strain, stored in the system's batch
+				system->get_batch<LinearTetStrainBatch>()->add( p[0], p[1], p[2], p[3], stiffness );
 
 		}
 /*
@@ -343,10 +353,8 @@ bool ForceBuilder::build_tetmesh( std::shared_ptr<mcl::TetMesh> mesh,
 			int max_iters = 10;
 			if( force.exists("max_iterations") ){ max_iters = force["max_iterations"].as_int(); }	
 
-			std::shared_ptr<Force> new_force( new
-				HyperElasticTet( p[0], p[1], p[2], p[3], mu, lambda, max_iters, "nh" )
-			);
-			sys_forces->push_back( new_force );
+			// Stored in the system's batch
+			system->get_batch<HyperElasticTetBatch>()->add( p[0], p[1], p[2], p[3], mu, lambda, max_iters, "nh" );
 
 //std::cout << "tet: " << t << std::endl;
 
@@ -362,10 +370,8 @@ bool ForceBuilder::build_tetmesh( std::shared_ptr<mcl::TetMesh> mesh,
 			int max_iters = 10;
 			if( force.exists("max_iterations") ){ max_iters = force["max_iterations"].as_int(); }	
 
-			std::shared_ptr<Force> new_force( new
-				HyperElasticTet( p[0], p[1], p[2], p[3], mu, lambda, max_iters, "stvk" )
-			);
-			sys_forces->push_back( new_force );
+			// Stored in the system's batch
+			system->get_batch<HyperElasticTetBatch>()->add( p[0], p[1], p[2], p[3], mu, lambda, max_iters, "stvk" );
 
 //std::cout << "tet: " << t << std::endl;
 
@@ -427,10 +433,7 @@ bool ForceBuilder::build_tetmesh( std::shared_ptr<mcl::TetMesh> mesh,
 			double rangeMin = force["range_min"].as_double();
 			double rangeMax = force["range_max"].as_double();
 						
-			std::shared_ptr<Force> new_force( new
-				TetVolume( p[0], p[1], p[2], p[3], stiffness, rangeMin, rangeMax )
-			);
-			sys_forces->push_back( new_force );
+			system->get_batch<TetVolumeBatch>()->add( p[0], p[1], p[2], p[3], stiffness, rangeMin, rangeMax );
 			
 		}
 
@@ -467,6 +470,7 @@ int ForceBuilder::index_offset;
 int ForceBuilder::num_objects;
 int ForceBuilder::bend_index=0;
 std::unordered_map< int, std::pair< int, int > > *ForceBuilder::system_to_scene_map;
+std::vector< std::vector<int> > ForceBuilder::tet_surfaces;
 
 
 
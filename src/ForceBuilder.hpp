@@ -24,9 +24,12 @@
 #include "BendForce.hpp"
 #include "AnchorForce.hpp"
 #include "TetForce.hpp"
+#include "SelfCollisionForce.hpp"
+#include "MeshContactForce.hpp"
 #include "System.hpp"
 #include "MCL/DefaultBuilders.hpp"
 #include "MCL/VertexSort.hpp"
+#include "MCL/Trace.hpp"
 
 namespace admm {
 
@@ -45,6 +48,7 @@ public:
 		index_offset=0;
 		num_objects=0;
 		bend_index=0;
+		tet_surfaces.clear();
 	}
 
 	static bool build_trimesh(
@@ -66,6 +70,7 @@ public:
 	static std::unordered_map< std::string, mcl::Component > *force_param_map;
 	static std::unordered_map< int, std::pair< int, int > > *system_to_scene_map;
 	static std::unordered_map< std::string, std::vector< std::string > > obj_to_forces;
+	static std::vector< std::vector<int> > tet_surfaces; // surface faces (system indices) of each dynamic tet mesh
 
 
 	// This callback function is bound to the SceneManager and called when and Object component
@@ -74,6 +79,7 @@ public:
 	// we can use. Then, we can add nodes/forces to the system.
 	static std::shared_ptr<mcl::BaseObject> admm_build_object( mcl::Component &obj ){
 
+		MCL_TRACE_SPAN( "sim", "ForceBuilder::admm_build_object" );
 		num_objects++;
 		using namespace mcl;
 		std::string o_type = parse::to_lower(obj.type);
@@ -303,6 +309,19 @@ public:
 		} // end density weighted mass
 
 
+		//
+		//	Keep the surface of tet meshes for object-object contact
+		//
+		if( o_type == "tetmesh" ){
+			std::shared_ptr<mcl::TetMesh> t_mesh = std::static_pointer_cast<mcl::TetMesh>(object);
+			std::vector<int> faces;
+			faces.reserve( t_mesh->faces.size()*3 );
+			for( int f=0; f<t_mesh->faces.size(); ++f ){
+				for( int j=0; j<3; ++j ){ faces.push_back( t_mesh->faces[f].v[j]+index_offset ); }
+			}
+			tet_surfaces.push_back( faces );
+		}
+
 		index_offset += mesh->vertices.size();
 		return object;
 
@@ -0,0 +1,203 @@
+// Copyright (c) 2017 University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "SDFBaker.hpp"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <deque>
+#include <unordered_map>
+
+#ifndef OUTPUT_DIR
+#define OUTPUT_DIR "."
+#endif
+
+using namespace admm;
+
+static inline Eigen::Vector3d to_eigen( const trimesh::vec &v ){ return Eigen::Vector3d( v[0], v[1], v[2] ); }
+
+// FNV-1a, so cache keys are the same between runs and platforms
+static inline void hash_bytes( uint64_t &h, const void *data, size_t n ){
+	const unsigned char *bytes = (const unsigned char*)data;
+	for( size_t i=0; i<n; ++i ){ h = ( h ^ bytes[i] ) * 1099511628211ull; }
+}
+
+SDFBaker::Settings::Settings() : dx(-1.0), band(0.1), cache_dir(OUTPUT_DIR) {}
+
+
+// Angle-weighted pseudo-normals (Baerentzen and Aanaes 2005). With the normal of the
+// closest feature, the sign of (x-point).dot(n) is right anywhere off a closed surface:
+// the face normal inside a face, the sum of the two face normals on an edge, and the
+// face normals around a vertex weighted by their angle at it.
+struct PseudoNormals {
+	const trimesh::point *verts;
+	std::vector<Eigen::Vector3d> vertex;
+	std::unordered_map<uint64_t,Eigen::Vector3d> edge;
+
+	PseudoNormals( const trimesh::TriMesh &mesh ) : verts( &mesh.vertices[0] ), vertex( mesh.vertices.size(), Eigen::Vector3d::Zero() ) {
+		for( int i=0; i<mesh.faces.size(); ++i ){
+			const trimesh::TriMesh::Face &f = mesh.faces[i];
+			const Eigen::Vector3d p[3] = { to_eigen( verts[f[0]] ), to_eigen( verts[f[1]] ), to_eigen( verts[f[2]] ) };
+			const Eigen::Vector3d n = face( p[0], p[1], p[2] );
+			for( int j=0; j<3; ++j ){
+				const Eigen::Vector3d e1 = p[(j+1)%3] - p[j], e2 = p[(j+2)%3] - p[j];
+				vertex[ f[j] ] += std::atan2( e1.cross( e2 ).norm(), e1.dot( e2 ) ) * n;
+				edge.insert( std::make_pair( key( f[j], f[(j+1)%3] ), Eigen::Vector3d::Zero() ) ).first->second += n;
+			}
+		}
+	}
+
+	// Normal at the closest point on a triangle, from its barycentric coordinates
+	Eigen::Vector3d at( const mcl::TriangleRef *tri, const trimesh::vec &bary ) const {
+		const trimesh::point *p[3] = { tri->p0, tri->p1, tri->p2 };
+		int on[3], n_on = 0; // corners with nonzero weight
+		for( int j=0; j<3; ++j ){ if( bary[j] > 1e-6f ){ on[n_on++] = j; } }
+		if( n_on == 1 ){ return vertex[ p[on[0]]-verts ]; }
+		if( n_on == 2 ){
+			std::unordered_map<uint64_t,Eigen::Vector3d>::const_iterator it = edge.find( key( p[on[0]]-verts, p[on[1]]-verts ) );
+			if( it != edge.end() ){ return it->second; }
+		}
+		return face( to_eigen( *p[0] ), to_eigen( *p[1] ), to_eigen( *p[2] ) );
+	}
+
+	static inline Eigen::Vector3d face( const Eigen::Vector3d &a, const Eigen::Vector3d &b, const Eigen::Vector3d &c ){
+		const Eigen::Vector3d n = ( b-a ).cross( c-a );
+		const double len = n.norm();
+		return len > 0.0 ? Eigen::Vector3d( n/len ) : Eigen::Vector3d::Zero();
+	}
+	static inline uint64_t key( uint64_t a, uint64_t b ){ return a < b ? ( a << 32 ) | b : ( b << 32 ) | a; }
+};
+
+
+std::shared_ptr<CollisionSDF> SDFBaker::bake( std::shared_ptr<mcl::BaseObject> object, const Settings &settings ){
+
+	std::shared_ptr<trimesh::TriMesh> mesh = object->get_TriMesh();
+	if( mesh==NULL || mesh->faces.size()==0 ){ return NULL; }
+
+	//
+	//	Grid size: by default, 16 cells across the thinnest side
+	//	of the object, but at most 512 along the longest.
+	//
+	trimesh::vec tmin, tmax;
+	object->bounds( tmin, tmax );
+	Eigen::Vector3d bmin = to_eigen( tmin ), bmax = to_eigen( tmax );
+	Eigen::Vector3d size = bmax - bmin;
+	double dx = settings.dx;
+	if( dx <= 0.0 ){ dx = std::max( size.minCoeff()/16.0, size.maxCoeff()/512.0 ); }
+	if( dx <= 0.0 ){ dx = 1e-3; }
+	const double band = std::max( settings.band, 4.0*dx );
+	const Eigen::Vector3d origin = bmin - Eigen::Vector3d::Constant( band+dx );
+	Eigen::Vector3i dims;
+	for( int i=0; i<3; ++i ){ dims[i] = int( std::ceil( ( size[i] + 2.0*( band+dx ) ) / dx ) ) + 1; }
+
+	//
+	//	Load it from the cache if it's there
+	//
+	// The version changes with how grids are baked, so older cache files aren't used
+	const int version = 2;
+	uint64_t key = 14695981039346656037ull;
+	hash_bytes( key, &version, sizeof(version) );
+	for( int i=0; i<mesh->vertices.size(); ++i ){ hash_bytes( key, &mesh->vertices[i][0], 3*sizeof(float) ); }
+	for( int i=0; i<mesh->faces.size(); ++i ){ hash_bytes( key, &mesh->faces[i][0], 3*sizeof(int) ); }
+	hash_bytes( key, &dx, sizeof(dx) );
+	hash_bytes( key, &band, sizeof(band) );
+
+	std::shared_ptr<CollisionSDF> sdf( new CollisionSDF() );
+	std::string cache_file;
+	if( settings.cache_dir.size() > 0 ){
+		std::stringstream ss;
+		ss << settings.cache_dir << "/sdf_" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+		cache_file = ss.str();
+		if( sdf->load( cache_file, key ) ){ return sdf; }
+	}
+
+	std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
+
+	//
+	//	BVH over the surface triangles
+	//
+	mcl::FlatBVH bvh;
+	std::vector< std::shared_ptr<mcl::BaseObject> > objects( 1, object );
+	mcl::BVHBuilder::make_tree_lbvh( bvh, objects );
+	const PseudoNormals normals( *mesh );
+
+	//
+	//	Exact distances for nodes within band of the surface,
+	//	queried a slice of the grid at a time.
+	//
+	sdf->resize( origin, dx, dims, band );
+	sdf->key = key;
+	const int n_nodes = sdf->phi.size();
+	const int slice = dims[0]*dims[1];
+	std::vector<char> known( n_nodes, 0 );
+	std::vector<trimesh::vec> points( slice );
+	std::vector<mcl::ProximityHit> hits;
+	for( int k=0; k<dims[2]; ++k ){
+		for( int idx=0; idx<slice; ++idx ){
+			const Eigen::Vector3d x = sdf->node( idx % dims[0], idx / dims[0], k );
+			points[idx] = trimesh::vec( x[0], x[1], x[2] );
+		}
+		mcl::BVHTraversal::closest_point( bvh, points, hits, band );
+
+#pragma omp parallel for
+		for( int idx=0; idx<slice; ++idx ){
+			if( hits[idx].prim < 0 ){ continue; }
+			const mcl::TriangleRef *tri = dynamic_cast<const mcl::TriangleRef*>( bvh.prims[ hits[idx].prim ].get() );
+			if( tri==NULL ){ continue; }
+			const Eigen::Vector3d x = to_eigen( points[idx] ), point = to_eigen( hits[idx].point );
+			const double sign = ( x-point ).dot( normals.at( tri, hits[idx].bary ) ) < 0.0 ? -1.0 : 1.0;
+			sdf->phi[ k*slice + idx ] = float( sign*std::sqrt( double( hits[idx].dist2 ) ) );
+			known[ k*slice + idx ] = 1;
+		}
+	}
+
+	//
+	//	The band separates the inside from the outside, so the other
+	//	nodes take the sign of the band nodes they are connected to.
+	//
+	std::deque<int> queue;
+	for( int idx=0; idx<n_nodes; ++idx ){ if( known[idx] ){ queue.push_back( idx ); } }
+	while( !queue.empty() ){
+		const int idx = queue.front(); queue.pop_front();
+		const int i = idx % dims[0], j = ( idx / dims[0] ) % dims[1], k = idx / ( dims[0]*dims[1] );
+		const int nbrs[6][3] = { {i-1,j,k}, {i+1,j,k}, {i,j-1,k}, {i,j+1,k}, {i,j,k-1}, {i,j,k+1} };
+		const float val = sdf->phi[idx] < 0.f ? -float(band) : float(band);
+		for( int n=0; n<6; ++n ){
+			if( nbrs[n][0] < 0 || nbrs[n][1] < 0 || nbrs[n][2] < 0 ||
+				nbrs[n][0] >= dims[0] || nbrs[n][1] >= dims[1] || nbrs[n][2] >= dims[2] ){ continue; }
+			const int nidx = sdf->index( nbrs[n][0], nbrs[n][1], nbrs[n][2] );
+			if( known[nidx] ){ continue; }
+			known[nidx] = 1;
+			sdf->phi[nidx] = val;
+			queue.push_back( nidx );
+		}
+	}
+	sdf->finalize();
+
+	std::chrono::duration<double> elapsed_s = std::chrono::system_clock::now() - start;
+	std::cout << "Baked a " << dims[0] << "x" << dims[1] << "x" << dims[2] << " SDF in " << elapsed_s.count() << "s" << std::endl;
+
+	if( cache_file.size() > 0 && !sdf->save( cache_file ) ){
+		std::cerr << "\n**SDFBaker Error: Unable to write " << cache_file << std::endl;
+	}
+
+	return sdf;
+
+} // end bake
@@ -0,0 +1,50 @@
+// Copyright (c) 2017 University of Minnesota
+// 
+// ADMM-Elastic Uses the BSD 2-Clause License (http://www.opensource.org/licenses/BSD-2-Clause)
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other materials
+//    provided with the distribution.
+// THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR  A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE UNIVERSITY OF MINNESOTA, DULUTH OR CONTRIBUTORS BE 
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+// IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+// OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#ifndef ADMM_SDFBAKER_H
+#define ADMM_SDFBAKER_H 1
+
+#include "MCL/BVH.hpp"
+#include "MCL/TriangleMesh.hpp"
+#include "CollisionSDF.hpp" // admm-elastic
+
+namespace admm {
+
+//
+//	SDFBaker voxelizes static scene objects (TriangleMesh or TetMesh surfaces)
+//	into a narrow band CollisionSDF. Closest points are found with a BVH over the
+//	object's triangles, and the sign comes from the normals at the closest point.
+//	Baked grids are cached in cache_dir, keyed on a hash of the mesh and settings.
+//
+class SDFBaker {
+public:
+	struct Settings {
+		double dx; // grid spacing, or <= 0 to pick one from the object bounds
+		double band; // distances are exact within band, at least 4 dx
+		std::string cache_dir; // empty to disable the cache
+		Settings();
+	};
+
+	// Returns NULL if the object has no surface triangles
+	static std::shared_ptr<CollisionSDF> bake( std::shared_ptr<mcl::BaseObject> object, const Settings &settings=Settings() );
+};
+
+} // end namespace admm
+
+#endif
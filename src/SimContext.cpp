@@ -18,6 +18,7 @@
 // OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "SimContext.hpp"
+#include "CollisionForce.hpp"
 
 SimContext::SimContext(){
 
@@ -38,6 +39,7 @@ SimContext::SimContext(){
 
 void SimContext::load( std::string config_file ){
 
+	MCL_TRACE_SPAN( "sim", "SimContext::load" );
 	//
 	//	First, we want to load any force properties and store them in force_param_map
 	//
@@ -69,6 +71,16 @@ void SimContext::load( std::string config_file ){
 				else if( params[i].tag=="timestep" ){ system->settings.timestep_s = params[i].as_double(); }
 				else if( params[i].tag=="realtime" ){ settings.run_realtime = params[i].as_bool(); }
 				else if( params[i].tag=="verbose" ){ system->settings.verbose = params[i].as_int(); }
+				else if( params[i].tag=="converge" ){ system->settings.converge = params[i].as_bool(); }
+				else if( params[i].tag=="max_iterations" ){ system->settings.max_admm_iters = params[i].as_int(); }
+				else if( params[i].tag=="primal_tol" ){ system->settings.primal_tol = params[i].as_double(); }
+				else if( params[i].tag=="dual_tol" ){ system->settings.dual_tol = params[i].as_double(); }
+				else if( params[i].tag=="linear_solver" ){ system->settings.linear_solver = mcl::parse::to_lower( params[i].as_string() ); }
+				else if( params[i].tag=="linear_solver_iterations" ){ system->settings.linsolve_iters = params[i].as_int(); }
+				else if( params[i].tag=="linear_solver_tol" ){ system->settings.linsolve_tol = params[i].as_double(); }
+				else if( params[i].tag=="chebyshev_rho" ){ system->settings.cheby_rho = params[i].as_double(); }
+				else if( params[i].tag=="lowrank_rows" ){ system->settings.lowrank_rows = params[i].as_int(); }
+				else if( params[i].tag=="matrix_free" ){ system->settings.matrix_free_D = params[i].as_bool(); }
 
 			} // end loop params
 
@@ -104,6 +116,7 @@ void SimContext::load( std::string config_file ){
 
 void SimContext::initialize(){
 
+	MCL_TRACE_SPAN( "sim", "SimContext::initialize" );
 	//
 	//	Loop over the force_param_map and gravity, wind, or anchor forces forces
 	//	This happens at initialize, because wind forces are applied to all triangles
@@ -162,9 +175,95 @@ void SimContext::initialize(){
 		}
 
 
+		else if( type=="contact" ){
+
+			// Contact between all dynamic tet meshes, e.g.
+			// <Force name="contact" type="Contact" > <thickness value="0.005" /> </Force>
+			double thickness = 0.005;
+			if( f_it->second.exists("thickness") ){ thickness = f_it->second["thickness"].as_double(); }
+			double weight = 32.0;
+			if( f_it->second.exists("weight") ){ weight = f_it->second["weight"].as_double(); }
+			if( admm::ForceBuilder::tet_surfaces.size() < 2 ){
+				std::cerr << "\n**SimContext::initialize Error: Contact needs at least two dynamic tet meshes" << std::endl;
+				continue;
+			}
+			std::shared_ptr<admm::Force> mcf( new admm::MeshContactForce( admm::ForceBuilder::tet_surfaces, thickness, weight ) );
+			system->forces.push_back( mcf );
+		}
+
+
 	} // end add other force types
 
 
+	//
+	//	Static objects with <Collide value="1" /> become signed distance field
+	//	obstacles. The grid spacing can be set with <collide_dx value="..." />.
+	//	Collisions are swept unless an object sets <collide_ccd value="0" />.
+	//	Obstacles can be moved with keyframes relative to where they are placed:
+	//	<keyframe value="time  tx ty tz  rx ry rz" /> (rotation in degrees about
+	//	x, y, then z, around the object's center).
+	//
+	std::vector< std::shared_ptr<admm::CollisionShape> > sdf_shapes;
+	bool sdf_swept = true;
+	std::unordered_map< std::string, std::vector<mcl::Param> >::iterator o_it = scene->object_params.begin();
+	for( ; o_it != scene->object_params.end(); ++o_it ){
+
+		bool collide = false, has_force = false, ccd = true;
+		admm::SDFBaker::Settings sdf_settings;
+		std::vector<mcl::Param> keyframes;
+		for( int p=0; p<o_it->second.size(); ++p ){
+			const mcl::Param &param = o_it->second[p];
+			if( param.tag=="force" ){ has_force=true; }
+			else if( param.tag=="keyframe" ){ keyframes.push_back( param ); }
+			else if( param.tag=="collide" ){ collide = param.as_bool(); }
+			else if( param.tag=="collide_dx" ){ sdf_settings.dx = param.as_double(); }
+			else if( param.tag=="collide_ccd" ){ ccd = param.as_bool(); }
+		}
+		if( !collide ){ continue; }
+		if( has_force ){
+			std::cerr << "\n**SimContext::initialize Error: Only static objects can collide, skipping " << o_it->first << std::endl;
+			continue;
+		}
+
+		std::shared_ptr<admm::CollisionSDF> sdf = admm::SDFBaker::bake( scene->objects_map[ o_it->first ], sdf_settings );
+		if( sdf==NULL ){ throw std::runtime_error("\nSimContext::initialize Error: Unable to make an SDF for "+o_it->first); }
+		sdf_swept = sdf_swept && ccd;
+		if( keyframes.size()==0 ){
+			sdf_shapes.push_back( sdf );
+			continue;
+		}
+
+		// Keyframed obstacle
+		std::shared_ptr<admm::KinematicShape> ks( new admm::KinematicShape( sdf, 0.5*( sdf->inside_min + sdf->inside_max ) ) );
+		for( int k=0; k<keyframes.size(); ++k ){
+			std::stringstream ss( keyframes[k].as_string() );
+			double t; Eigen::Vector3d translate, rotate;
+			ss >> t >> translate[0] >> translate[1] >> translate[2] >> rotate[0] >> rotate[1] >> rotate[2];
+			if( ss.fail() ){ throw std::runtime_error("\nSimContext::initialize Error: Bad keyframe for "+o_it->first+", expected \"time tx ty tz rx ry rz\""); }
+			rotate *= M_PI/180.0;
+			Eigen::Quaterniond q = Eigen::AngleAxisd( rotate[0], Eigen::Vector3d::UnitX() ) *
+				Eigen::AngleAxisd( rotate[1], Eigen::Vector3d::UnitY() ) * Eigen::AngleAxisd( rotate[2], Eigen::Vector3d::UnitZ() );
+			ks->add_keyframe( t, translate, q );
+		}
+		ks->set_time( system->elapsed_s, system->elapsed_s );
+		sdf_shapes.push_back( ks );
+
+		MovingObstacle mo;
+		mo.shape = ks;
+		mo.mesh = scene->objects_map[ o_it->first ]->get_TriMesh();
+		mo.mesh->need_normals();
+		mo.rest_verts = mo.mesh->vertices;
+		mo.rest_normals = mo.mesh->normals;
+		moving_obstacles.push_back( mo );
+
+	} // end loop static objects
+
+	if( sdf_shapes.size() > 0 ){
+		std::shared_ptr<admm::Force> cf( new admm::CollisionForce( sdf_shapes, 32.0, true, 0.1, sdf_swept ) );
+		system->forces.push_back( cf );
+	}
+
+
 	//
 	// Finalize the system. It has own error messages
 	//
@@ -175,6 +274,7 @@ void SimContext::initialize(){
 
 bool SimContext::update( mcl::SceneManager *scene_ ){
 
+	MCL_TRACE_SPAN( "sim", "SimContext::update" );
 	using map_it=std::unordered_map< int, std::pair< int, int > >::const_iterator;
 
 #pragma omp parallel for
@@ -186,6 +286,22 @@ bool SimContext::update( mcl::SceneManager *scene_ ){
 		mesh->vertices[ it->second.second ] = p;
 	} // end loop map
 
+	for( int i=0; i<moving_obstacles.size(); ++i ){
+		const MovingObstacle &mo = moving_obstacles[i];
+		admm::KinematicShape::Pose pose = mo.shape->pose( system->elapsed_s );
+		const int n_verts = mo.rest_verts.size();
+#pragma omp parallel for
+		for( int v=0; v<n_verts; ++v ){
+			const trimesh::point &r = mo.rest_verts[v];
+			Eigen::Vector3d p = pose.apply( Eigen::Vector3d( r[0], r[1], r[2] ) );
+			mo.mesh->vertices[v] = trimesh::point( p[0], p[1], p[2] );
+			if( v >= mo.rest_normals.size() ){ continue; }
+			const trimesh::vec &rn = mo.rest_normals[v];
+			Eigen::Vector3d n = pose.R * Eigen::Vector3d( rn[0], rn[1], rn[2] );
+			mo.mesh->normals[v] = trimesh::vec( n[0], n[1], n[2] );
+		}
+	}
+
 #pragma omp parallel for
 	for( int i=0; i<scene->objects.size(); ++i ){
 		scene->objects[i]->update();
@@ -197,6 +313,7 @@ bool SimContext::update( mcl::SceneManager *scene_ ){
 
 bool SimContext::step( const mcl::SceneManager *scene_, float screen_dt ){
 
+	MCL_TRACE_SPAN( "sim", "SimContext::step" );
 	if( !settings.run_realtime ){ return system->step(); }
 
 	double timeleft = screen_dt;
@@ -23,6 +23,8 @@
 #include "MCL/Simulator.hpp"
 #include "System.hpp" // admm-elastic
 #include "ForceBuilder.hpp"
+#include "SDFBaker.hpp"
+#include "KinematicShape.hpp"
 
 class SimContext : public mcl::Simulator {
 public:
@@ -68,6 +70,16 @@ private:
 	// It's used by ForceBuilder to set values.
 	std::unordered_map< std::string, mcl::Component > force_param_map;
 
+	// Collision objects moved by keyframes, and the rest
+	// positions of their render meshes (posed in update).
+	struct MovingObstacle {
+		std::shared_ptr<admm::KinematicShape> shape;
+		std::shared_ptr<trimesh::TriMesh> mesh;
+		std::vector<trimesh::point> rest_verts;
+		std::vector<trimesh::vec> rest_normals;
+	};
+	std::vector<MovingObstacle> moving_obstacles;
+
 }; // end class SimContext
 
 #endif